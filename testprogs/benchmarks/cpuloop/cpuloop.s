@@ -0,0 +1,19 @@
+; cpuloop - keep the main CPU busy with memory accesses
+;
+; The screen is blanked, so the VIC-II steals no cycles and the time is
+; spent in the CPU emulation and its memory accesses.
+
+        * = $07ff
+        .word $0801
+        .word next, 10
+        .byt $9e, "2061", 0
+next    .word 0
+
+start   sei
+        lda #$0b        ; blank the screen
+        sta $d011
+loop    inc $d020
+        ldx $0400
+        inx
+        stx $0400
+        jmp loop
@@ -0,0 +1,35 @@
+#!/bin/bash
+#
+# run.sh - time x64sc with and without recording the CPU history
+#
+# usage: run.sh <x64sc> [rounds]
+#
+# With +maincpuhistory (and no checkpoints, profiler or code coverage) the
+# copy of the main CPU loop without the monitor hooks is used, with
+# -maincpuhistory the one that records the history and memory map.
+# Prints the user time of each run.
+
+emu=${1:?usage: run.sh <x64sc> [rounds]}
+rounds=${2:-20}
+here=$(cd "$(dirname "$0")" && pwd)
+data=${VICEDATA:-$here/../../../vice/data}
+TIMEFORMAT="%U"
+
+run()
+{
+    echo "$1 $( { time "$emu" -default -directory "$data" -warp \
+        -sounddev dummy -seed 1 +autostart-delay-random \
+        -limitcycles 15000000 -autostart "$here/cpuloop.prg" \
+        "$1" >/dev/null 2>&1; } 2>&1 )"
+}
+
+for ((i = 0; i < rounds; i++)); do
+    # alternate the order, so a changing load hits both the same
+    if ((i % 2 == 0)); then
+        run +maincpuhistory
+        run -maincpuhistory
+    else
+        run -maincpuhistory
+        run +maincpuhistory
+    fi
+done
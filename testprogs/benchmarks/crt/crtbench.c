@@ -0,0 +1,186 @@
+/*
+ * crtbench.c - Benchmark of the PAL CRT emulation renderers.
+ *
+ * Written by
+ *  The VICE team
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Renders a full PAL frame of a VIC-II sized source with
+   render_32_1x1_pal() and render_32_2x2_pal() and prints the CPU time per
+   frame. The color tables are filled with made up but plausible values,
+   the timing does not depend on them.
+
+   Before timing, both renderers draw a number of partial areas with
+   different scanline shade and odd line settings, and a checksum of the
+   results is printed. It has to stay the same when the renderers are
+   only made faster.  */
+
+#include "vice.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "render1x1pal.h"
+#include "render2x2pal.h"
+#include "types.h"
+#include "video.h"
+
+#define SRC_WIDTH       384
+#define SRC_HEIGHT      272
+#define SRC_PITCH       (SRC_WIDTH + 2 * 32)
+#define SRC_LINES       (SRC_HEIGHT + 2 * 16)
+#define TRG_PITCH       (SRC_WIDTH * 2 * 4)
+#define TRG_LINES       (SRC_LINES * 2)
+
+static video_render_config_t config;
+static uint8_t src[SRC_PITCH * SRC_LINES];
+static uint32_t trg[TRG_PITCH / 4 * TRG_LINES];
+
+static void fill_tables(video_render_color_tables_t *t)
+{
+    int i, y, cb, cr;
+
+    for (i = 0; i < 256; i++) {
+        y = rand() & 255;
+        cb = (rand() % 121) - 60;
+        cr = (rand() % 121) - 60;
+        t->ytablel[i] = y * 128 * 32;
+        t->ytableh[i] = y * 128 * 191;
+        t->cbtable[i] = cb * 50;
+        t->crtable[i] = cr * 50;
+        t->cbtable_odd[i] = cr * 50;
+        t->crtable_odd[i] = -cb * 50;
+        t->cutable[i] = cb * 128;
+        t->cvtable[i] = cr * 128;
+        t->cutable_odd[i] = cr * 128;
+        t->cvtable_odd[i] = -cb * 128;
+    }
+    for (i = 0; i < 256 * 3; i++) {
+        t->gamma_red[i] = (uint32_t)rand();
+        t->gamma_grn[i] = (uint32_t)rand();
+        t->gamma_blu[i] = (uint32_t)rand();
+    }
+    for (i = 0; i < 256 * 6; i++) {
+        t->gamma_red_fac[i] = (uint32_t)rand();
+        t->gamma_grn_fac[i] = (uint32_t)rand();
+        t->gamma_blu_fac[i] = (uint32_t)rand();
+    }
+    t->alpha = 0xff000000U;
+}
+
+static uint64_t hash_result(uint64_t h)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof trg / sizeof trg[0]; i++) {
+        h = (h ^ trg[i]) * 1099511628211ULL;
+    }
+    for (i = 0; i < SRC_WIDTH * 2 * 3; i++) {
+        h = (h ^ (uint16_t)config.color_tables.prevrgbline[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static uint64_t check(void)
+{
+    uint64_t h = 1469598103934665603ULL;
+    unsigned int ys, xt, yt, height;
+    int c;
+
+    for (c = 0; c < 24; c++) {
+        ys = (unsigned int)(c % 3) * 7 + 1;
+        xt = c & 1;
+        yt = (c >> 1) & 1;
+        height = 200 + (unsigned int)(c % 5) * 2;
+        config.video_resources.pal_scanlineshade = (c % 4) * 333;
+        config.video_resources.pal_oddlines_offset = (c % 3) * 700;
+
+        memset(trg, 0x55, sizeof trg);
+        render_32_1x1_pal(&config.color_tables, src, (uint8_t *)trg,
+                          SRC_WIDTH - 32 - (c & 7), height / 2, 24 + (c & 3),
+                          ys, xt, yt, SRC_PITCH, TRG_PITCH, &config);
+        h = hash_result(h);
+
+        memset(trg, 0x55, sizeof trg);
+        render_32_2x2_pal(&config.color_tables, src, (uint8_t *)trg,
+                          SRC_WIDTH * 2 - (c & 7), height, 24 + (c & 3),
+                          ys, xt, yt, SRC_PITCH, TRG_PITCH,
+                          ys / 2 + 3, ys / 2 + 3 + (c % 2 ? 90 : 130), &config);
+        h = hash_result(h);
+    }
+    return h;
+}
+
+static double cpu_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 500;
+    double start;
+    int i;
+
+    if (frames < 1) {
+        fprintf(stderr, "usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    /* text like pattern with some noise */
+    for (i = 0; i < (int)sizeof src; i++) {
+        src[i] = (uint8_t)((i * 7 + (i / SRC_PITCH) * 13) % 251 % 16);
+        if ((rand() & 7) == 0) {
+            src[i] ^= (uint8_t)(rand() & 15);
+        }
+    }
+    fill_tables(&config.color_tables);
+
+    printf("checksum %016llx\n", (unsigned long long)check());
+
+    config.video_resources.pal_scanlineshade = 667;
+    config.video_resources.pal_oddlines_offset = 1000;
+
+    start = cpu_time();
+    for (i = 0; i < frames; i++) {
+        render_32_1x1_pal(&config.color_tables, src, (uint8_t *)trg,
+                          SRC_WIDTH, SRC_HEIGHT, 32, 16, 0, 0,
+                          SRC_PITCH, TRG_PITCH, &config);
+    }
+    printf("1x1 PAL  %8.1f us/frame\n", (cpu_time() - start) * 1e6 / frames);
+
+    start = cpu_time();
+    for (i = 0; i < frames; i++) {
+        render_32_2x2_pal(&config.color_tables, src, (uint8_t *)trg,
+                          SRC_WIDTH * 2, SRC_HEIGHT * 2, 32, 16, 0, 0,
+                          SRC_PITCH, TRG_PITCH, 16, 16 + SRC_HEIGHT - 1, &config);
+    }
+    printf("2x2 PAL  %8.1f us/frame\n", (cpu_time() - start) * 1e6 / frames);
+
+    return 0;
+}
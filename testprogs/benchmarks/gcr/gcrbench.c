@@ -0,0 +1,206 @@
+/*
+ * gcrbench.c - Benchmark of the GCR encoding and decoding in gcr.c.
+ *
+ * Written by
+ *  The VICE team
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Encodes tracks 35 to 42 of a 1541 disk full of random data, then
+   decodes them sector by sector (gcr_read_sector(), as used for single
+   sector reads) and track by track (gcr_read_track(), as used when a
+   written track is converted back), and prints the time per pass.
+   Every pass is checked against the original data.
+
+   The tracks are rotated by an odd number of bits before decoding, like
+   tracks written by the drive emulation, so the unaligned paths of the
+   decoder are measured too.
+
+   gcr_read_track() only exists since VICE 3.10; build with
+   -DNO_READ_TRACK to measure an older gcr.c.  */
+
+#include "vice.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gcr.h"
+#include "lib.h"
+
+#define FIRST_TRACK     35
+#define LAST_TRACK      42
+#define NUM_TRACKS      (LAST_TRACK - FIRST_TRACK + 1)
+#define SECTORS         17      /* sectors per track in speed zone 0 */
+#define GAP             9
+#define SYNC            5
+
+/* gcr.c only needs these from the rest of VICE */
+void *lib_malloc(size_t size)
+{
+    return malloc(size);
+}
+
+void *lib_calloc(size_t nmemb, size_t size)
+{
+    return calloc(nmemb, size);
+}
+
+void lib_free(void *ptr)
+{
+    free(ptr);
+}
+
+static uint8_t sectors[NUM_TRACKS][SECTORS][256];
+static uint8_t track_data[NUM_TRACKS][NUM_MAX_BYTES_TRACK];
+static disk_track_t tracks[NUM_TRACKS];
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void encode_tracks(void)
+{
+    gcr_header_t header;
+    uint8_t *p;
+    int t, s;
+
+    for (t = 0; t < NUM_TRACKS; t++) {
+        tracks[t].data = track_data[t];
+        tracks[t].size = NUM_MAX_BYTES_TRACK;
+        memset(track_data[t], 0x55, NUM_MAX_BYTES_TRACK);
+        p = track_data[t];
+        for (s = 0; s < SECTORS; s++) {
+            header.sector = (uint8_t)s;
+            header.track = (uint8_t)(t + FIRST_TRACK);
+            header.id2 = 'B';
+            header.id1 = 'A';
+            gcr_convert_sector_to_GCR(sectors[t][s], p, &header, GAP, SYNC,
+                                      CBMDOS_FDC_ERR_OK);
+            p += SECTOR_GCR_SIZE_WITH_HEADER + GAP + SYNC + 5;
+        }
+    }
+}
+
+/* rotate a track left by `bits' bits */
+static void rotate_track(uint8_t *data, int size, int bits)
+{
+    uint8_t *copy = malloc((size_t)size);
+    int i, src;
+
+    memcpy(copy, data, (size_t)size);
+    memset(data, 0, (size_t)size);
+    for (i = 0; i < size * 8; i++) {
+        src = (i + bits) % (size * 8);
+        if (copy[src >> 3] & (0x80 >> (src & 7))) {
+            data[i >> 3] |= (uint8_t)(0x80 >> (i & 7));
+        }
+    }
+    free(copy);
+}
+
+static int check(int t, int s, const uint8_t *data, fdc_err_t err)
+{
+    if (err != CBMDOS_FDC_ERR_OK || memcmp(data, sectors[t][s], 256) != 0) {
+        fprintf(stderr, "track %d sector %d decoded wrong\n", t + FIRST_TRACK, s);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t buffer[SECTORS * 256];
+    fdc_err_t errors[SECTORS];
+    int passes = argc > 1 ? atoi(argv[1]) : 2000;
+    double start;
+    int i, t, s;
+
+    if (passes < 1) {
+        fprintf(stderr, "usage: %s [passes]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    for (t = 0; t < NUM_TRACKS; t++) {
+        for (s = 0; s < SECTORS; s++) {
+            for (i = 0; i < 256; i++) {
+                sectors[t][s][i] = (uint8_t)rand();
+            }
+        }
+    }
+
+    printf("tracks %d-%d, %d passes\n", FIRST_TRACK, LAST_TRACK, passes);
+
+    start = now();
+    for (i = 0; i < passes; i++) {
+        encode_tracks();
+    }
+    printf("encode                %8.2f us/pass\n", (now() - start) * 1e6 / passes);
+
+    for (t = 0; t < NUM_TRACKS; t++) {
+        rotate_track(track_data[t], NUM_MAX_BYTES_TRACK, 37 * t + 3);
+    }
+
+    start = now();
+    for (i = 0; i < passes; i++) {
+        for (t = 0; t < NUM_TRACKS; t++) {
+            for (s = 0; s < SECTORS; s++) {
+                errors[s] = gcr_read_sector(&tracks[t], buffer + s * 256, (uint8_t)s);
+            }
+        }
+    }
+    printf("decode, by sector     %8.2f us/pass\n", (now() - start) * 1e6 / passes);
+
+#ifndef NO_READ_TRACK
+    start = now();
+    for (i = 0; i < passes; i++) {
+        for (t = 0; t < NUM_TRACKS; t++) {
+            gcr_read_track(&tracks[t], buffer, errors, SECTORS);
+        }
+    }
+    printf("decode, by track      %8.2f us/pass\n", (now() - start) * 1e6 / passes);
+#endif
+
+    for (t = 0; t < NUM_TRACKS; t++) {
+#ifndef NO_READ_TRACK
+        memset(buffer, 0, sizeof buffer);
+        gcr_read_track(&tracks[t], buffer, errors, SECTORS);
+        for (s = 0; s < SECTORS; s++) {
+            if (check(t, s, buffer + s * 256, errors[s]) < 0) {
+                return 1;
+            }
+        }
+#endif
+        for (s = 0; s < SECTORS; s++) {
+            errors[s] = gcr_read_sector(&tracks[t], buffer + s * 256, (uint8_t)s);
+            if (check(t, s, buffer + s * 256, errors[s]) < 0) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
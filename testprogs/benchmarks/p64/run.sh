@@ -0,0 +1,45 @@
+#!/bin/bash
+#
+# run.sh - time an autostart with true drive emulation from a G64 and a P64
+#
+# usage: run.sh <x64sc> <c1541> [rounds]
+#
+# bench.p64 holds ../cpuloop/cpuloop.prg as "loop", on a disk formatted
+# with c1541 -format "bench,01" g64 and converted to P64 pulse streams.
+# The same G64 is made again with c1541 for each run of this script, so
+# both images have the same tracks. The program is loaded and running
+# after 8M cycles, the rest of the 10M is the drive idling.
+# Prints the user time of each run.
+
+emu=${1:?usage: run.sh <x64sc> <c1541> [rounds]}
+c1541=${2:?usage: run.sh <x64sc> <c1541> [rounds]}
+rounds=${3:-20}
+here=$(cd "$(dirname "$0")" && pwd)
+data=${VICEDATA:-$here/../../../vice/data}
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+TIMEFORMAT="%U"
+
+"$c1541" -format "bench,01" g64 "$tmp/bench.g64" \
+    -write "$here/../cpuloop/cpuloop.prg" loop >/dev/null 2>&1 || exit 1
+# a copy, so a write back on close would not change the one in the tree
+cp "$here/bench.p64" "$tmp/bench.p64"
+
+run()
+{
+    echo "$1 $( { time "$emu" -default -directory "$data" -warp \
+        -sounddev dummy -seed 1 +autostart-delay-random -drive8truedrive \
+        -limitcycles 10000000 -autostart "$tmp/bench.$1" \
+        >/dev/null 2>&1; } 2>&1 )"
+}
+
+for ((i = 0; i < rounds; i++)); do
+    # alternate the order, so a changing load hits both the same
+    if ((i % 2 == 0)); then
+        run g64
+        run p64
+    else
+        run p64
+        run g64
+    fi
+done
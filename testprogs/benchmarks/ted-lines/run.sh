@@ -0,0 +1,45 @@
+#!/bin/bash
+#
+# run.sh - time the TED rendering of an unchanged screen
+#
+# usage: run.sh [-r rounds] <xplus4> [<xplus4> ...]
+#
+# Runs xplus4 for 200M cycles at the READY prompt, without a program and
+# without true drive emulation, with each of the given emulators in turn.
+# Prints the mean of the videochip column of the -frametimingfile output,
+# the microseconds per frame spent in the TED emulation and its drawing.
+
+rounds=5
+if [ "$1" = "-r" ]; then
+    rounds=$2
+    shift 2
+fi
+if [ $# -lt 1 ]; then
+    echo "usage: run.sh [-r rounds] <xplus4> [<xplus4> ...]" >&2
+    exit 1
+fi
+here=$(cd "$(dirname "$0")" && pwd)
+data=${VICEDATA:-$here/../../../vice/data}
+tmp=$(mktemp -d) || exit 1
+trap 'rm -rf "$tmp"' EXIT
+
+run()
+{
+    rm -f "$tmp/ft.csv"
+    "$1" -default -directory "$data" -warp -sounddev dummy -seed 1 \
+        +drive8truedrive -limitcycles 200000000 \
+        -frametimingfile "$tmp/ft.csv" >/dev/null 2>&1
+    # the first frame holds the startup
+    echo "$1 $(awk -F, '
+        NR == 1 { for (i = 1; i <= NF; i++) if ($i == "videochip") col = i }
+        NR > 2 { sum += $col; n++ }
+        END { if (n) printf "%.1f us/frame", sum / n }' "$tmp/ft.csv")"
+}
+
+for ((i = 0; i < rounds; i++)); do
+    # rotate the order, so a changing load hits all of them the same
+    for ((j = 0; j < $#; j++)); do
+        k=$(( (i + j) % $# + 1 ))
+        run "${!k}"
+    done
+done
@@ -0,0 +1,38 @@
+#!/bin/bash
+#
+# run.sh - time the x64sc VIC-II renderer on a sprite heavy screen
+#
+# usage: run.sh [-r rounds] <x64sc> [<x64sc> ...]
+#
+# Runs sprites.prg for 60M cycles (about 61 emulated seconds) with each
+# of the given emulators in turn, so two builds of the renderer can be
+# compared. Prints the user time of each run.
+
+rounds=10
+if [ "$1" = "-r" ]; then
+    rounds=$2
+    shift 2
+fi
+if [ $# -lt 1 ]; then
+    echo "usage: run.sh [-r rounds] <x64sc> [<x64sc> ...]" >&2
+    exit 1
+fi
+here=$(cd "$(dirname "$0")" && pwd)
+data=${VICEDATA:-$here/../../../vice/data}
+TIMEFORMAT="%U"
+
+run()
+{
+    echo "$1 $( { time "$1" -default -directory "$data" -warp \
+        -sounddev dummy -seed 1 +autostart-delay-random \
+        -limitcycles 60000000 -autostart "$here/sprites.prg" \
+        >/dev/null 2>&1; } 2>&1 )"
+}
+
+for ((i = 0; i < rounds; i++)); do
+    # rotate the order, so a changing load hits all of them the same
+    for ((j = 0; j < $#; j++)); do
+        k=$(( (i + j) % $# + 1 ))
+        run "${!k}"
+    done
+done
@@ -0,0 +1,129 @@
+; sprites - sprite heavy VIC-II screen for timing the x64sc renderer
+;
+; 8 multicolor sprites, some of them expanded, over a text screen. They
+; are reused further down the screen, so 16 sprites are shown per frame.
+; The video mode is switched (ECM, bitmap, both) at three lines and the
+; xscroll changes every frame, so both the per pixel and the 8 pixel span
+; paths of vicii-draw-cycle.c are used.
+
+        * = $07ff
+        .word $0801
+        .word next, 10
+        .byt $9e, "2061", 0
+next    .word 0
+start   sei
+        lda #$35
+        sta $01
+        ; fill screen with chars and colors
+        ldx #0
+fill    txa
+        sta $0400,x
+        sta $0500,x
+        sta $0600,x
+        sta $06e8,x
+        sta $d800,x
+        sta $d900,x
+        sta $da00,x
+        sta $dae8,x
+        inx
+        bne fill
+        ; sprite data at $3000 (pointer $c0)
+        ldx #0
+sdat    txa
+        eor #$a5
+        sta $3000,x
+        inx
+        cpx #64
+        bne sdat
+        ldx #7
+sptr    lda #$c0
+        sta $07f8,x
+        txa
+        sta $d027,x
+        dex
+        bpl sptr
+        lda #$ff
+        sta $d015
+        lda #$55
+        sta $d01c
+        lda #$33
+        sta $d01d
+        lda #$0f
+        sta $d017
+        lda #$a0
+        sta $d01b
+        lda #2
+        sta $d025
+        lda #7
+        sta $d026
+        lda #$18
+        sta $d016
+frame   ; wait for line $30
+w1      lda $d012
+        cmp #$30
+        bne w1
+        ldx #0
+        ldy #0
+pos1    lda xpos,x
+        sta $d000,y
+        lda #$40
+        sta $d001,y
+        iny
+        iny
+        inx
+        cpx #8
+        bne pos1
+        lda #$c0
+        sta $d010
+        lda #$1b
+        sta $d011
+        ; wait for line $90 and reuse the sprites further down
+w2      lda $d012
+        cmp #$90
+        bne w2
+        ldx #0
+        ldy #0
+pos2    lda xpos,x
+        eor #$ff
+        sta $d000,y
+        lda #$a0
+        sta $d001,y
+        iny
+        iny
+        inx
+        cpx #8
+        bne pos2
+        lda #$03
+        sta $d010
+        lda #$5b
+        sta $d011
+w3      lda $d012
+        cmp #$c0
+        bne w3
+        lda #$3b
+        sta $d011
+w4      lda $d012
+        cmp #$e0
+        bne w4
+        lda #$7b
+        sta $d011
+        ; move
+        ldx #7
+mv      inc xpos,x
+        txa
+        lsr
+        bcc mv2
+        inc xpos,x
+mv2     dex
+        bpl mv
+        lda $d01e
+        lda $d01f
+        inc $d020
+        dec $d020
+        ldx $d016
+        inx
+        txa
+        and #$17
+        sta $d016
+        jmp frame
+xpos    .byt 10, 40, 70, 100, 130, 160, 190, 220
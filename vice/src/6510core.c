@@ -54,6 +54,7 @@
 #endif
 #endif
 
+#include "coverage.h"
 #include "traps.h"
 
 #ifndef DRIVE_CPU
@@ -2373,6 +2374,10 @@ static const uint8_t rewind_fetch_tab[] = {
         }
 #endif
 
+        if (coverage_enabled) {
+            coverage_exec(CALLER, (uint16_t)reg_pc);
+        }
+
         SET_LAST_ADDR(reg_pc);
 
         /* HACK: The real CPU would stop fetching opcodes all together when
@@ -52,10 +52,24 @@
 #endif
 #endif
 
+#include "coverage.h"
 #include "traps.h"
 
 #include "profiler.h"
 
+/* The CPU emulation may be included more than once into the same function,
+   once with CPU_INSTRUMENTED set to 1 for the copy that feeds the monitor
+   (checkpoints, CPU history, memory map, profiler, code coverage) and once
+   with 0 for a copy that skips all of that. Each copy needs its own TRAP_SKIPPED_LABEL
+   then, and CPU_JAM_OPCODE must be shared by them. */
+#ifndef CPU_INSTRUMENTED
+#define CPU_INSTRUMENTED 1
+#endif
+
+#ifndef TRAP_SKIPPED_LABEL
+#define TRAP_SKIPPED_LABEL trap_skipped
+#endif
+
 #ifndef C64DTV
 /* The C64DTV can use different shadow registers for accu read/write. */
 /* For standard 6510, this is not the case. */
@@ -333,7 +347,7 @@
             /* Transform the IRQ/BRK into an NMI. */                                                                  \
             handler_vector = 0xfffa;                                                                                  \
             TRACE_NMI();                                                                                              \
-            if (monitor_mask[CALLER] & (MI_STEP)) {                                                                   \
+            if (CPU_INSTRUMENTED && (monitor_mask[CALLER] & (MI_STEP))) {                                             \
                 monitor_check_icount_interrupt();                                                                     \
             }                                                                                                         \
             interrupt_ack_nmi(CPU_INT_STATUS);                                                                        \
@@ -360,7 +374,7 @@
             if ((ik & IK_NMI)                                                  \
                 && interrupt_check_nmi_delay(CPU_INT_STATUS, CLK)) {           \
                 TRACE_NMI();                                                   \
-                if (monitor_mask[CALLER] & (MI_STEP)) {                        \
+                if (CPU_INSTRUMENTED && (monitor_mask[CALLER] & (MI_STEP))) {  \
                     monitor_check_icount_interrupt();                          \
                 }                                                              \
                 interrupt_ack_nmi(CPU_INT_STATUS);                             \
@@ -390,7 +404,7 @@
                          || OPINFO_DISABLES_IRQ(LAST_OPCODE_INFO))             \
                      && interrupt_check_irq_delay(CPU_INT_STATUS, CLK)) {      \
                 TRACE_IRQ();                                                   \
-                if (monitor_mask[CALLER] & (MI_STEP)) {                        \
+                if (CPU_INSTRUMENTED && (monitor_mask[CALLER] & (MI_STEP))) {  \
                     monitor_check_icount_interrupt();                          \
                 }                                                              \
                 interrupt_ack_irq(CPU_INT_STATUS);                             \
@@ -429,19 +443,19 @@
         }                                                                      \
         if (ik & (IK_MONITOR | IK_DMA)) {                                      \
             if (ik & IK_MONITOR) {                                             \
-                if (monitor_mask[CALLER] & (MI_STEP)) {                        \
+                if (CPU_INSTRUMENTED && (monitor_mask[CALLER] & (MI_STEP))) {  \
                     EXPORT_REGISTERS();                                        \
                     monitor_check_icount((uint16_t)reg_pc);                    \
                     IMPORT_REGISTERS();                                        \
                 }                                                              \
-                if (monitor_mask[CALLER] & (MI_BREAK)) {                       \
+                if (CPU_INSTRUMENTED && (monitor_mask[CALLER] & (MI_BREAK))) { \
                     EXPORT_REGISTERS();                                        \
                     if (monitor_check_breakpoints(CALLER, (uint16_t)reg_pc)) { \
                         monitor_startup(CALLER);                               \
                     }                                                          \
                     IMPORT_REGISTERS();                                        \
                 }                                                              \
-                if (monitor_mask[CALLER] & (MI_WATCH)) {                       \
+                if (CPU_INSTRUMENTED && (monitor_mask[CALLER] & (MI_WATCH))) { \
                     EXPORT_REGISTERS();                                        \
                     monitor_check_watchpoints(ORIGIN_MEMSPACE, LAST_OPCODE_ADDR, (uint16_t)reg_pc); \
                     IMPORT_REGISTERS();                                        \
@@ -1032,7 +1046,7 @@ FIXME: perhaps we really have to add some randomness to (some) bits
                 REWIND_FETCH_OPCODE(CLK);                                             \
                 SET_OPCODE(trap_result);                                              \
                 IMPORT_REGISTERS();                                                   \
-                goto trap_skipped;                                                    \
+                goto TRAP_SKIPPED_LABEL;                                              \
             } else {                                                                  \
                 IMPORT_REGISTERS();                                                   \
             }                                                                         \
@@ -1193,7 +1207,12 @@ FIXME: perhaps we really have to add some randomness to (some) bits
 
 /* HACK: fix JSR MSB in monitor CPU history */
 #ifdef FEATURE_CPUMEMHISTORY
-#define JSR_FIXUP_MSB(x)    monitor_cpuhistory_fix_p2(x)
+#define JSR_FIXUP_MSB(x)                  \
+    do {                                  \
+        if (CPU_INSTRUMENTED) {           \
+            monitor_cpuhistory_fix_p2(x); \
+        }                                 \
+    } while (0)
 #else
 #define JSR_FIXUP_MSB(x)
 #endif
@@ -1778,17 +1797,23 @@ static const uint8_t fetch_tab[] = {
 #endif
 
 #ifdef FEATURE_CPUMEMHISTORY
-        memmap_state |= (MEMMAP_STATE_INSTR | MEMMAP_STATE_OPCODE);
+        if (CPU_INSTRUMENTED) {
+            memmap_state |= (MEMMAP_STATE_INSTR | MEMMAP_STATE_OPCODE);
+        }
 #endif
 
 #if !defined(DRIVE_CPU)
         profiling_clock_start = CLK;
         stolen_cycles = 0;
-        if (maincpu_profiling) {
+        if (CPU_INSTRUMENTED && maincpu_profiling) {
             profile_sample_start(reg_pc);
         }
 #endif
 
+        if (CPU_INSTRUMENTED && coverage_enabled) {
+            coverage_exec(CALLER, (uint16_t)reg_pc);
+        }
+
         SET_LAST_ADDR(reg_pc);
 
         /* HACK: The real CPU would stop fetching opcodes all together when
@@ -1800,23 +1825,28 @@ static const uint8_t fetch_tab[] = {
          * whatever reason.
          */
         {
+#ifndef CPU_JAM_OPCODE
             static uint8_t lastop;
+#define CPU_JAM_OPCODE lastop
+#endif
             FETCH_OPCODE(opcode);
             if (!CPU_IS_JAMMED) {
                 /* remember current opcode */
-                lastop = p0;
+                CPU_JAM_OPCODE = p0;
             } else {
                 /* set opcode that made the cpu jam */
-                SET_OPCODE(lastop);
+                SET_OPCODE(CPU_JAM_OPCODE);
             }
         }
 
 #ifdef FEATURE_CPUMEMHISTORY
-        /* If reg_pc >= bank_limit  then JSR (0x20) hasn't load p2 yet.
-           The earlier LOAD(reg_pc+2) hack can break stealing badly on x64sc.
-           The fixing is now handled in JSR(). */
-        monitor_cpuhistory_store(debug_clk, reg_pc, p0, p1, p2 >> 8, reg_a_read, reg_x, reg_y, reg_sp, LOCAL_STATUS(), ORIGIN_MEMSPACE);
-        memmap_state &= ~(MEMMAP_STATE_INSTR | MEMMAP_STATE_OPCODE);
+        if (CPU_INSTRUMENTED) {
+            /* If reg_pc >= bank_limit  then JSR (0x20) hasn't load p2 yet.
+               The earlier LOAD(reg_pc+2) hack can break stealing badly on x64sc.
+               The fixing is now handled in JSR(). */
+            monitor_cpuhistory_store(debug_clk, reg_pc, p0, p1, p2 >> 8, reg_a_read, reg_x, reg_y, reg_sp, LOCAL_STATUS(), ORIGIN_MEMSPACE);
+            memmap_state &= ~(MEMMAP_STATE_INSTR | MEMMAP_STATE_OPCODE);
+        }
 #endif
 
 #ifdef DEBUG
@@ -1837,7 +1867,7 @@ static const uint8_t fetch_tab[] = {
         }
 #endif
 
-trap_skipped:
+TRAP_SKIPPED_LABEL:
 #ifndef OPCODE_UPDATE_IN_FETCH
         SET_LAST_OPCODE(p0);
 #endif
@@ -2790,7 +2820,7 @@ trap_skipped:
         }
 
 #if !defined(DRIVE_CPU)
-        if (maincpu_profiling) {
+        if (CPU_INSTRUMENTED && maincpu_profiling) {
             profile_sample_finish(CLK - profiling_clock_start - stolen_cycles, stolen_cycles);
         }
 #endif
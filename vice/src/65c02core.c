@@ -51,6 +51,7 @@
 #define CPU_STR "65(S)C02 CPU"
 #endif
 
+#include "coverage.h"
 #include "traps.h"
 
 /* To avoid 'magic' numbers, we will use the following defines. */
@@ -1646,6 +1647,10 @@
         history_clk = CLK;
 #endif
 #endif
+        if (coverage_enabled) {
+            coverage_exec(CALLER, (uint16_t)reg_pc);
+        }
+
         SET_LAST_ADDR(reg_pc);
         FETCH_OPCODE(opcode);
 
@@ -32,6 +32,7 @@
 
 #include "cmdline.h"
 #include "machine.h"
+#include "palette.h"
 #include "resources.h"
 #include "videoarch.h"
 #include "video.h"
@@ -117,7 +118,8 @@ char video_canvas_can_resize(video_canvas_t *canvas)
 {
     /* printf("%s\n", __func__); */
 
-    return 0;
+    /* there is no window, the canvas takes the size of the visible area */
+    return 1;
 }
 
 /** \brief Create a new video_canvas_s.
@@ -187,10 +189,42 @@ void video_canvas_resize(struct video_canvas_s *canvas, char resize_canvas)
 int video_canvas_set_palette(struct video_canvas_s *canvas,
                              struct palette_s *palette)
 {
+    video_render_color_tables_t *color_tables = &canvas->videoconfig->color_tables;
+    unsigned int i;
+
     /* printf("%s\n", __func__); */
 
     canvas->palette = palette;
 
+    if (palette == NULL) {
+        return 0;
+    }
+
+    /* Nothing is displayed, but the frames rendered for the shared memory
+       export use the same R, G, B, A byte order as the GTK3 renderers. */
+    for (i = 0; i < palette->num_entries; i++) {
+        palette_entry_t color = palette->entries[i];
+#ifdef WORDS_BIGENDIAN
+        uint32_t color_code = (color.red << 24) | (color.green << 16) | (color.blue << 8) | 0xffU;
+#else
+        uint32_t color_code = color.red | (color.green << 8) | (color.blue << 16) | (0xffU << 24);
+#endif
+        video_render_setphysicalcolor(canvas->videoconfig, (int)i, color_code, 32);
+    }
+
+#ifdef WORDS_BIGENDIAN
+    for (i = 0; i < 256; i++) {
+        video_render_setrawrgb(color_tables, i, i << 24, i << 16, i << 8);
+    }
+    video_render_setrawalpha(color_tables, 0xffU);
+#else
+    for (i = 0; i < 256; i++) {
+        video_render_setrawrgb(color_tables, i, i, i << 8, i << 16);
+    }
+    video_render_setrawalpha(color_tables, 0xffU << 24);
+#endif
+    video_render_initraw(canvas->videoconfig);
+
     return 0;
 }
 
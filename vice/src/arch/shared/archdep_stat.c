@@ -71,3 +71,23 @@ int archdep_stat(const char *path, size_t *len, unsigned int *isdir)
     }
     return 0;
 }
+
+
+/** \brief  Determine the time \a path was last modified
+ *
+ * \param[in]   path    pathname
+ * \param[out]  mtime   modification time of \a path
+ *
+ * \return  0 on success, -1 on failure
+ */
+int archdep_stat_mtime(const char *path, time_t *mtime)
+{
+    struct stat statbuf;
+
+    if (stat(path, &statbuf) < 0) {
+        *mtime = 0;
+        return -1;
+    }
+    *mtime = statbuf.st_mtime;
+    return 0;
+}
@@ -28,6 +28,7 @@
 #define ARCHDEP_STAT_H
 
 #include <stddef.h>
+#include <time.h>
 
 /* Visual Studio doesn't provide these macros. */
 #ifdef _MSC_VER
@@ -39,5 +40,6 @@
 #endif
 
 int archdep_stat(const char *filename, size_t *len, unsigned int *isdir);
+int archdep_stat_mtime(const char *filename, time_t *mtime);
 
 #endif
@@ -572,7 +572,8 @@ int probe_disk_image(const char *filename)
     disk_image_t new_image;
 
     new_image.gcr = NULL;
-    new_image.p64 = lib_calloc(1, sizeof(TP64Image));
+    /* no need to decode the pulse streams of P64 images for probing */
+    new_image.p64 = NULL;
     new_image.read_only = 1;
 
     new_image.device = DISK_IMAGE_DEVICE_FS;
@@ -581,13 +582,9 @@ int probe_disk_image(const char *filename)
     disk_image_fsimage_name_set(&new_image, filename);
 
     if (fsimage_open_probe(&new_image) < 0) {
-        P64ImageDestroy((PP64Image) new_image.p64);
-        lib_free(new_image.p64);
         disk_image_media_destroy(&new_image);
         return 0;
     }
-    P64ImageDestroy((PP64Image) new_image.p64);
-    lib_free(new_image.p64);
     disk_image_media_destroy(&new_image);
     return 1;
 }
@@ -623,7 +620,9 @@ static int attach_disk_image(disk_image_t *oldimage, vdrive_t *vdrive,
     }
 
     new_image.gcr = NULL;
-    new_image.p64 = lib_calloc(1, sizeof(TP64Image));
+    /* the pulse streams of P64 images are decoded by drive_image_attach(),
+       into the P64 image of the drive */
+    new_image.p64 = NULL;
     new_image.read_only = (unsigned int)attach_device_readonly_enabled[unit - 8][drive];
 
     switch (devicetype) {
@@ -645,8 +644,6 @@ static int attach_disk_image(disk_image_t *oldimage, vdrive_t *vdrive,
     }
 
     if (disk_image_open(&new_image) < 0) {
-        P64ImageDestroy((PP64Image) new_image.p64);
-        lib_free(new_image.p64);
         disk_image_media_destroy(&new_image);
         return -1;
     }
@@ -656,9 +653,6 @@ static int attach_disk_image(disk_image_t *oldimage, vdrive_t *vdrive,
     image = disk_image_create();
 
     memcpy(image, &new_image, sizeof(disk_image_t));
-    /* free the P64 stuff, fixes the leak in src/attach.c, reported when
-     * using --enable-debug */
-    lib_free(new_image.p64);
 
     switch (unit) {
         case 8:
@@ -0,0 +1,361 @@
+/*
+ * autostart-bootcache.c - Cache the machine state after booting for autostart
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Every autostart power cycles the machine and then waits until BASIC shows
+   its "READY." prompt, which takes a few emulated seconds. When the boot
+   cache is enabled ("AutostartBootCache"), a snapshot of the machine is taken
+   at the "READY." prompt and kept in memory, and the next autostart with the
+   same setup restores it instead of booting again.
+
+   The setup is identified by a hash over the machine name, the contents of
+   all ROM files of the current romset and of the attached cartridge, and the
+   values of all resources that are relevant for events (the ones which have
+   to be the same on both sides of a netplay connection).
+
+   Disk images are not included in the snapshot, so the images attached for
+   the autostart stay in the drives when the snapshot is restored. Tapes are
+   detached by restoring a snapshot without them, autostart puts them back. */
+
+#include "vice.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "archdep.h"
+#include "autostart-bootcache.h"
+#include "lib.h"
+#include "log.h"
+#include "machine.h"
+#include "resources.h"
+#include "sysfile.h"
+#include "types.h"
+
+/* #define DEBUG_AUTOSTART_BOOTCACHE */
+
+#ifdef DEBUG_AUTOSTART_BOOTCACHE
+#define DBG(_x_) log_printf  _x_
+#else
+#define DBG(_x_)
+#endif
+
+#define BOOTCACHE_SIZE 4
+
+#define FNV1A_OFFSET_BASIS  UINT64_C(0xcbf29ce484222325)
+#define FNV1A_PRIME         UINT64_C(0x100000001b3)
+
+typedef struct bootcache_entry_s {
+    uint64_t key;
+    uint8_t *data;      /* snapshot, NULL if the entry is free */
+    size_t size;
+    unsigned long used;
+} bootcache_entry_t;
+
+static bootcache_entry_t bootcache[BOOTCACHE_SIZE];
+static unsigned long bootcache_clock = 0;
+
+/* key of the setup the current autostart runs with */
+static uint64_t current_key;
+
+extern log_t autostart_log;
+
+/* ------------------------------------------------------------------------- */
+
+static uint64_t hash_data(uint64_t hash, const uint8_t *data, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= FNV1A_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t hash_string(uint64_t hash, const char *s)
+{
+    /* include the terminator, so "ab" + "c" differs from "a" + "bc" */
+    return hash_data(hash, (const uint8_t *)s, strlen(s) + 1);
+}
+
+/* Hash the contents of the file `fd' and close it, NULL hashes as empty */
+static uint64_t hash_file(uint64_t hash, FILE *fd)
+{
+    uint8_t buffer[0x1000];
+    size_t len;
+
+    if (fd == NULL) {
+        return hash_string(hash, "");
+    }
+    while ((len = fread(buffer, 1, sizeof buffer, fd)) > 0) {
+        hash = hash_data(hash, buffer, len);
+    }
+    fclose(fd);
+    return hash;
+}
+
+/* Hash the contents of the system file `name', looked up like the ROMs are
+   loaded: in the directory of the machine, or with the drive ROMs. */
+static uint64_t hash_rom_file(uint64_t hash, const char *name)
+{
+    FILE *fd;
+
+    fd = sysfile_open(name, machine_name, NULL, MODE_READ);
+    if (fd == NULL) {
+        fd = sysfile_open(name, "DRIVES", NULL, MODE_READ);
+    }
+    return hash_file(hash, fd);
+}
+
+/* Hash the ROM files of the romset, the list has one `Name="file"' per line */
+static uint64_t hash_romset(uint64_t hash)
+{
+    char *list;
+    char *line;
+    char *next;
+    char *start;
+    char *end;
+
+    list = machine_romset_file_list();
+    if (list == NULL) {
+        return hash;
+    }
+    hash = hash_string(hash, list);
+
+    for (line = list; *line != '\0'; line = next) {
+        next = strchr(line, '\n');
+        if (next != NULL) {
+            *next++ = '\0';
+        } else {
+            next = line + strlen(line);
+        }
+        start = strchr(line, '"');
+        if (start == NULL) {
+            continue;
+        }
+        start++;
+        end = strrchr(start, '"');
+        if (end == NULL || end == start) {
+            continue;
+        }
+        *end = '\0';
+        hash = hash_rom_file(hash, start);
+    }
+    lib_free(list);
+    return hash;
+}
+
+static uint64_t bootcache_key(void)
+{
+    uint64_t hash = FNV1A_OFFSET_BASIS;
+    const char *cartfile = NULL;
+    char *values;
+
+    hash = hash_string(hash, machine_get_name());
+
+    values = resources_write_event_relevant_to_string();
+    hash = hash_string(hash, values);
+    lib_free(values);
+
+    if (resources_exists("CartridgeFile")) {
+        resources_get_string("CartridgeFile", &cartfile);
+    }
+    /* the contents, so a rebuilt cartridge image at the same path does not
+       restore a machine booted with the old one */
+    hash = hash_string(hash, cartfile != NULL ? cartfile : "");
+    if (cartfile != NULL && *cartfile != '\0') {
+        hash = hash_file(hash, fopen(cartfile, MODE_READ));
+    }
+
+    return hash_romset(hash);
+}
+
+static bootcache_entry_t *entry_lookup(uint64_t key)
+{
+    unsigned int i;
+
+    for (i = 0; i < BOOTCACHE_SIZE; i++) {
+        if (bootcache[i].data != NULL && bootcache[i].key == key) {
+            return &bootcache[i];
+        }
+    }
+    return NULL;
+}
+
+static bootcache_entry_t *entry_alloc(void)
+{
+    bootcache_entry_t *victim = &bootcache[0];
+    unsigned int i;
+
+    for (i = 0; i < BOOTCACHE_SIZE; i++) {
+        if (bootcache[i].data == NULL) {
+            return &bootcache[i];
+        }
+        if (bootcache[i].used < victim->used) {
+            victim = &bootcache[i];
+        }
+    }
+    lib_free(victim->data);
+    victim->data = NULL;
+    return victim;
+}
+
+/* ------------------------------------------------------------------------- */
+
+/** \brief  Get ready for an autostart with the current setup
+ *
+ * \return  1 if a snapshot of the booted machine is available for the
+ *          current setup, 0 if the machine has to boot (and should be
+ *          saved with autostart_bootcache_save() once it is ready)
+ */
+int autostart_bootcache_prepare(void)
+{
+    current_key = bootcache_key();
+    DBG(("autostart_bootcache_prepare key %016"PRIx64" %s", current_key,
+         entry_lookup(current_key) != NULL ? "cached" : "not cached"));
+    return entry_lookup(current_key) != NULL ? 1 : 0;
+}
+
+/** \brief  Save the booted machine for the setup of the current autostart
+ *
+ * Must be called from a trap, like all snapshot functions.
+ *
+ * \return  0 on success, -1 on error
+ */
+int autostart_bootcache_save(void)
+{
+    bootcache_entry_t *entry;
+    char *filename = NULL;
+    uint8_t *data = NULL;
+    off_t size;
+    FILE *fd;
+    int result = -1;
+
+    fd = archdep_mkstemp_fd(&filename, MODE_WRITE);
+    if (fd == NULL) {
+        log_error(autostart_log, "Cannot create boot snapshot file.");
+        return -1;
+    }
+    fclose(fd);
+
+    if (machine_write_snapshot(filename, 0, 0, 0) < 0) {
+        log_error(autostart_log, "Cannot write boot snapshot %s.", filename);
+        goto error;
+    }
+
+    fd = fopen(filename, MODE_READ);
+    if (fd == NULL) {
+        log_error(autostart_log, "Cannot open boot snapshot %s.", filename);
+        goto error;
+    }
+    size = archdep_file_size(fd);
+    if (size > 0) {
+        data = lib_malloc((size_t)size);
+        if (fread(data, (size_t)size, 1, fd) != 1) {
+            log_error(autostart_log, "Cannot read boot snapshot %s.", filename);
+            lib_free(data);
+            data = NULL;
+        }
+    }
+    fclose(fd);
+
+    if (data != NULL) {
+        entry = entry_lookup(current_key);
+        if (entry != NULL) {
+            lib_free(entry->data);
+        } else {
+            entry = entry_alloc();
+        }
+        entry->key = current_key;
+        entry->data = data;
+        entry->size = (size_t)size;
+        entry->used = ++bootcache_clock;
+        log_message(autostart_log, "Saved the booted machine (%lu bytes).",
+                    (unsigned long)size);
+        result = 0;
+    }
+
+error:
+    archdep_remove(filename);
+    lib_free(filename);
+    return result;
+}
+
+/** \brief  Restore the booted machine for the setup of the current autostart
+ *
+ * Must be called from a trap, like all snapshot functions.
+ *
+ * \return  0 on success, -1 on error (the machine must be reset then)
+ */
+int autostart_bootcache_restore(void)
+{
+    bootcache_entry_t *entry;
+    char *filename = NULL;
+    FILE *fd;
+    int result = -1;
+
+    entry = entry_lookup(current_key);
+    if (entry == NULL) {
+        return -1;
+    }
+
+    fd = archdep_mkstemp_fd(&filename, MODE_WRITE);
+    if (fd == NULL) {
+        log_error(autostart_log, "Cannot create boot snapshot file.");
+        return -1;
+    }
+    if (fwrite(entry->data, entry->size, 1, fd) != 1) {
+        log_error(autostart_log, "Cannot write boot snapshot file %s.", filename);
+        fclose(fd);
+        goto error;
+    }
+    fclose(fd);
+
+    if (machine_read_snapshot(filename, 0) < 0) {
+        log_error(autostart_log, "Cannot read boot snapshot %s.", filename);
+        /* do not try again with this one */
+        lib_free(entry->data);
+        entry->data = NULL;
+        goto error;
+    }
+    entry->used = ++bootcache_clock;
+    log_message(autostart_log, "Restored the booted machine.");
+    result = 0;
+
+error:
+    archdep_remove(filename);
+    lib_free(filename);
+    return result;
+}
+
+/** \brief  Free all saved snapshots
+ */
+void autostart_bootcache_shutdown(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < BOOTCACHE_SIZE; i++) {
+        lib_free(bootcache[i].data);
+        bootcache[i].data = NULL;
+    }
+}
@@ -41,6 +41,7 @@
 
 #include "archdep.h"
 #include "autostart.h"
+#include "autostart-bootcache.h"
 #include "autostart-prg.h"
 #include "attach.h"
 #include "cartridge.h"
@@ -170,6 +171,11 @@ static int autostart_disk_drive = 0; /* set by setup_for_disk */
 
 static int autostart_tape_unit = 1; /* set by autostart_tape */
 
+/* position of the program on tape, set by autostart_tape */
+static unsigned int autostart_tape_port = TAPEPORT_PORT_1;
+static unsigned int autostart_tape_program_number = 0;
+static unsigned long autostart_tape_raw_offset = 0;
+
 #define AUTOSTART_DISK_IMAGE    0
 #define AUTOSTART_PRG_VFS       1
 #define AUTOSTART_PRG_DISK      2
@@ -192,6 +198,18 @@ static int AutostartHandleTrueDriveEmulation = 0;
 
 static int AutostartWarp = 0;
 
+/* Flag: Do we want to keep a snapshot of the booted machine and restore it on
+   the next autostart instead of booting again?
+   Resource: "AutostartBootCache"
+*/
+static int AutostartBootCache = 0;
+
+#define BOOTCACHE_NONE      0   /* not used for this autostart */
+#define BOOTCACHE_RECORD    1   /* booting, save the machine when it is ready */
+#define BOOTCACHE_SAVING    2   /* snapshot trap is pending */
+
+static int bootcache_state = BOOTCACHE_NONE;
+
 static int AutostartDelay = 0;
 static int AutostartDelayDefaultSeconds = 0;
 static int AutostartDelayRandom = 0;
@@ -225,6 +243,7 @@ static void autostart_finish(void);
 static void setup_for_disk_ready(int unit, int drive);
 
 static void disk_copy_state_virtual_to_tde(void);
+static int attach_tape_for_autostart(const char *file_name);
 /* ------------------------------------------------------------------------- */
 
 /*! \internal \brief set if autostart should use LOAD ... ,1 */
@@ -290,6 +309,14 @@ static int set_autostart_warp(int val, void *param)
     return 0;
 }
 
+/*! \internal \brief set if autostart should restore a snapshot of the booted machine */
+static int set_autostart_boot_cache(int val, void *param)
+{
+    AutostartBootCache = val ? 1 : 0;
+
+    return 0;
+}
+
 /*! \internal \brief set initial autostart delay. 0 means default. */
 static int set_autostart_delay(int val, void *param)
 {
@@ -409,6 +436,8 @@ static resource_int_t resources_int[] = {
       &AutostartHandleTrueDriveEmulation, set_autostart_handle_tde, NULL },
     { "AutostartWarp", 1, RES_EVENT_NO, (resource_value_t)0,
       &AutostartWarp, set_autostart_warp, NULL },
+    { "AutostartBootCache", 0, RES_EVENT_NO, (resource_value_t)0,
+      &AutostartBootCache, set_autostart_boot_cache, NULL },
     { "AutostartPrgMode", AUTOSTART_PRG_MODE_DEFAULT, RES_EVENT_NO, (resource_value_t)0,
       &AutostartPrgMode, set_autostart_prg_mode, NULL },
     { "AutostartDelay", 0, RES_EVENT_NO, (resource_value_t)0,
@@ -527,6 +556,12 @@ static const cmdline_option_t cmdline_options[] =
     { "+autostart-warp", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
       NULL, NULL, "AutostartWarp", (resource_value_t)0,
       NULL, "Disable warp mode during autostart" },
+    { "-autostart-boot-cache", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "AutostartBootCache", (resource_value_t)1,
+      NULL, "Restore a snapshot of the booted machine instead of booting again on autostart" },
+    { "+autostart-boot-cache", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "AutostartBootCache", (resource_value_t)0,
+      NULL, "Always boot the machine on autostart" },
     { "-autostartprgmode", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "AutostartPrgMode", NULL,
       "<Mode>", "Set autostart mode for PRG files (0: VirtualFS, 1: Inject, 2: Disk image)" },
@@ -1627,6 +1662,112 @@ static void advance_inject(void)
     }
 }
 
+/* ----- boot cache ------------------------------------------------------ */
+
+/* Add the random delay of up to 10 frames if requested */
+static CLOCK autostart_random_delay(void)
+{
+    int rnd;
+
+    resources_get_int("AutostartDelayRandom", &rnd);
+    if (rnd) {
+        return lib_unsigned_rand(1, (int)machine_get_cycles_per_frame() * 10);
+    }
+    return 0;
+}
+
+/* Can the booted machine be restored instead of booting for this autostart? */
+static int bootcache_usable(unsigned int mode)
+{
+    if (!AutostartBootCache) {
+        return 0;
+    }
+    if (mode != AUTOSTART_HASDISK
+        && mode != AUTOSTART_HASTAPE
+        && mode != AUTOSTART_HASSNAPSHOT) {
+        return 0;
+    }
+    return !network_connected()
+           && !event_record_active()
+           && !event_playback_active();
+}
+
+static void bootcache_save_trap(uint16_t unused_addr, void *unused_data)
+{
+    autostart_bootcache_save();
+    bootcache_state = BOOTCACHE_NONE;
+}
+
+static void bootcache_restore_trap(uint16_t unused_addr, void *unused_data)
+{
+    char *tape_name[TAPEPORT_MAX_PORTS];
+    unsigned int port;
+    int result;
+
+    /* the snapshot has no tapes, remember which ones to put back in */
+    for (port = 0; port < TAPEPORT_MAX_PORTS; port++) {
+        const char *name = tape_get_file_name((int)port);
+
+        tape_name[port] = (name != NULL && *name != '\0') ? lib_strdup(name) : NULL;
+    }
+
+    result = autostart_bootcache_restore();
+
+    for (port = 0; port < TAPEPORT_MAX_PORTS; port++) {
+        if (tape_name[port] != NULL) {
+            if (autostartmode == AUTOSTART_HASTAPE && port == autostart_tape_port) {
+                attach_tape_for_autostart(tape_name[port]);
+            } else {
+                tape_image_attach(port + 1, tape_name[port]);
+            }
+        }
+        lib_free(tape_name[port]);
+    }
+
+    if (result < 0) {
+        /* boot the usual way then */
+        bootcache_state = BOOTCACHE_RECORD;
+        machine_trigger_reset(MACHINE_RESET_MODE_POWER_CYCLE);
+        return;
+    }
+
+    /* Make sure breakpoints are still working after loading the snapshot */
+    mon_update_all_checkpoint_state();
+
+    /* the machine is ready now, there will be no reset to wait for */
+    autostart_ignore_reset = 0;
+    autostart_wait_for_reset = 0;
+    autostart_initial_delay_cycles = maincpu_clk + autostart_random_delay();
+}
+
+/* Save the machine once it has booted, before the autostart goes on */
+static int advance_bootcache(void)
+{
+    switch (bootcache_state) {
+        case BOOTCACHE_RECORD:
+            switch (check("READY.", AUTOSTART_WAIT_BLINK)) {
+                case YES:
+                    bootcache_state = BOOTCACHE_SAVING;
+                    interrupt_maincpu_trigger_trap(bootcache_save_trap, NULL);
+                    return 1;
+                case NO:
+                    /* let the current stage deal with it */
+                    bootcache_state = BOOTCACHE_NONE;
+                    return 0;
+                case NOT_YET:
+                    return 1;
+            }
+            break;
+        case BOOTCACHE_SAVING:
+            return 1;
+        default:
+            break;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
 /* Execute the actions for the current `autostartmode', advancing to the next
    mode if necessary.  */
 void autostart_advance(void)
@@ -1654,6 +1795,10 @@ void autostart_advance(void)
         return;
     }
 
+    if (advance_bootcache()) {
+        return;
+    }
+
     /* DBG(("autostart_advance (%d)", autostartmode)); */
 
     switch (autostartmode) {
@@ -1710,7 +1855,6 @@ void autostart_advance(void)
 static void reboot_for_autostart(const char *program_name, unsigned int mode,
                                  unsigned int runmode)
 {
-    int rnd;
     char *temp_name = NULL, *temp;
 
     DBG(("reboot_for_autostart autostart_enabled: %d", autostart_enabled));
@@ -1753,14 +1897,20 @@ static void reboot_for_autostart(const char *program_name, unsigned int mode,
     DBG(("reboot_for_autostart AutostartDelay: %d AutostartDelayDefaultSeconds: %d autostart_initial_delay_cycles: %"PRIu64"",
            AutostartDelay, AutostartDelayDefaultSeconds, autostart_initial_delay_cycles));
 
-    resources_get_int("AutostartDelayRandom", &rnd);
-    if (rnd) {
-        /* additional random delay of up to 10 frames */
-        autostart_initial_delay_cycles += lib_unsigned_rand(1, (int)machine_get_cycles_per_frame() * 10);
-    }
+    /* additional random delay of up to 10 frames */
+    autostart_initial_delay_cycles += autostart_random_delay();
     DBG(("reboot_for_autostart - autostart_initial_delay_cycles: %"PRIu64, autostart_initial_delay_cycles));
 
-    machine_trigger_reset(MACHINE_RESET_MODE_POWER_CYCLE);
+    bootcache_state = BOOTCACHE_NONE;
+    if (bootcache_usable(mode) && autostart_bootcache_prepare()) {
+        log_message(autostart_log, "Restoring the booted machine.");
+        interrupt_maincpu_trigger_trap(bootcache_restore_trap, NULL);
+    } else {
+        if (bootcache_usable(mode)) {
+            bootcache_state = BOOTCACHE_RECORD;
+        }
+        machine_trigger_reset(MACHINE_RESET_MODE_POWER_CYCLE);
+    }
 
     /* enable warp before reset */
     if (mode != AUTOSTART_HASSNAPSHOT) {
@@ -2036,12 +2186,45 @@ int autostart_snapshot(const char *file_name, const char *program_name)
 }
 
 
+/* Attach the tape image for autostart and wind it to the program. This is
+   done again after restoring the booted machine, which has no tape.  */
+static int attach_tape_for_autostart(const char *file_name)
+{
+    uint8_t do_seek = 1;
+    unsigned int tapeport = autostart_tape_port;
+    unsigned int tapeunit = (tapeport == TAPEPORT_PORT_2) ? 2 : 1;
+    unsigned int program_number = autostart_tape_program_number;
+
+    if (tape_image_attach(tapeunit, file_name) < 0) {
+        return -1;
+    }
+
+    log_message(autostart_log,
+                "Attached file `%s' as a tape image on unit #%u.", file_name, tapeunit);
+    if (!tape_tap_attached(tapeport)) {
+        if (program_number == 0 || program_number == 1) {
+            do_seek = 0;
+        }
+        program_number -= 1;
+    }
+    if (autostart_tape_raw_offset > 0) {
+        tape_seek_to_offset(tape_image_dev[tapeport], autostart_tape_raw_offset);
+    } else if (do_seek) {
+        if (program_number > 0) {
+            /* program numbers in tape_seek_to_file() start at 0 */
+            tape_seek_to_file(tape_image_dev[tapeport], program_number - 1);
+        } else {
+            tape_seek_start(tape_image_dev[tapeport]);
+        }
+    }
+    return 0;
+}
+
 /* Autostart tape image `file_name'.  */
 int autostart_tape(const char *file_name, const char *program_name,
                    unsigned int program_number, unsigned int runmode,
                    unsigned int tapeport)
 {
-    uint8_t do_seek = 1;
     unsigned int tapeunit = (tapeport == TAPEPORT_PORT_2) ? 2 : 1;
 
     DBG(("autostart_tape autostart_enabled: %d", autostart_enabled));
@@ -2063,27 +2246,12 @@ int autostart_tape(const char *file_name, const char *program_name,
     datasette_control(tapeport, DATASETTE_CONTROL_RESET);
     tape_image_detach(tapeunit);
 
-    if (!(tape_image_attach(tapeunit, file_name) < 0)) {
-        log_message(autostart_log,
-                    "Attached file `%s' as a tape image on unit #%u.", file_name, tapeunit);
-        if (!tape_tap_attached(tapeport)) {
-            if (program_number == 0 || program_number == 1) {
-                do_seek = 0;
-            }
-            program_number -= 1;
-        }
-        if (tap_initial_raw_offset > 0) {
-            tape_seek_to_offset(tape_image_dev[tapeport], tap_initial_raw_offset);
-            tap_initial_raw_offset = 0;
-        } else if (do_seek) {
-            if (program_number > 0) {
-                /* program numbers in tape_seek_to_file() start at 0 */
-                tape_seek_to_file(tape_image_dev[tapeport], program_number - 1);
-            } else {
-                tape_seek_start(tape_image_dev[tapeport]);
-            }
-        }
+    autostart_tape_port = tapeport;
+    autostart_tape_program_number = program_number;
+    autostart_tape_raw_offset = (unsigned long)tap_initial_raw_offset;
 
+    if (!(attach_tape_for_autostart(file_name) < 0)) {
+        tap_initial_raw_offset = 0;
         if (!tape_tap_attached(tapeport)) {
             /* KLUDGE: for t64 images we need device traps ON */
             if (!get_device_traps_state(tapeunit)) {
@@ -2629,6 +2797,7 @@ void autostart_reset(void)
         }
         autostartmode = AUTOSTART_NONE;
         trigger_monitor = 0;
+        bootcache_state = BOOTCACHE_NONE;
         deallocate_program_name();
         log_message(autostart_log, "Turned off.");
     }
@@ -2640,4 +2809,5 @@ void autostart_shutdown(void)
     deallocate_program_name();
 
     autostart_prg_shutdown();
+    autostart_bootcache_shutdown();
 }
@@ -106,6 +106,12 @@
 
 #ifdef UNIX_COMPILE
 #include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
+
+#ifdef HAVE_IO_H
+#include <io.h>
 #endif
 
 /* #define DEBUG_DRIVE */
@@ -187,6 +193,7 @@ static int translate_fsimage_error(int err);
 /* command handlers */
 static int attach_cmd(int nargs, char **args);
 static int bam_cmd(int nargs, char **args);
+static int batch_cmd(int nargs, char **args);
 static int bcopy_cmd(int nargs, char **args);
 static int bfill_cmd(int nargs, char **args);
 static int block_cmd(int nargs, char **args);
@@ -298,6 +305,14 @@ const command_t command_list[] = {
       "<track-max>",
       0, 3,
       bam_cmd },
+    { "batch",
+      "batch <manifest> [<resultfile> [<workers>]]",
+      "Run the jobs in <manifest> with <workers> processes in parallel and\n"
+      "write the results as JSON to <resultfile> (default: stdout).  Each\n"
+      "line of the manifest is a disk image, followed by commands separated\n"
+      "by `;'.",
+      1, 3,
+      batch_cmd },
     { "bcopy",
       "bcopy <src-track> <src-sector> <dst-track> <dst-sector> [<src-unit> "
       "[<dst-unit>]]",
@@ -1527,6 +1542,582 @@ static int bam_cmd(int nargs, char **args)
 }
 
 
+/* ------------------------------------------------------------------------- */
+/* Batch mode */
+
+#ifdef UNIX_COMPILE
+/** \brief  Run batch jobs in forked worker processes
+ *
+ * The vdrive code and the commands work on global state, so the jobs are
+ * isolated from each other by running each in its own process, forked from
+ * the already initialized c1541.
+ */
+# define BATCH_USE_FORK
+#endif
+
+/** \brief  Maximum length of a manifest line */
+#define BATCH_LINE_MAX      4096
+
+/** \brief  Maximum number of worker processes */
+#define BATCH_WORKERS_MAX   256
+
+/** \brief  Results of a batch job, commands failing add their index */
+enum {
+    BATCH_JOB_OK = 0,           /**< all commands succeeded */
+    BATCH_JOB_ATTACH_FAILED,    /**< the disk image could not be attached */
+    BATCH_JOB_CRASHED,          /**< the worker process died */
+    BATCH_JOB_COMMAND_FAILED    /**< command failed, + index of command */
+};
+
+/** \brief  Job of a batch manifest
+ */
+typedef struct batch_job_s {
+    int line;               /**< line number in the manifest */
+    char *image;            /**< disk image to attach to unit 8 */
+    char **commands;        /**< command lines */
+    int num_commands;       /**< number of command lines */
+    int status;             /**< BATCH_JOB_* result */
+    char *output;           /**< captured stdout and stderr of the job */
+    FILE *capture;          /**< file capturing the output while running */
+#ifdef BATCH_USE_FORK
+    pid_t pid;              /**< worker process running the job */
+    int result_fd;          /**< pipe the worker sends the result through */
+#endif
+} batch_job_t;
+
+
+/** \brief  Split a manifest line at `;' outside of quotes
+ *
+ * \param[in,out]   job     job to store image and commands in
+ * \param[in]       line    manifest line
+ *
+ * \return  0 on success, -1 if the line has no image
+ */
+static int batch_parse_line(batch_job_t *job, const char *line)
+{
+    char *args[MAXARG];
+    char *field;
+    const char *start = line;
+    const char *s;
+    int in_quote = 0;
+    int nargs = 0;
+    int i;
+
+    for (i = 0; i < MAXARG; i++) {
+        args[i] = NULL;
+    }
+
+    for (s = line;; s++) {
+        if (*s == '"') {
+            in_quote = !in_quote;
+        } else if (*s == '\\' && s[1] != 0) {
+            s++;
+        } else if (*s == 0 || (*s == ';' && !in_quote)) {
+            start += strspn(start, " \t");
+            if (start > s) {
+                start = s;
+            }
+            field = lib_malloc((size_t)(s - start) + 1);
+            memcpy(field, start, (size_t)(s - start));
+            field[s - start] = 0;
+
+            if (job->image == NULL) {
+                /* the first field is the image name, unquote it */
+                if (split_args(field, &nargs, args) == 0 && nargs == 1) {
+                    job->image = lib_strdup(args[0]);
+                }
+                lib_free(field);
+                if (job->image == NULL) {
+                    break;
+                }
+            } else if (*field != 0) {
+                job->commands = lib_realloc(job->commands,
+                        sizeof(char *) * (size_t)(job->num_commands + 1));
+                job->commands[job->num_commands++] = field;
+            } else {
+                lib_free(field);
+            }
+
+            if (*s == 0) {
+                break;
+            }
+            start = s + 1;
+        }
+    }
+
+    for (i = 0; i < MAXARG; i++) {
+        lib_free(args[i]);
+    }
+    return job->image != NULL ? 0 : -1;
+}
+
+
+/** \brief  Read the jobs from a manifest file
+ *
+ * Empty lines and lines starting with `#' are skipped.
+ *
+ * \param[in]   name        manifest file name
+ * \param[out]  num_jobs    number of jobs read, -1 on error
+ *
+ * \return  list of jobs
+ */
+static batch_job_t *batch_read_manifest(const char *name, int *num_jobs)
+{
+    FILE *fp;
+    batch_job_t *jobs = NULL;
+    char buffer[BATCH_LINE_MAX];
+    int line = 0;
+    size_t len;
+
+    *num_jobs = 0;
+
+    fp = fopen(name, MODE_READ_TEXT);
+    if (fp == NULL) {
+        fprintf(stderr, "cannot open manifest `%s'\n", name);
+        *num_jobs = -1;
+        return NULL;
+    }
+
+    while (fgets(buffer, sizeof(buffer), fp) != NULL) {
+        line++;
+        len = strlen(buffer);
+        while (len > 0 && (buffer[len - 1] == '\n' || buffer[len - 1] == '\r')) {
+            buffer[--len] = 0;
+        }
+        if (buffer[strspn(buffer, " \t")] == 0 || buffer[strspn(buffer, " \t")] == '#') {
+            continue;
+        }
+
+        jobs = lib_realloc(jobs, sizeof(batch_job_t) * (size_t)(*num_jobs + 1));
+        memset(&jobs[*num_jobs], 0, sizeof(batch_job_t));
+        jobs[*num_jobs].line = line;
+        if (batch_parse_line(&jobs[*num_jobs], buffer) < 0) {
+            fprintf(stderr, "%s:%d: missing disk image\n", name, line);
+            continue;
+        }
+        (*num_jobs)++;
+    }
+    fclose(fp);
+    return jobs;
+}
+
+
+/** \brief  Run the commands of a job against a fresh virtual drive
+ *
+ * The job gets its own vdrive and disk image as unit 8. The unit 8 drive
+ * and the current unit are restored afterwards.
+ *
+ * \param[in]   job     batch job
+ *
+ * \return  BATCH_JOB_* result
+ */
+static int batch_run_job(batch_job_t *job)
+{
+    char *args[MAXARG];
+    vdrive_t *saved_drive = drives[0];
+    int saved_index = drive_index;
+    vdrive_t *vdrive;
+    int nargs;
+    int result = BATCH_JOB_OK;
+    int i;
+
+    for (i = 0; i < MAXARG; i++) {
+        args[i] = NULL;
+    }
+
+    vdrive = lib_calloc(1, sizeof *vdrive);
+    vdrive_device_setup(vdrive, DRIVE_UNIT_MIN);
+    drives[0] = vdrive;
+    drive_index = 0;
+
+    if (open_disk_image(vdrive, job->image, DRIVE_UNIT_MIN) < 0) {
+        result = BATCH_JOB_ATTACH_FAILED;
+    } else {
+        for (i = 0; i < job->num_commands; i++) {
+            printf("c1541 #8> %s\n", job->commands[i]);
+            if (split_args(job->commands[i], &nargs, args) < 0
+                    || (nargs > 0 && lookup_and_execute_command(nargs, args) < 0)) {
+                result = BATCH_JOB_COMMAND_FAILED + i;
+                break;
+            }
+        }
+    }
+    fflush(stdout);
+    fflush(stderr);
+
+    close_disk_image(vdrive, DRIVE_UNIT_MIN);
+    lib_free(vdrive);
+    drives[0] = saved_drive;
+    drive_index = saved_index;
+
+    for (i = 0; i < MAXARG; i++) {
+        lib_free(args[i]);
+    }
+    return result;
+}
+
+
+/** \brief  Send stdout and stderr to the capture file of \a job
+ *
+ * \param[in]   job     batch job
+ * \param[out]  saved   duplicates of the original stdout and stderr
+ */
+static void batch_capture_start(batch_job_t *job, int *saved)
+{
+    fflush(stdout);
+    fflush(stderr);
+    if (saved != NULL) {
+        saved[0] = dup(1);
+        saved[1] = dup(2);
+    }
+    dup2(fileno(job->capture), 1);
+    dup2(fileno(job->capture), 2);
+}
+
+
+/** \brief  Restore stdout and stderr after batch_capture_start()
+ *
+ * \param[in]   saved   duplicates of the original stdout and stderr
+ */
+static void batch_capture_stop(int *saved)
+{
+    fflush(stdout);
+    fflush(stderr);
+    dup2(saved[0], 1);
+    dup2(saved[1], 2);
+    close(saved[0]);
+    close(saved[1]);
+}
+
+
+/** \brief  Collect the captured output of a finished job
+ *
+ * \param[in,out]   job     batch job
+ */
+static void batch_collect_output(batch_job_t *job)
+{
+    long size;
+
+    fflush(job->capture);
+    fseek(job->capture, 0, SEEK_END);
+    size = ftell(job->capture);
+    if (size < 0) {
+        size = 0;
+    }
+    job->output = lib_malloc((size_t)size + 1);
+    rewind(job->capture);
+    size = (long)fread(job->output, 1, (size_t)size, job->capture);
+    job->output[size] = 0;
+    fclose(job->capture);
+    job->capture = NULL;
+}
+
+
+/** \brief  Run a job in this process
+ *
+ * \param[in,out]   job     batch job
+ */
+static void batch_run_job_here(batch_job_t *job)
+{
+    int saved[2];
+
+    batch_capture_start(job, saved);
+    job->status = batch_run_job(job);
+    batch_capture_stop(saved);
+    batch_collect_output(job);
+}
+
+
+/** \brief  Write \a str as JSON string
+ *
+ * Bytes outside of ASCII are written as their Latin-1 code point, so the
+ * result is valid JSON whatever a command printed.
+ *
+ * \param[in]   fp  file to write to
+ * \param[in]   str string
+ */
+static void batch_write_json_string(FILE *fp, const char *str)
+{
+    const unsigned char *s;
+
+    fputc('"', fp);
+    for (s = (const unsigned char *)str; *s != 0; s++) {
+        switch (*s) {
+            case '"':
+                fputs("\\\"", fp);
+                break;
+            case '\\':
+                fputs("\\\\", fp);
+                break;
+            case '\n':
+                fputs("\\n", fp);
+                break;
+            case '\r':
+                fputs("\\r", fp);
+                break;
+            case '\t':
+                fputs("\\t", fp);
+                break;
+            default:
+                if (*s < 0x20 || *s >= 0x7f) {
+                    fprintf(fp, "\\u%04x", *s);
+                } else {
+                    fputc(*s, fp);
+                }
+                break;
+        }
+    }
+    fputc('"', fp);
+}
+
+
+/** \brief  Write the results of all jobs as JSON
+ *
+ * \param[in]   fp          file to write to
+ * \param[in]   manifest    manifest file name
+ * \param[in]   workers     number of worker processes
+ * \param[in]   jobs        list of jobs
+ * \param[in]   num_jobs    number of jobs
+ *
+ * \return  number of failed jobs
+ */
+static int batch_write_results(FILE *fp, const char *manifest, int workers,
+                               batch_job_t *jobs, int num_jobs)
+{
+    batch_job_t *job;
+    int failed = 0;
+    int i;
+    int c;
+
+    fprintf(fp, "{\n  \"manifest\": ");
+    batch_write_json_string(fp, manifest);
+    fprintf(fp, ",\n  \"workers\": %d,\n  \"jobs\": [", workers);
+
+    for (i = 0; i < num_jobs; i++) {
+        job = &jobs[i];
+
+        fprintf(fp, "%s\n    {\n      \"line\": %d,\n      \"image\": ",
+                i == 0 ? "" : ",", job->line);
+        batch_write_json_string(fp, job->image);
+        fprintf(fp, ",\n      \"commands\": [");
+        for (c = 0; c < job->num_commands; c++) {
+            fprintf(fp, "%s", c == 0 ? "" : ", ");
+            batch_write_json_string(fp, job->commands[c]);
+        }
+        fprintf(fp, "],\n      \"status\": ");
+        switch (job->status) {
+            case BATCH_JOB_OK:
+                fprintf(fp, "\"ok\"");
+                break;
+            case BATCH_JOB_ATTACH_FAILED:
+                fprintf(fp, "\"attach-failed\"");
+                break;
+            case BATCH_JOB_CRASHED:
+                fprintf(fp, "\"crashed\"");
+                break;
+            default:
+                fprintf(fp, "\"command-failed\",\n      \"failed_command\": %d",
+                        job->status - BATCH_JOB_COMMAND_FAILED);
+                break;
+        }
+        if (job->status != BATCH_JOB_OK) {
+            failed++;
+        }
+        fprintf(fp, ",\n      \"output\": ");
+        batch_write_json_string(fp, job->output != NULL ? job->output : "");
+        fprintf(fp, "\n    }");
+    }
+    fprintf(fp, "\n  ],\n  \"total\": %d,\n  \"failed\": %d\n}\n",
+            num_jobs, failed);
+    return failed;
+}
+
+
+#ifdef BATCH_USE_FORK
+/** \brief  Start a job in a worker process
+ *
+ * \param[in,out]   job     batch job
+ *
+ * \return  0 on success, -1 if the process could not be started
+ */
+static int batch_start_worker(batch_job_t *job)
+{
+    int fds[2];
+    int result;
+
+    /* the result holds the index of a failed command, which does not fit
+       into an exit status */
+    if (pipe(fds) < 0) {
+        return -1;
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+
+    job->pid = fork();
+    if (job->pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    if (job->pid == 0) {
+        /* worker: keep stdout and stderr in order, and don't run any exit
+           handlers of the parent */
+        close(fds[0]);
+        batch_capture_start(job, NULL);
+        setvbuf(stdout, NULL, _IONBF, 0);
+        result = batch_run_job(job);
+        if (write(fds[1], &result, sizeof result) != sizeof result) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    job->result_fd = fds[0];
+    return 0;
+}
+
+
+/** \brief  Wait for a worker process to finish and collect its job
+ *
+ * \param[in,out]   jobs        list of jobs
+ * \param[in]       num_jobs    number of jobs
+ */
+static void batch_wait_worker(batch_job_t *jobs, int num_jobs)
+{
+    pid_t pid;
+    int status;
+    int result;
+    int i;
+
+    pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+        return;
+    }
+    for (i = 0; i < num_jobs; i++) {
+        if (jobs[i].pid == pid) {
+            /* a worker that died before sending its result crashed */
+            if (!WIFEXITED(status)
+                    || read(jobs[i].result_fd, &result, sizeof result) != sizeof result) {
+                result = BATCH_JOB_CRASHED;
+            }
+            jobs[i].status = result;
+            close(jobs[i].result_fd);
+            jobs[i].pid = 0;
+            batch_collect_output(&jobs[i]);
+            break;
+        }
+    }
+}
+#endif
+
+
+/** \brief  'batch' command handler
+ *
+ * Run the jobs of a manifest and write the results as JSON.
+ *
+ * Syntax: `batch <manifest> [<resultfile> [<workers>]]`
+ *
+ * Each manifest line holds a disk image and the commands to run on it,
+ * separated by `;', for example `"my disk.d64"; validate; list`. Each job
+ * gets its own virtual drive as unit 8. On Unix the jobs run in \a workers
+ * forked processes (default: number of CPUs), elsewhere one after another.
+ *
+ * \param[in]   nargs   argument count
+ * \param[in]   args    argument list
+ *
+ * \return  FD_OK if all jobs succeeded, FD_BADNAME if the manifest can't
+ *          be read, FD_BADVAL on bad workers or failed jobs
+ */
+static int batch_cmd(int nargs, char **args)
+{
+    batch_job_t *jobs;
+    FILE *fp = stdout;
+    int num_jobs;
+    int workers = 1;
+    int failed;
+    int i;
+    int c;
+#ifdef BATCH_USE_FORK
+    int running = 0;
+    long cpus;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 0) {
+        workers = (int)cpus;
+    }
+#endif
+
+    if (nargs > 3) {
+        if (arg_to_int(args[3], &workers) < 0
+                || workers < 1 || workers > BATCH_WORKERS_MAX) {
+            return FD_BADVAL;
+        }
+    }
+
+    jobs = batch_read_manifest(args[1], &num_jobs);
+    if (num_jobs < 0) {
+        return FD_BADNAME;
+    }
+
+    if (nargs > 2 && strcmp(args[2], "-") != 0) {
+        fp = fopen(args[2], MODE_WRITE_TEXT);
+        if (fp == NULL) {
+            fprintf(stderr, "cannot create result file `%s'\n", args[2]);
+            lib_free(jobs);
+            return FD_NOTWRT;
+        }
+    }
+
+    for (i = 0; i < num_jobs; i++) {
+        jobs[i].capture = tmpfile();
+        if (jobs[i].capture == NULL) {
+            jobs[i].status = BATCH_JOB_CRASHED;
+            jobs[i].output = lib_strdup("cannot create temporary file\n");
+            continue;
+        }
+#ifdef BATCH_USE_FORK
+        if (running == workers) {
+            batch_wait_worker(jobs, num_jobs);
+            running--;
+        }
+        if (batch_start_worker(&jobs[i]) == 0) {
+            running++;
+            continue;
+        }
+#endif
+        batch_run_job_here(&jobs[i]);
+    }
+#ifdef BATCH_USE_FORK
+    while (running > 0) {
+        batch_wait_worker(jobs, num_jobs);
+        running--;
+    }
+#endif
+
+    failed = batch_write_results(fp, args[1], workers, jobs, num_jobs);
+    if (fp != stdout) {
+        fclose(fp);
+    }
+
+    for (i = 0; i < num_jobs; i++) {
+        lib_free(jobs[i].image);
+        for (c = 0; c < jobs[i].num_commands; c++) {
+            lib_free(jobs[i].commands[c]);
+        }
+        lib_free(jobs[i].commands);
+        lib_free(jobs[i].output);
+    }
+    lib_free(jobs);
+
+    if (failed > 0) {
+        fprintf(stderr, "%d of %d jobs failed\n", failed, num_jobs);
+        return FD_BADVAL;
+    }
+    return FD_OK;
+}
+
+
 /** \brief  Copy block to another block
  *
  * Copies a single block (sector) to another block, optionally between different
@@ -660,6 +660,10 @@ void image_contents_destroy(image_contents_t *contents)
 {
 }
 
+void image_contents_cache_shutdown(void)
+{
+}
+
 char *image_contents_file_to_string(image_contents_file_list_t * p, char convert_to_ascii)
 {
     return NULL;
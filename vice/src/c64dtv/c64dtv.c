@@ -208,6 +208,15 @@ static const trap_t c64_serial_traps[] = {
         c64memrom_trap_read,
         c64memrom_trap_store
     },
+    {
+        "SerialLoad",
+        0xF501,
+        0xF524,
+        { 0x20, 0x13, 0xEE },
+        serial_trap_load,
+        c64memrom_trap_read,
+        c64memrom_trap_store
+    },
     {
         NULL,
         0,
@@ -0,0 +1,433 @@
+/*
+ * coverage.c - Execution-count code coverage.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Every CPU core (main CPU, drive CPUs and the Z80) calls coverage_exec()
+   with the address of each opcode it fetches while coverage is enabled. The
+   counts are kept in one 64k table per memspace and memory bank
+   configuration, so code that is banked in and out of the same address
+   range (cartridges, KERNAL vs. RAM) is kept apart. The tables are written
+   as lcov tracefile or JSON on exit, using the monitor labels as function
+   names.
+
+   The Z80 (C128, CP/M cartridge) runs in the computer memspace too, its
+   counts go to maps of their own so they are not mixed up with those of
+   the 6502/8510 at the same addresses. */
+
+#include "vice.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "archdep.h"
+#include "cmdline.h"
+#include "coverage.h"
+#include "lib.h"
+#include "log.h"
+#include "machine.h"
+#include "mem.h"
+#include "monitor.h"
+#include "resources.h"
+#include "util.h"
+
+/* #define DEBUG_COVERAGE */
+
+#ifdef DEBUG_COVERAGE
+#define DBG(x) log_printf x
+#else
+#define DBG(x)
+#endif
+
+#define COVERAGE_NUM_ADDR   0x10000
+
+typedef struct coverage_map_s {
+    int mem;
+    int z80;
+    int bank_config;
+    uint32_t *count;
+    struct coverage_map_s *next;
+} coverage_map_t;
+
+bool coverage_enabled = false;
+
+static char *coverage_file = NULL;
+static int coverage_format = COVERAGE_FORMAT_LCOV;
+
+/* All maps, and the one last used per memspace as lookup shortcut */
+static coverage_map_t *coverage_maps = NULL;
+static coverage_map_t *current_map[NUM_MEMSPACES];
+static coverage_map_t *current_z80_map = NULL;
+
+static const char * const coverage_space_names[NUM_MEMSPACES] = {
+    "default", "computer", "disk8", "disk9", "disk10", "disk11"
+};
+
+
+/* Maps are ordered by memspace, CPU and bank configuration */
+static int coverage_map_before(const coverage_map_t *map, int mem, int z80, int bank_config)
+{
+    if (map->mem != mem) {
+        return map->mem < mem;
+    }
+    if (map->z80 != z80) {
+        return map->z80 < z80;
+    }
+    return map->bank_config < bank_config;
+}
+
+static coverage_map_t *coverage_get_map(int mem, int z80, int bank_config)
+{
+    coverage_map_t *map;
+    coverage_map_t **prev;
+
+    for (map = coverage_maps; map != NULL; map = map->next) {
+        if (map->mem == mem && map->z80 == z80 && map->bank_config == bank_config) {
+            return map;
+        }
+    }
+
+    DBG(("coverage: new map for %s%s bank %d", coverage_space_names[mem],
+         z80 ? " z80" : "", bank_config));
+
+    map = lib_malloc(sizeof(coverage_map_t));
+    map->mem = mem;
+    map->z80 = z80;
+    map->bank_config = bank_config;
+    map->count = lib_calloc(COVERAGE_NUM_ADDR, sizeof(uint32_t));
+    map->next = NULL;
+
+    /* keep the list sorted so the output is stable */
+    prev = &coverage_maps;
+    while (*prev != NULL && coverage_map_before(*prev, mem, z80, bank_config)) {
+        prev = &(*prev)->next;
+    }
+    map->next = *prev;
+    *prev = map;
+
+    return map;
+}
+
+/** \brief  Count one executed opcode
+ *
+ * \param[in]   mem     memspace of the CPU (e_comp_space, e_disk8_space ...)
+ * \param[in]   addr    address of the opcode
+ */
+void coverage_exec(int mem, uint16_t addr)
+{
+    coverage_map_t *map = current_map[mem];
+    int bank_config = 0;
+
+    /* only the computer has banking worth telling apart */
+    if (mem == e_comp_space) {
+        bank_config = mem_get_current_bank_config();
+    }
+
+    if (map == NULL || map->bank_config != bank_config) {
+        map = coverage_get_map(mem, 0, bank_config);
+        current_map[mem] = map;
+    }
+
+    /* saturate instead of wrapping around */
+    if (map->count[addr] != UINT32_MAX) {
+        map->count[addr]++;
+    }
+}
+
+/** \brief  Count one opcode executed by the Z80
+ *
+ * \param[in]   addr    address of the opcode
+ */
+void coverage_exec_z80(uint16_t addr)
+{
+    coverage_map_t *map = current_z80_map;
+    int bank_config = mem_get_current_bank_config();
+
+    if (map == NULL || map->bank_config != bank_config) {
+        map = coverage_get_map(e_comp_space, 1, bank_config);
+        current_z80_map = map;
+    }
+
+    if (map->count[addr] != UINT32_MAX) {
+        map->count[addr]++;
+    }
+}
+
+/** \brief  Drop all collected counts
+ */
+void coverage_reset(void)
+{
+    coverage_map_t *map;
+    int i;
+
+    while (coverage_maps != NULL) {
+        map = coverage_maps;
+        coverage_maps = map->next;
+        lib_free(map->count);
+        lib_free(map);
+    }
+    for (i = 0; i < NUM_MEMSPACES; i++) {
+        current_map[i] = NULL;
+    }
+    current_z80_map = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct coverage_label_s {
+    FILE *fp;
+    coverage_map_t *map;
+    uint8_t *is_label;
+    int found;
+    int hit;
+} coverage_label_t;
+
+static void write_lcov_fn(uint16_t addr, const char *name, void *param)
+{
+    coverage_label_t *cl = param;
+
+    fprintf(cl->fp, "FN:%u,%s\n", addr + 1U, name);
+    cl->is_label[addr] = 1;
+}
+
+static void write_lcov_fnda(uint16_t addr, const char *name, void *param)
+{
+    coverage_label_t *cl = param;
+
+    fprintf(cl->fp, "FNDA:%lu,%s\n", (unsigned long)cl->map->count[addr], name);
+    cl->found++;
+    if (cl->map->count[addr] != 0) {
+        cl->hit++;
+    }
+}
+
+/* One record per map, "line" numbers are the addresses plus one, as lcov
+   counts lines from 1. Labels become the
+   functions, so a label that is never reached shows up as an uncovered line
+   and function. */
+static void coverage_write_lcov(FILE *fp)
+{
+    coverage_map_t *map;
+    coverage_label_t cl;
+    unsigned int addr;
+    unsigned int lines_found;
+    unsigned int lines_hit;
+
+    cl.fp = fp;
+    cl.is_label = lib_malloc(COVERAGE_NUM_ADDR);
+
+    for (map = coverage_maps; map != NULL; map = map->next) {
+        memset(cl.is_label, 0, COVERAGE_NUM_ADDR);
+        cl.map = map;
+        cl.found = 0;
+        cl.hit = 0;
+
+        fprintf(fp, "TN:%s\n", machine_get_name());
+        fprintf(fp, "SF:%s%s/bank%d\n", coverage_space_names[map->mem],
+                map->z80 ? "-z80" : "", map->bank_config);
+
+        /* the monitor labels belong to the 65xx code */
+        if (!map->z80) {
+            monitor_label_foreach(map->mem, write_lcov_fn, &cl);
+            monitor_label_foreach(map->mem, write_lcov_fnda, &cl);
+        }
+        fprintf(fp, "FNF:%d\nFNH:%d\n", cl.found, cl.hit);
+
+        lines_found = 0;
+        lines_hit = 0;
+        for (addr = 0; addr < COVERAGE_NUM_ADDR; addr++) {
+            if (map->count[addr] != 0 || cl.is_label[addr]) {
+                fprintf(fp, "DA:%u,%lu\n", addr + 1, (unsigned long)map->count[addr]);
+                lines_found++;
+                if (map->count[addr] != 0) {
+                    lines_hit++;
+                }
+            }
+        }
+        fprintf(fp, "LF:%u\nLH:%u\nend_of_record\n", lines_found, lines_hit);
+    }
+
+    lib_free(cl.is_label);
+}
+
+static void collect_json_label(uint16_t addr, const char *name, void *param)
+{
+    const char **labels = param;
+
+    /* only one label per address in the JSON output */
+    if (labels[addr] == NULL) {
+        labels[addr] = name;
+    }
+}
+
+static void coverage_write_json_string(FILE *fp, const char *str)
+{
+    fputc('"', fp);
+    while (*str != '\0') {
+        if (*str == '"' || *str == '\\') {
+            fputc('\\', fp);
+        }
+        fputc(*str, fp);
+        str++;
+    }
+    fputc('"', fp);
+}
+
+static void coverage_write_json(FILE *fp)
+{
+    coverage_map_t *map;
+    const char **labels;
+    unsigned int addr;
+    int first;
+
+    labels = lib_malloc(COVERAGE_NUM_ADDR * sizeof(const char *));
+
+    fprintf(fp, "{\n  \"machine\": ");
+    coverage_write_json_string(fp, machine_get_name());
+    fprintf(fp, ",\n  \"spaces\": [");
+
+    for (map = coverage_maps; map != NULL; map = map->next) {
+        memset(labels, 0, COVERAGE_NUM_ADDR * sizeof(const char *));
+        if (!map->z80) {
+            monitor_label_foreach(map->mem, collect_json_label, labels);
+        }
+
+        fprintf(fp, "%s\n    {\n      \"memspace\": \"%s\",\n"
+                "      \"cpu\": \"%s\",\n"
+                "      \"bank_config\": %d,\n      \"executed\": [",
+                map == coverage_maps ? "" : ",",
+                coverage_space_names[map->mem], map->z80 ? "z80" : "65xx",
+                map->bank_config);
+
+        first = 1;
+        for (addr = 0; addr < COVERAGE_NUM_ADDR; addr++) {
+            if (map->count[addr] == 0 && labels[addr] == NULL) {
+                continue;
+            }
+            fprintf(fp, "%s\n        { \"addr\": %u, \"count\": %lu",
+                    first ? "" : ",", addr, (unsigned long)map->count[addr]);
+            if (labels[addr] != NULL) {
+                fprintf(fp, ", \"label\": ");
+                coverage_write_json_string(fp, labels[addr]);
+            }
+            fprintf(fp, " }");
+            first = 0;
+        }
+        fprintf(fp, "\n      ]\n    }");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+
+    lib_free(labels);
+}
+
+/** \brief  Write the collected counts to a file
+ *
+ * \param[in]   filename    name of the file to write
+ * \param[in]   format      COVERAGE_FORMAT_LCOV or COVERAGE_FORMAT_JSON
+ *
+ * \return  0 on success, -1 on error
+ */
+int coverage_write(const char *filename, int format)
+{
+    FILE *fp;
+
+    fp = fopen(filename, MODE_WRITE_TEXT);
+    if (fp == NULL) {
+        log_error(LOG_DEFAULT, "Cannot open coverage file '%s'.", filename);
+        return -1;
+    }
+
+    if (format == COVERAGE_FORMAT_JSON) {
+        coverage_write_json(fp);
+    } else {
+        coverage_write_lcov(fp);
+    }
+
+    fclose(fp);
+    log_message(LOG_DEFAULT, "Wrote coverage to '%s'.", filename);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int set_coverage_file(const char *val, void *param)
+{
+    util_string_set(&coverage_file, val);
+    coverage_enabled = (coverage_file != NULL && *coverage_file != '\0');
+    return 0;
+}
+
+static int set_coverage_format(int val, void *param)
+{
+    switch (val) {
+        case COVERAGE_FORMAT_LCOV:
+        case COVERAGE_FORMAT_JSON:
+            break;
+        default:
+            return -1;
+    }
+    coverage_format = val;
+    return 0;
+}
+
+static const resource_int_t resources_int[] = {
+    { "CoverageFormat", COVERAGE_FORMAT_LCOV, RES_EVENT_NO, NULL,
+      &coverage_format, set_coverage_format, NULL },
+    RESOURCE_INT_LIST_END
+};
+
+int coverage_resources_init(void)
+{
+    return resources_register_int(resources_int);
+}
+
+static const cmdline_option_t cmdline_options[] =
+{
+    /* not a resource, a coverage run should not end up in vicerc */
+    { "-coverage", CALL_FUNCTION, CMDLINE_ATTRIB_NEED_ARGS,
+      set_coverage_file, NULL, NULL, NULL,
+      "<Name>", "Count executed instructions of all CPUs and write code coverage to file on exit." },
+    { "-coverageformat", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "CoverageFormat", NULL,
+      "<Type>", "Set code coverage file format: (0: lcov, 1: JSON)" },
+    CMDLINE_LIST_END
+};
+
+int coverage_cmdline_options_init(void)
+{
+    return cmdline_register_options(cmdline_options);
+}
+
+/** \brief  Write the coverage file if enabled and free all memory
+ *
+ * Must be called before monitor_shutdown(), the labels are needed.
+ */
+void coverage_shutdown(void)
+{
+    if (coverage_enabled) {
+        coverage_write(coverage_file, coverage_format);
+    }
+    coverage_enabled = false;
+    coverage_reset();
+    lib_free(coverage_file);
+    coverage_file = NULL;
+}
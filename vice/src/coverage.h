@@ -0,0 +1,45 @@
+/*
+ * coverage.h - Execution-count code coverage.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_COVERAGE_H
+#define VICE_COVERAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define COVERAGE_FORMAT_LCOV    0
+#define COVERAGE_FORMAT_JSON    1
+
+/* Checked by the CPU cores before every opcode fetch, keep the test cheap */
+extern bool coverage_enabled;
+
+void coverage_exec(int mem, uint16_t addr);
+void coverage_exec_z80(uint16_t addr);
+void coverage_reset(void);
+int coverage_write(const char *filename, int format);
+
+int coverage_resources_init(void);
+int coverage_cmdline_options_init(void);
+void coverage_shutdown(void);
+
+#endif
@@ -113,6 +113,8 @@ void disk_image_init(void);
 int disk_image_resources_init(void);
 int disk_image_cmdline_options_init(void);
 void disk_image_resources_shutdown(void);
+void disk_image_flush_all(void);
+void disk_image_flush_check(void);
 
 void disk_image_fsimage_name_set(disk_image_t *image, const char *name);
 const char *disk_image_fsimage_name_get(const disk_image_t *image);
@@ -148,6 +150,9 @@ unsigned int disk_image_sync_size(unsigned int format, unsigned int track);
 int disk_image_read_image(const disk_image_t *image);
 int disk_image_write_p64_image(const disk_image_t *image);
 int disk_image_write_half_track(disk_image_t *image, unsigned int half_track, const struct disk_track_s *raw);
+void disk_image_gcr_track(const disk_image_t *image, unsigned int index);
+void disk_image_gcr_all_tracks(const disk_image_t *image);
+void disk_image_gcr_release(const disk_image_t *image);
 
 unsigned int disk_image_speed_map(unsigned int format, unsigned int track);
 
@@ -40,12 +40,15 @@
 
 #include "diskconstants.h"
 #include "diskimage.h"
+#include "fsimage-cache.h"
 #include "fsimage-check.h"
 #include "fsimage-create.h"
 #include "fsimage-dxx.h"
 #include "fsimage-gcr.h"
+#include "fsimage-mmap.h"
 #include "fsimage-p64.h"
 #include "fsimage.h"
+#include "gcr.h"
 #include "lib.h"
 #include "log.h"
 #include "realimage.h"
@@ -739,6 +742,52 @@ int disk_image_write_p64_image(const disk_image_t *image)
     return fsimage_write_p64_image(image);
 }
 
+/** \brief  Make sure the GCR data of a track is there
+ *
+ * The GCR tracks of sector based images are generated on first access.
+ *
+ * \param[in]   image   disk image attached to the true drive emulation
+ * \param[in]   index   half track index into the GCR image
+ */
+void disk_image_gcr_track(const disk_image_t *image, unsigned int index)
+{
+    if (image->gcr != NULL && image->gcr->pending[index]) {
+        fsimage_dxx_gcr_track(image, index);
+    }
+}
+
+/** \brief  Generate all pending GCR tracks
+ *
+ * \param[in]   image   disk image attached to the true drive emulation
+ */
+void disk_image_gcr_all_tracks(const disk_image_t *image)
+{
+    unsigned int i;
+
+    for (i = 0; i < MAX_GCR_TRACKS; i++) {
+        disk_image_gcr_track(image, i);
+    }
+}
+
+/** \brief  Release the GCR data of an image detached from the true drive
+ *
+ * Unmodified tracks of sector based images are kept for the next attach.
+ *
+ * \param[in]   image   disk image
+ */
+void disk_image_gcr_release(const disk_image_t *image)
+{
+    switch (image->type) {
+        case DISK_IMAGE_TYPE_P64:
+        case DISK_IMAGE_TYPE_G64:
+        case DISK_IMAGE_TYPE_G71:
+            break;
+        default:
+            fsimage_dxx_release_gcr(image);
+            break;
+    }
+}
+
 /*-----------------------------------------------------------------------*/
 /* Initialization.  */
 
@@ -754,7 +803,10 @@ void disk_image_init(void)
 
 int disk_image_resources_init(void)
 {
-    return 0;
+    if (fsimage_cache_resources_init() < 0) {
+        return -1;
+    }
+    return fsimage_mmap_resources_init();
 }
 
 void disk_image_resources_shutdown(void)
@@ -763,7 +815,26 @@ void disk_image_resources_shutdown(void)
 
 int disk_image_cmdline_options_init(void)
 {
-    return 0;
+    if (fsimage_cache_cmdline_options_init() < 0) {
+        return -1;
+    }
+    return fsimage_mmap_cmdline_options_init();
+}
+
+/** \brief  Write all cached writes to the image files and wait until done
+ */
+void disk_image_flush_all(void)
+{
+    fsimage_cache_flush_all();
+}
+
+/** \brief  Write back cached writes in the background once they are due
+ *
+ * Called once per frame.
+ */
+void disk_image_flush_check(void)
+{
+    fsimage_cache_check_timer();
 }
 
 /*-----------------------------------------------------------------------*/
@@ -0,0 +1,717 @@
+/*
+ * fsimage-cache.c - Write-back cache for file system based disk images.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Without the cache every sector or track the drive writes goes straight to
+   the image file, followed by a fflush(). With "DiskImageWriteBack" enabled
+   the writes to a D64/D71/D81/G64... image end up in 256 byte blocks in
+   memory instead, which are marked dirty. The dirty blocks are copied and
+   written to the file by a background thread once the oldest of them is
+   "DiskImageWriteBackDelay" seconds old, and synchronously when a snapshot
+   is saved or the image is detached.
+
+   With "DiskImageJournal" every write is also appended to "<image>.journal"
+   and flushed right away. The journal is emptied after a flush that covered
+   all records in it, and removed when the image is detached. If VICE dies
+   before that, the records are written to the image the next time it is
+   attached read/write.
+
+   P64 images are not cached, they are only written on detach anyway. CMD HD
+   images are accessed through the file handle by the SCSI emulation. */
+
+#include "vice.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "archdep.h"
+#include "cmdline.h"
+#include "diskimage.h"
+#include "fsimage-cache.h"
+#include "fsimage-mmap.h"
+#include "fsimage.h"
+#include "lib.h"
+#include "log.h"
+#include "resources.h"
+#include "types.h"
+#include "util.h"
+
+/* #define DEBUG_FSIMAGE_CACHE */
+
+#ifdef DEBUG_FSIMAGE_CACHE
+#define DBG(x)  log_printf x
+#else
+#define DBG(x)
+#endif
+
+#define CACHE_BLOCK_SIZE    256
+#define CACHE_BLOCK_SHIFT   8
+
+#define JOURNAL_EXTENSION   ".journal"
+#define JOURNAL_MAGIC       "VICEJNL1"
+#define JOURNAL_MAGIC_LEN   8
+
+/* a copy of a dirty block on its way to the image file */
+typedef struct cache_batch_entry_s {
+    long offset;
+    size_t len;
+    uint8_t *data;
+} cache_batch_entry_t;
+
+typedef struct fsimage_cache_s {
+    fsimage_t *fsimage;
+
+    /* cached blocks, indexed by block number, NULL if not cached */
+    uint8_t **blocks;
+    uint8_t *dirty;
+    unsigned int num_blocks;
+    unsigned int num_dirty;
+    time_t dirty_since;
+
+    /* image size including the cached writes, and on disk */
+    off_t size;
+    off_t file_size;
+
+    FILE *journal;
+    char *journal_name;
+    unsigned long journal_records;
+
+    /* protects the image and journal files, and everything below */
+    pthread_mutex_t lock;
+    pthread_t thread;
+    int thread_started;
+    int busy;
+    cache_batch_entry_t *batch;
+    unsigned int batch_len;
+    unsigned long batch_journal_records;
+
+    struct fsimage_cache_s *next;
+} fsimage_cache_t;
+
+static log_t fsimage_cache_log = LOG_DEFAULT;
+
+static int writeback_enabled = 0;
+static int writeback_delay = 2;
+static int journal_enabled = 0;
+
+static fsimage_cache_t *caches = NULL;
+
+/*-----------------------------------------------------------------------*/
+
+static char *journal_name_get(const fsimage_t *fsimage)
+{
+    return util_concat(fsimage->name, JOURNAL_EXTENSION, NULL);
+}
+
+/* must be called with the lock held */
+static int journal_reset(fsimage_cache_t *cache)
+{
+    if (cache->journal != NULL) {
+        fclose(cache->journal);
+    }
+    cache->journal = fopen(cache->journal_name, MODE_WRITE);
+    if (cache->journal == NULL) {
+        log_error(fsimage_cache_log, "Cannot create journal `%s'.",
+                  cache->journal_name);
+        return -1;
+    }
+    if (fwrite(JOURNAL_MAGIC, JOURNAL_MAGIC_LEN, 1, cache->journal) < 1) {
+        log_error(fsimage_cache_log, "Cannot write journal `%s'.",
+                  cache->journal_name);
+    }
+    fflush(cache->journal);
+    cache->journal_records = 0;
+    return 0;
+}
+
+/* must be called with the lock held */
+static void journal_append(fsimage_cache_t *cache, const void *buf, size_t num,
+                           long offset)
+{
+    uint8_t header[8];
+
+    util_dword_to_le_buf(&header[0], (uint32_t)offset);
+    util_dword_to_le_buf(&header[4], (uint32_t)num);
+
+    if (fwrite(header, sizeof(header), 1, cache->journal) < 1
+        || fwrite(buf, num, 1, cache->journal) < 1) {
+        log_error(fsimage_cache_log, "Cannot write journal `%s'.",
+                  cache->journal_name);
+    }
+    fflush(cache->journal);
+    cache->journal_records++;
+}
+
+/** \brief  Write the records of a left over journal to the image
+ *
+ * Called when the image is opened read/write, before it is probed. The
+ * journal is removed afterwards.
+ *
+ * \param[in,out]   fsimage file system image
+ */
+void fsimage_cache_replay_journal(fsimage_t *fsimage)
+{
+    FILE *journal;
+    char *name;
+    uint8_t header[8];
+    uint8_t *data;
+    uint32_t offset;
+    uint32_t len;
+    unsigned int records = 0;
+
+    name = journal_name_get(fsimage);
+    journal = fopen(name, MODE_READ);
+    if (journal == NULL) {
+        lib_free(name);
+        return;
+    }
+
+    if (fread(header, JOURNAL_MAGIC_LEN, 1, journal) < 1
+        || memcmp(header, JOURNAL_MAGIC, JOURNAL_MAGIC_LEN) != 0) {
+        log_error(fsimage_cache_log, "Ignoring invalid journal `%s'.", name);
+        fclose(journal);
+        lib_free(name);
+        return;
+    }
+
+    /* a partial record at the end was never completed, skip it */
+    while (fread(header, sizeof(header), 1, journal) == 1) {
+        offset = util_le_buf_to_dword(&header[0]);
+        len = util_le_buf_to_dword(&header[4]);
+        data = lib_malloc(len);
+        if (fread(data, len, 1, journal) < 1) {
+            lib_free(data);
+            break;
+        }
+        if (fsimage_mmap_write(fsimage, data, len, (long)offset) < 0) {
+            log_error(fsimage_cache_log, "Cannot write journal record to `%s'.",
+                      fsimage->name);
+        }
+        lib_free(data);
+        records++;
+    }
+    fclose(journal);
+    fflush(fsimage->fd);
+
+    log_message(fsimage_cache_log, "Recovered %u writes from journal `%s'.",
+                records, name);
+    archdep_remove(name);
+    lib_free(name);
+}
+
+/*-----------------------------------------------------------------------*/
+
+static void batch_free(fsimage_cache_t *cache)
+{
+    unsigned int i;
+
+    for (i = 0; i < cache->batch_len; i++) {
+        lib_free(cache->batch[i].data);
+    }
+    lib_free(cache->batch);
+    cache->batch = NULL;
+    cache->batch_len = 0;
+}
+
+/* write the batch to the image file, runs on the flush thread or on the
+   emulation thread */
+static void batch_write(fsimage_cache_t *cache)
+{
+    fsimage_t *fsimage = cache->fsimage;
+    cache_batch_entry_t *entry;
+    unsigned int i;
+    off_t end;
+
+    DBG(("fsimage_cache: writing %u blocks to `%s'", cache->batch_len, fsimage->name));
+
+    for (i = 0; i < cache->batch_len; i++) {
+        entry = &cache->batch[i];
+        /* take the lock per block so reads don't wait for the whole batch */
+        pthread_mutex_lock(&cache->lock);
+        if (fsimage_mmap_write(fsimage, entry->data, entry->len, entry->offset) < 0) {
+            log_error(fsimage_cache_log, "Cannot write to disk image `%s'.",
+                      fsimage->name);
+        }
+        end = (off_t)entry->offset + (off_t)entry->len;
+        if (end > cache->file_size) {
+            cache->file_size = end;
+        }
+        pthread_mutex_unlock(&cache->lock);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    fflush(fsimage->fd);
+    /* the journal can only go if nothing was added since the batch was made */
+    if (cache->journal != NULL
+        && cache->journal_records == cache->batch_journal_records) {
+        journal_reset(cache);
+    }
+    batch_free(cache);
+    cache->busy = 0;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static void *flush_thread(void *arg)
+{
+    batch_write((fsimage_cache_t *)arg);
+    return NULL;
+}
+
+/* wait for a running flush to finish */
+static void flush_join(fsimage_cache_t *cache)
+{
+    if (cache->thread_started) {
+        pthread_join(cache->thread, NULL);
+        cache->thread_started = 0;
+    }
+}
+
+static void flush_start(fsimage_cache_t *cache, int async)
+{
+    cache_batch_entry_t *entry;
+    unsigned int i;
+    long offset;
+
+    flush_join(cache);
+
+    if (cache->num_dirty == 0) {
+        return;
+    }
+
+    cache->batch = lib_malloc(cache->num_dirty * sizeof(cache_batch_entry_t));
+    cache->batch_len = 0;
+    for (i = 0; i < cache->num_blocks; i++) {
+        if (!cache->dirty[i]) {
+            continue;
+        }
+        offset = (long)i << CACHE_BLOCK_SHIFT;
+        entry = &cache->batch[cache->batch_len++];
+        entry->offset = offset;
+        entry->len = CACHE_BLOCK_SIZE;
+        /* don't grow the file beyond the last byte written */
+        if ((off_t)offset + CACHE_BLOCK_SIZE > cache->size) {
+            entry->len = (size_t)(cache->size - offset);
+        }
+        entry->data = lib_malloc(entry->len);
+        memcpy(entry->data, cache->blocks[i], entry->len);
+        cache->dirty[i] = 0;
+    }
+    cache->num_dirty = 0;
+
+    pthread_mutex_lock(&cache->lock);
+    cache->busy = 1;
+    cache->batch_journal_records = cache->journal_records;
+    pthread_mutex_unlock(&cache->lock);
+
+    if (async) {
+        if (pthread_create(&cache->thread, NULL, flush_thread, cache) == 0) {
+            cache->thread_started = 1;
+            return;
+        }
+        log_error(fsimage_cache_log, "Cannot start flush thread, flushing now.");
+    }
+    batch_write(cache);
+}
+
+/*-----------------------------------------------------------------------*/
+
+/** \brief  Set up the write-back cache for a freshly opened image
+ *
+ * Does nothing unless "DiskImageWriteBack" is enabled and the image is
+ * writable and of a cached type.
+ *
+ * \param[in,out]   image   disk image
+ */
+void fsimage_cache_open(disk_image_t *image)
+{
+    fsimage_t *fsimage = image->media.fsimage;
+    fsimage_cache_t *cache;
+
+    if (!writeback_enabled || image->read_only || fsimage->cache != NULL) {
+        return;
+    }
+    if (image->type == DISK_IMAGE_TYPE_P64
+        || image->type == DISK_IMAGE_TYPE_DHD) {
+        return;
+    }
+
+    cache = lib_calloc(1, sizeof(fsimage_cache_t));
+    cache->fsimage = fsimage;
+    cache->file_size = archdep_file_size(fsimage->fd);
+    if (cache->file_size < 0) {
+        cache->file_size = 0;
+    }
+    cache->size = cache->file_size;
+    pthread_mutex_init(&cache->lock, NULL);
+
+    if (journal_enabled) {
+        cache->journal_name = journal_name_get(fsimage);
+        journal_reset(cache);
+    }
+
+    cache->next = caches;
+    caches = cache;
+    fsimage->cache = cache;
+
+    DBG(("fsimage_cache: caching `%s'", fsimage->name));
+}
+
+/** \brief  Write back all dirty blocks and drop the cache of an image
+ *
+ * \param[in,out]   fsimage file system image
+ */
+void fsimage_cache_close(fsimage_t *fsimage)
+{
+    fsimage_cache_t *cache = fsimage->cache;
+    fsimage_cache_t **prev;
+    unsigned int i;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    flush_start(cache, 0);
+
+    if (cache->journal != NULL) {
+        fclose(cache->journal);
+        archdep_remove(cache->journal_name);
+    }
+    lib_free(cache->journal_name);
+
+    for (prev = &caches; *prev != NULL; prev = &(*prev)->next) {
+        if (*prev == cache) {
+            *prev = cache->next;
+            break;
+        }
+    }
+
+    for (i = 0; i < cache->num_blocks; i++) {
+        lib_free(cache->blocks[i]);
+    }
+    lib_free(cache->blocks);
+    lib_free(cache->dirty);
+    pthread_mutex_destroy(&cache->lock);
+    lib_free(cache);
+    fsimage->cache = NULL;
+}
+
+/* read uncached bytes from the file, zeros beyond its end */
+static int read_file(fsimage_cache_t *cache, uint8_t *buf, size_t num, long offset)
+{
+    size_t avail = 0;
+    int res = 0;
+
+    pthread_mutex_lock(&cache->lock);
+    if ((off_t)offset < cache->file_size) {
+        avail = (size_t)(cache->file_size - offset);
+        if (avail > num) {
+            avail = num;
+        }
+        res = fsimage_mmap_read(cache->fsimage, buf, avail, offset);
+    }
+    pthread_mutex_unlock(&cache->lock);
+
+    memset(buf + avail, 0, num - avail);
+    return res;
+}
+
+/** \brief  Read from the image, like util_fpread()
+ *
+ * \param[in]   fsimage file system image
+ * \param[out]  buf     where to store the data
+ * \param[in]   num     number of bytes
+ * \param[in]   offset  offset in the image file
+ *
+ * \return  0 on success, -1 on error
+ */
+int fsimage_cache_read(fsimage_t *fsimage, void *buf, size_t num, long offset)
+{
+    fsimage_cache_t *cache = fsimage->cache;
+    uint8_t *dest = buf;
+    unsigned int block;
+    size_t pos;
+    size_t run;
+    size_t len;
+
+    if (cache == NULL) {
+        return fsimage_mmap_read(fsimage, buf, num, offset);
+    }
+
+    if (offset < 0 || (off_t)offset + (off_t)num > cache->size) {
+        return -1;
+    }
+
+    pos = 0;
+    while (pos < num) {
+        block = (unsigned int)((offset + pos) >> CACHE_BLOCK_SHIFT);
+        len = CACHE_BLOCK_SIZE - ((offset + pos) & (CACHE_BLOCK_SIZE - 1));
+        if (len > num - pos) {
+            len = num - pos;
+        }
+        if (block < cache->num_blocks && cache->blocks[block] != NULL) {
+            memcpy(dest + pos, cache->blocks[block] + ((offset + pos) & (CACHE_BLOCK_SIZE - 1)), len);
+            pos += len;
+            continue;
+        }
+        /* collect a run of uncached blocks and read them at once */
+        run = len;
+        while (pos + run < num) {
+            block++;
+            if (block < cache->num_blocks && cache->blocks[block] != NULL) {
+                break;
+            }
+            run += CACHE_BLOCK_SIZE;
+        }
+        if (run > num - pos) {
+            run = num - pos;
+        }
+        if (read_file(cache, dest + pos, run, offset + (long)pos) < 0) {
+            return -1;
+        }
+        pos += run;
+    }
+    return 0;
+}
+
+static uint8_t *block_get(fsimage_cache_t *cache, unsigned int block)
+{
+    unsigned int num;
+
+    if (block >= cache->num_blocks) {
+        num = cache->num_blocks ? cache->num_blocks : 64;
+        while (num <= block) {
+            num *= 2;
+        }
+        cache->blocks = lib_realloc(cache->blocks, num * sizeof(uint8_t *));
+        cache->dirty = lib_realloc(cache->dirty, num);
+        memset(cache->blocks + cache->num_blocks, 0,
+               (num - cache->num_blocks) * sizeof(uint8_t *));
+        memset(cache->dirty + cache->num_blocks, 0, num - cache->num_blocks);
+        cache->num_blocks = num;
+    }
+
+    if (cache->blocks[block] == NULL) {
+        cache->blocks[block] = lib_malloc(CACHE_BLOCK_SIZE);
+        read_file(cache, cache->blocks[block], CACHE_BLOCK_SIZE,
+                  (long)block << CACHE_BLOCK_SHIFT);
+    }
+    return cache->blocks[block];
+}
+
+/** \brief  Write to the image, like util_fpwrite()
+ *
+ * \param[in,out]   fsimage file system image
+ * \param[in]       buf     data to write
+ * \param[in]       num     number of bytes
+ * \param[in]       offset  offset in the image file
+ *
+ * \return  0 on success, -1 on error
+ */
+int fsimage_cache_write(fsimage_t *fsimage, const void *buf, size_t num, long offset)
+{
+    fsimage_cache_t *cache = fsimage->cache;
+    const uint8_t *src = buf;
+    unsigned int block;
+    size_t pos;
+    size_t len;
+
+    if (cache == NULL) {
+        return fsimage_mmap_write(fsimage, buf, num, offset);
+    }
+
+    if (offset < 0) {
+        return -1;
+    }
+
+    if (cache->journal != NULL) {
+        pthread_mutex_lock(&cache->lock);
+        journal_append(cache, buf, num, offset);
+        pthread_mutex_unlock(&cache->lock);
+    }
+
+    if (cache->num_dirty == 0) {
+        cache->dirty_since = time(NULL);
+    }
+
+    pos = 0;
+    while (pos < num) {
+        block = (unsigned int)((offset + pos) >> CACHE_BLOCK_SHIFT);
+        len = CACHE_BLOCK_SIZE - ((offset + pos) & (CACHE_BLOCK_SIZE - 1));
+        if (len > num - pos) {
+            len = num - pos;
+        }
+        memcpy(block_get(cache, block) + ((offset + pos) & (CACHE_BLOCK_SIZE - 1)),
+               src + pos, len);
+        if (!cache->dirty[block]) {
+            cache->dirty[block] = 1;
+            cache->num_dirty++;
+        }
+        pos += len;
+    }
+
+    if ((off_t)offset + (off_t)num > cache->size) {
+        cache->size = (off_t)offset + (off_t)num;
+    }
+    return 0;
+}
+
+/** \brief  Make the written data visible, replaces fflush() on the image
+ *
+ * With the cache the data stays in memory until the next flush.
+ *
+ * \param[in,out]   fsimage file system image
+ */
+void fsimage_cache_sync(fsimage_t *fsimage)
+{
+    if (fsimage->cache == NULL) {
+        fflush(fsimage->fd);
+    }
+}
+
+/** \brief  Get the image size including the cached writes
+ *
+ * \param[in]   fsimage file system image
+ *
+ * \return  size in bytes
+ */
+off_t fsimage_cache_size(fsimage_t *fsimage)
+{
+    if (fsimage->cache == NULL) {
+        return archdep_file_size(fsimage->fd);
+    }
+    return fsimage->cache->size;
+}
+
+/*-----------------------------------------------------------------------*/
+
+/** \brief  Write all dirty blocks of all images and wait until done
+ *
+ * Used before saving a snapshot.
+ */
+void fsimage_cache_flush_all(void)
+{
+    fsimage_cache_t *cache;
+
+    for (cache = caches; cache != NULL; cache = cache->next) {
+        flush_start(cache, 0);
+    }
+}
+
+/** \brief  Start background flushes for images with old enough dirty blocks
+ *
+ * Called once per frame.
+ */
+void fsimage_cache_check_timer(void)
+{
+    fsimage_cache_t *cache;
+    time_t now;
+    int busy;
+
+    if (caches == NULL) {
+        return;
+    }
+
+    now = time(NULL);
+    for (cache = caches; cache != NULL; cache = cache->next) {
+        if (cache->num_dirty == 0
+            || now - cache->dirty_since < (time_t)writeback_delay) {
+            continue;
+        }
+        pthread_mutex_lock(&cache->lock);
+        busy = cache->busy;
+        pthread_mutex_unlock(&cache->lock);
+        /* try again next frame */
+        if (!busy) {
+            flush_start(cache, 1);
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------*/
+
+static int set_writeback_enabled(int val, void *param)
+{
+    writeback_enabled = val ? 1 : 0;
+    return 0;
+}
+
+static int set_writeback_delay(int val, void *param)
+{
+    if (val < 0 || val > 3600) {
+        return -1;
+    }
+    writeback_delay = val;
+    return 0;
+}
+
+static int set_journal_enabled(int val, void *param)
+{
+    journal_enabled = val ? 1 : 0;
+    return 0;
+}
+
+static const resource_int_t resources_int[] = {
+    { "DiskImageWriteBack", 0, RES_EVENT_NO, NULL,
+      &writeback_enabled, set_writeback_enabled, NULL },
+    { "DiskImageWriteBackDelay", 2, RES_EVENT_NO, NULL,
+      &writeback_delay, set_writeback_delay, NULL },
+    { "DiskImageJournal", 0, RES_EVENT_NO, NULL,
+      &journal_enabled, set_journal_enabled, NULL },
+    RESOURCE_INT_LIST_END
+};
+
+int fsimage_cache_resources_init(void)
+{
+    return resources_register_int(resources_int);
+}
+
+static const cmdline_option_t cmdline_options[] =
+{
+    { "-diskwriteback", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "DiskImageWriteBack", (resource_value_t)1,
+      NULL, "Cache writes to disk images in memory and write them back in the background" },
+    { "+diskwriteback", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "DiskImageWriteBack", (resource_value_t)0,
+      NULL, "Write to disk images immediately" },
+    { "-diskwritebackdelay", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "DiskImageWriteBackDelay", NULL,
+      "<Seconds>", "Set the time cached writes stay in memory before being written back" },
+    { "-diskjournal", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "DiskImageJournal", (resource_value_t)1,
+      NULL, "Keep a journal of the cached writes, replayed on the next attach after a crash" },
+    { "+diskjournal", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "DiskImageJournal", (resource_value_t)0,
+      NULL, "Do not keep a journal of the cached writes" },
+    CMDLINE_LIST_END
+};
+
+int fsimage_cache_cmdline_options_init(void)
+{
+    return cmdline_register_options(cmdline_options);
+}
+
+void fsimage_cache_init(void)
+{
+    fsimage_cache_log = log_open("Disk Image Cache");
+}
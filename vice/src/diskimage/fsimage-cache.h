@@ -0,0 +1,51 @@
+/*
+ * fsimage-cache.h - Write-back cache for file system based disk images.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_FSIMAGE_CACHE_H
+#define VICE_FSIMAGE_CACHE_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "types.h"
+
+struct disk_image_s;
+struct fsimage_s;
+
+void fsimage_cache_init(void);
+int fsimage_cache_resources_init(void);
+int fsimage_cache_cmdline_options_init(void);
+
+void fsimage_cache_replay_journal(struct fsimage_s *fsimage);
+void fsimage_cache_open(struct disk_image_s *image);
+void fsimage_cache_close(struct fsimage_s *fsimage);
+
+int fsimage_cache_read(struct fsimage_s *fsimage, void *buf, size_t num, long offset);
+int fsimage_cache_write(struct fsimage_s *fsimage, const void *buf, size_t num, long offset);
+void fsimage_cache_sync(struct fsimage_s *fsimage);
+off_t fsimage_cache_size(struct fsimage_s *fsimage);
+
+void fsimage_cache_flush_all(void);
+void fsimage_cache_check_timer(void);
+
+#endif
@@ -33,6 +33,7 @@
 #include "diskimage.h"
 #include "drive.h"
 #include "cbmdos.h"
+#include "fsimage-cache.h"
 #include "fsimage-dxx.h"
 #include "fsimage.h"
 #include "gcr.h"
@@ -53,6 +54,7 @@ int fsimage_dxx_write_half_track(disk_image_t *image, unsigned int half_track,
     uint8_t *buffer;
     fsimage_t *fsimage = image->media.fsimage;
     fdc_err_t rf;
+    fdc_err_t *errors;
 
     track = half_track / 2;
 
@@ -76,8 +78,10 @@ int fsimage_dxx_write_half_track(disk_image_t *image, unsigned int half_track,
     }
 
     buffer = lib_calloc(max_sector, 256);
+    errors = lib_malloc(max_sector * sizeof(fdc_err_t));
+    gcr_read_track(raw, buffer, errors, max_sector);
     for (sector = 0; sector < max_sector; sector++) {
-        rf = gcr_read_sector(raw, &buffer[sector * 256], (uint8_t)sector);
+        rf = errors[sector];
         if (rf != CBMDOS_FDC_ERR_OK) {
             log_error(fsimage_dxx_log,
                       "Could not find data sector of T:%u S:%u.",
@@ -101,6 +105,7 @@ int fsimage_dxx_write_half_track(disk_image_t *image, unsigned int half_track,
             }
         }
     }
+    lib_free(errors);
     offset = sectors * 256;
 
 #ifdef HAVE_X64_IMAGE
@@ -108,7 +113,7 @@ int fsimage_dxx_write_half_track(disk_image_t *image, unsigned int half_track,
         offset += X64_HEADER_LENGTH;
     }
 #endif
-    if (util_fpwrite(fsimage->fd, buffer, max_sector * 256, offset) < 0) {
+    if (fsimage_cache_write(fsimage, buffer, max_sector * 256, offset) < 0) {
         log_error(fsimage_dxx_log, "Error writing T:%u to disk image.",
                   track);
         lib_free(buffer);
@@ -126,10 +131,10 @@ int fsimage_dxx_write_half_track(disk_image_t *image, unsigned int half_track,
 #endif
             fsimage->error_info.dirty = 0;
             if (error_info_created) {
-                res = util_fpwrite(fsimage->fd, fsimage->error_info.map,
+                res = fsimage_cache_write(fsimage, fsimage->error_info.map,
                                    fsimage->error_info.len, fsimage->error_info.len * 256);
             } else {
-                res = util_fpwrite(fsimage->fd, fsimage->error_info.map + sectors,
+                res = fsimage_cache_write(fsimage, fsimage->error_info.map + sectors,
                                    max_sector, offset);
             }
             if (res < 0) {
@@ -142,17 +147,265 @@ int fsimage_dxx_write_half_track(disk_image_t *image, unsigned int half_track,
     }
 
     /* Make sure the stream is visible to other readers.  */
-    fflush(fsimage->fd);
+    fsimage_cache_sync(fsimage);
     return 0;
 }
 
+/*-----------------------------------------------------------------------*/
+/* Lazy generation of the GCR tracks.
+
+   Attaching a sector based image to the true drive emulation only sets up
+   the layout of the tracks (disk ID and track skew) and marks them pending.
+   A track is converted to GCR when the head is first moved onto it, or when
+   a sector of it is accessed through the GCR data.
+
+   Generated tracks which were not modified are kept in a small cache when
+   the image is detached. The cache is keyed by a hash of everything the GCR
+   data is made from, so attaching the same image again (fliplist swaps,
+   reset with autostart) reuses them after reading the sectors, while any
+   change to the image content misses the cache.  */
+
+/* Number of tracks kept in the cache, about 4 double sided disks */
+#define GCR_CACHE_TRACKS    280
+
+typedef struct fsimage_dxx_track_s {
+    unsigned long offset;   /* track skew in bytes */
+    gcr_header_t header;    /* disk ID and track number of the headers */
+    uint64_t key;           /* hash of the data the track was made from */
+    uint64_t check;         /* hash of the GCR data when it was made */
+} fsimage_dxx_track_t;
+
+typedef struct gcr_cache_entry_s {
+    uint64_t key;
+    uint8_t *data;
+    int size;
+    unsigned long used;
+} gcr_cache_entry_t;
+
+static gcr_cache_entry_t gcr_cache[GCR_CACHE_TRACKS];
+static unsigned long gcr_cache_clock = 0;
+
+/* FNV-1a */
+static uint64_t hash_bytes(uint64_t hash, const uint8_t *data, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+static uint64_t hash_value(uint64_t hash, unsigned long value)
+{
+    uint8_t buf[4];
+
+    buf[0] = (uint8_t)value;
+    buf[1] = (uint8_t)(value >> 8);
+    buf[2] = (uint8_t)(value >> 16);
+    buf[3] = (uint8_t)(value >> 24);
+    return hash_bytes(hash, buf, sizeof(buf));
+}
+
+#define HASH_INIT   UINT64_C(0xcbf29ce484222325)
+
+/* take the track with hash `key' out of the cache */
+static uint8_t *gcr_cache_fetch(uint64_t key, int size)
+{
+    uint8_t *data;
+    int i;
+
+    for (i = 0; i < GCR_CACHE_TRACKS; i++) {
+        if (gcr_cache[i].data != NULL && gcr_cache[i].key == key
+            && gcr_cache[i].size == size) {
+            data = gcr_cache[i].data;
+            gcr_cache[i].data = NULL;
+            return data;
+        }
+    }
+    return NULL;
+}
+
+/* put a track into the cache, the oldest one is dropped if it is full */
+static void gcr_cache_store(uint64_t key, uint8_t *data, int size)
+{
+    int i, slot = 0;
+
+    for (i = 0; i < GCR_CACHE_TRACKS; i++) {
+        if (gcr_cache[i].data == NULL) {
+            slot = i;
+            break;
+        }
+        if (gcr_cache[i].used < gcr_cache[slot].used) {
+            slot = i;
+        }
+    }
+    lib_free(gcr_cache[slot].data);
+
+    gcr_cache[slot].key = key;
+    gcr_cache[slot].data = data;
+    gcr_cache[slot].size = size;
+    gcr_cache[slot].used = ++gcr_cache_clock;
+}
+
+/** \brief  Generate the GCR data of a pending track
+ *
+ * \param[in]   image   disk image
+ * \param[in]   index   half track index into the GCR image (0 is track 1)
+ */
+void fsimage_dxx_gcr_track(const disk_image_t *image, unsigned int index)
+{
+    fsimage_t *fsimage = image->media.fsimage;
+    fsimage_dxx_track_t *info;
+    disk_track_t *raw = &image->gcr->tracks[index];
+    uint8_t *buffer, *rf, *cached, *ptr, *tempgcr;
+    unsigned int track, sector, max_sector, track_size;
+    unsigned long trackoffset;
+    int gap, headergap, synclen;
+    int sectors;
+    long offset;
+    gcr_header_t header;
+    uint64_t key;
+
+    image->gcr->pending[index] = 0;
+
+    track = index / 2 + 1;
+    if (fsimage->dxx_tracks == NULL || track > fsimage->dxx_num_tracks
+        || raw->data == NULL) {
+        return;
+    }
+    info = &fsimage->dxx_tracks[track];
+
+    track_size = (unsigned int)raw->size;
+    trackoffset = info->offset;
+    gap = disk_image_gap_size(image->type, track);
+    headergap = disk_image_header_gap_size(image->type, track);
+    synclen = disk_image_sync_size(image->type, track);
+    max_sector = disk_image_sector_per_track(image->type, track);
+
+    /* read the sectors, followed by their error codes */
+    buffer = lib_malloc(max_sector * 257);
+    rf = buffer + max_sector * 256;
+    for (sector = 0; sector < max_sector; sector++) {
+        sectors = disk_image_check_sector(image, track, sector);
+        offset = sectors * 256;
+
+#ifdef HAVE_X64_IMAGE
+        if (image->type == DISK_IMAGE_TYPE_X64) {
+            offset += X64_HEADER_LENGTH;
+        }
+#endif
+        rf[sector] = 0;
+        if (sectors >= 0) {
+            rf[sector] = CBMDOS_FDC_ERR_DRIVE;
+            if (fsimage_cache_read(fsimage, buffer + sector * 256, 256, offset) >= 0) {
+                if (fsimage->error_info.map != NULL) {
+                    rf[sector] = fsimage->error_info.map[sectors];
+                }
+            }
+        }
+    }
+
+    key = hash_bytes(HASH_INIT, buffer, max_sector * 256);
+    key = hash_bytes(key, rf, max_sector);
+    key = hash_value(key, info->header.track | (info->header.id1 << 8) | (info->header.id2 << 16));
+    key = hash_value(key, trackoffset);
+    key = hash_value(key, track_size);
+    key = hash_value(key, image->type);
+    info->key = key;
+
+    cached = gcr_cache_fetch(key, raw->size);
+    if (cached != NULL) {
+        lib_free(raw->data);
+        raw->data = cached;
+        info->check = hash_bytes(HASH_INIT, raw->data, track_size);
+        lib_free(buffer);
+        return;
+    }
+
+    header = info->header;
+    ptr = tempgcr = lib_malloc(track_size);
+
+    /* Clear track to avoid read errors.  */
+    memset(ptr, 0x55, track_size);
+
+    for (sector = 0; sector < max_sector; sector++) {
+        if (disk_image_check_sector(image, track, sector) >= 0) {
+            header.sector = sector;
+            gcr_convert_sector_to_GCR(buffer + sector * 256, ptr, &header,
+                                      headergap, synclen, (fdc_err_t)rf[sector]);
+        }
+
+        ptr += SECTOR_GCR_SIZE_WITH_HEADER + headergap + gap + (synclen * 2);
+    }
+
+#if 0
+    /* copy gcr data to buffer (this creates perfectly aligned tracks) */
+    memcpy(raw->data, tempgcr, track_size);
+#else
+    /* copy gcr data to final buffer with offset + wraparound */
+    ptr = raw->data;
+    memset(ptr, 0x55, track_size);
+    memcpy(ptr + trackoffset, tempgcr, track_size - trackoffset);
+    memcpy(ptr, tempgcr + (track_size - trackoffset), track_size - (track_size - trackoffset));
+#endif
+    lib_free(tempgcr);
+    lib_free(buffer);
+
+    info->check = hash_bytes(HASH_INIT, raw->data, track_size);
+}
+
+/** \brief  Keep the unmodified GCR tracks of an image which is detached
+ *
+ * The tracks are taken out of the GCR image and put into the cache.
+ *
+ * \param[in]   image   disk image
+ */
+void fsimage_dxx_release_gcr(const disk_image_t *image)
+{
+    fsimage_t *fsimage = image->media.fsimage;
+    fsimage_dxx_track_t *info;
+    disk_track_t *raw;
+    unsigned int track;
+
+    if (image->gcr == NULL || fsimage->dxx_tracks == NULL) {
+        return;
+    }
+
+    for (track = 1; track <= fsimage->dxx_num_tracks; track++) {
+        info = &fsimage->dxx_tracks[track];
+        raw = &image->gcr->tracks[track * 2 - 2];
+        if (info->key == 0 || image->gcr->pending[track * 2 - 2]
+            || raw->data == NULL) {
+            continue;
+        }
+        if (hash_bytes(HASH_INIT, raw->data, raw->size) == info->check) {
+            gcr_cache_store(info->key, raw->data, raw->size);
+            raw->data = NULL;
+            raw->size = 0;
+        }
+        info->key = 0;
+    }
+}
+
+/** \brief  Free the track layout of an image
+ *
+ * \param[in,out]   fsimage file system image
+ */
+void fsimage_dxx_close(fsimage_t *fsimage)
+{
+    lib_free(fsimage->dxx_tracks);
+    fsimage->dxx_tracks = NULL;
+    fsimage->dxx_num_tracks = 0;
+}
+
 int fsimage_read_dxx_image(const disk_image_t *image)
 {
     uint8_t buffer[256], *bam_id;
     int gap, headergap, synclen;
-    unsigned int track, sector, track_size;
+    unsigned int track, track_size;
     gcr_header_t header;
-    fdc_err_t rf;
     int image_has_two_single_sides = 0;
     int double_sided_drive = 0;
     fsimage_t *fsimage = image->media.fsimage;
@@ -160,9 +413,7 @@ int fsimage_read_dxx_image(const disk_image_t *image)
     uint8_t *ptr;
     int half_track;
     int sectors;
-    long offset;
     unsigned long trackoffset = 0;
-    uint8_t *tempgcr;
 
     if (image->type == DISK_IMAGE_TYPE_D80
         || image->type == DISK_IMAGE_TYPE_D82) {
@@ -175,13 +426,17 @@ int fsimage_read_dxx_image(const disk_image_t *image)
 
     bam_id[0] = bam_id[1] = 0xa0;
     if (sectors >= 0) {
-        util_fpread(fsimage->fd, buffer, 256, sectors << 8);
+        fsimage_cache_read(fsimage, buffer, 256, sectors << 8);
     } else {
         return -1;
     }
     header.id1 = bam_id[0];
     header.id2 = bam_id[1];
 
+    fsimage_dxx_close(fsimage);
+    fsimage->dxx_num_tracks = image->max_half_tracks / 2;
+    fsimage->dxx_tracks = lib_calloc(fsimage->dxx_num_tracks + 1, sizeof(fsimage_dxx_track_t));
+
     /* check double sided images */
     image_has_two_single_sides = (image->type == DISK_IMAGE_TYPE_D71) && !(buffer[0x03] & 0x80);
     double_sided_drive = (drive_get_disk_drive_type(image->device) == DRIVE_TYPE_1571) ||
@@ -232,9 +487,6 @@ int fsimage_read_dxx_image(const disk_image_t *image)
         image->gcr->tracks[half_track].size = track_size;
 
         if (track <= image->tracks) {
-            /* get temp buffer */
-            ptr = tempgcr = lib_malloc(track_size);
-
             /* special case for second side of the 1571. If each side was formatted
                separately in one-sided mode, we must start from track 1 again and use
                the ID from the BAM on the second side. */
@@ -243,7 +495,7 @@ int fsimage_read_dxx_image(const disk_image_t *image)
 
                 buffer[BAM_ID_1571] = buffer[BAM_ID_1571 + 1] = 0xa0;
                 if (sectors >= 0) {
-                    util_fpread(fsimage->fd, buffer, 256, sectors << 8);
+                    fsimage_cache_read(fsimage, buffer, 256, sectors << 8);
                 }
                 header.id1 = buffer[BAM_ID_1571]; /* second side, update id and track */
                 header.id2 = buffer[BAM_ID_1571 + 1];
@@ -256,54 +508,23 @@ int fsimage_read_dxx_image(const disk_image_t *image)
 
             max_sector = disk_image_sector_per_track(image->type, track);
 
-            /* Clear track to avoid read errors.  */
-            memset(ptr, 0x55, track_size);
-
-            for (sector = 0; sector < max_sector; sector++) {
-                sectors = disk_image_check_sector(image, track, sector);
-                offset = sectors * 256;
-
-#ifdef HAVE_X64_IMAGE
-                if (image->type == DISK_IMAGE_TYPE_X64) {
-                    offset += X64_HEADER_LENGTH;
-                }
-#endif
-                if (sectors >= 0) {
-                    rf = CBMDOS_FDC_ERR_DRIVE;
-                    if (util_fpread(fsimage->fd, buffer, 256, offset) >= 0) {
-                        if (fsimage->error_info.map != NULL) {
-                            rf = fsimage->error_info.map[sectors];
-                        }
-                    }
-                    header.sector = sector;
-                    gcr_convert_sector_to_GCR(buffer, ptr, &header, headergap, synclen, rf);
-                }
-
-                ptr += SECTOR_GCR_SIZE_WITH_HEADER + headergap + gap + (synclen * 2);
-            }
-
-#if 0
-            /* copy gcr data to buffer (this creates perfectly aligned tracks) */
-            ptr = image->gcr->tracks[half_track].data;
-            memcpy(ptr, tempgcr, track_size);
-#else
-            /* copy gcr data to final buffer with offset + wraparound */
             /* On real disks, the track skew depends on many factors of which
                none is exactly defined: the mechanical properties of the drive,
                and last not least the code used for formatting the disk. Thus
                the offset we use here is somewhat arbitrary, the choosen values
                are tweaked to be somewhat close to what the skew1.prg program
                shows for the first few tracks. */
-            trackoffset += (ptr - tempgcr) - gap; /* bytes we have written */
+            trackoffset += max_sector * (SECTOR_GCR_SIZE_WITH_HEADER + headergap + gap + (synclen * 2))
+                           - gap; /* bytes we have written */
             trackoffset += (track_size * 100) / 270; /* time it takes to step */
             trackoffset %= track_size;
             /*printf("track: %2u sectors: %2u size: %5u offset: %5lu\n", track, max_sector, track_size, trackoffset);*/
-            ptr = image->gcr->tracks[half_track].data;
-            memset(ptr, 0x55, track_size);
-            memcpy(ptr + trackoffset, tempgcr, track_size - trackoffset);
-            memcpy(ptr, tempgcr + (track_size - trackoffset), track_size - (track_size - trackoffset));
-#endif
-            lib_free(tempgcr);
+
+            fsimage->dxx_tracks[track].offset = trackoffset;
+            fsimage->dxx_tracks[track].header = header;
+
+            /* the GCR data is generated on first access */
+            image->gcr->pending[half_track] = 1;
         } else {
             memset(ptr, 0x55, track_size);
         }
@@ -373,7 +594,7 @@ int fsimage_dxx_read_sector(const disk_image_t *image, uint8_t *buf, const disk_
 
     if (harderror == 0) {
         if (image->gcr == NULL) {
-            if (util_fpread(fsimage->fd, buf, 256, offset) < 0) {
+            if (fsimage_cache_read(fsimage, buf, 256, offset) < 0) {
                 log_error(fsimage_dxx_log,
                         "Error reading T:%u S:%u from disk image.",
                         dadr->track, dadr->sector);
@@ -382,6 +603,9 @@ int fsimage_dxx_read_sector(const disk_image_t *image, uint8_t *buf, const disk_
                 rf = fsimage->error_info.map ? fsimage->error_info.map[sectors] : CBMDOS_FDC_ERR_OK;
             }
         } else {
+            if (image->gcr->pending[(dadr->track * 2) - 2]) {
+                fsimage_dxx_gcr_track(image, (dadr->track * 2) - 2);
+            }
             rf = gcr_read_sector(&image->gcr->tracks[(dadr->track * 2) - 2], buf, (uint8_t)dadr->sector);
             /* HACK: if the image has an error map, and the "FDC" did not detect an
             error in the GCR stream, use the error from the error map instead.
@@ -450,12 +674,13 @@ int fsimage_dxx_write_sector(disk_image_t *image, const uint8_t *buf, const disk
         offset += X64_HEADER_LENGTH;
     }
 #endif
-    if (util_fpwrite(fsimage->fd, buf, 256, offset) < 0) {
+    if (fsimage_cache_write(fsimage, buf, 256, offset) < 0) {
         log_error(fsimage_dxx_log, "Error writing T:%u S:%u to disk image.",
                   dadr->track, dadr->sector);
         return -1;
     }
-    if (image->gcr != NULL) {
+    /* a pending track is made from the image later, including this sector */
+    if (image->gcr != NULL && !image->gcr->pending[(dadr->track * 2) - 2]) {
         gcr_write_sector(&image->gcr->tracks[(dadr->track * 2) - 2], buf, (uint8_t)dadr->sector);
     }
 
@@ -469,7 +694,7 @@ int fsimage_dxx_write_sector(disk_image_t *image, const uint8_t *buf, const disk
         }
 #endif
         fsimage->error_info.map[sectors] = CBMDOS_FDC_ERR_OK;
-        if (util_fpwrite(fsimage->fd, &fsimage->error_info.map[sectors], 1, offset) < 0) {
+        if (fsimage_cache_write(fsimage, &fsimage->error_info.map[sectors], 1, offset) < 0) {
             log_error(fsimage_dxx_log,
                     "Error writing T:%u S:%u error info to disk image.",
                     dadr->track, dadr->sector);
@@ -477,7 +702,7 @@ int fsimage_dxx_write_sector(disk_image_t *image, const uint8_t *buf, const disk
     }
 
     /* Make sure the stream is visible to other readers.  */
-    fflush(fsimage->fd);
+    fsimage_cache_sync(fsimage);
     return 0;
 }
 
@@ -32,10 +32,14 @@
 struct disk_image_s;
 struct disk_track_s;
 struct disk_addr_s;
+struct fsimage_s;
 
 void fsimage_dxx_init(void);
 
 int fsimage_read_dxx_image(const disk_image_t *image);
+void fsimage_dxx_gcr_track(const disk_image_t *image, unsigned int index);
+void fsimage_dxx_release_gcr(const disk_image_t *image);
+void fsimage_dxx_close(struct fsimage_s *fsimage);
 
 int fsimage_dxx_write_half_track(disk_image_t *image, unsigned int half_track,
                                  const struct disk_track_s *raw);
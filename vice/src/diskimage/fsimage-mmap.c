@@ -0,0 +1,259 @@
+/*
+ * fsimage-mmap.c - Memory mapped access to file system based disk images.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* With "DiskImageMemoryMap" enabled the image file is mapped into memory
+   once it has been probed, and the fsimage backends read sectors and tracks
+   with a memcpy() from the mapping instead of fseek() and fread().
+
+   Writable images get a shared mapping, so writes go straight to the page
+   cache and are seen by other processes that have the image mapped or
+   open. Read only images get a private read only mapping. A write that
+   extends the file (G64 tracks added, P64 written back) goes through the
+   stream, after which the file is mapped again.
+
+   Images that could not be mapped, like compressed images uncompressed to
+   memory, keep using the stream. CMD HD images are only mapped read only,
+   the SCSI emulation writes to them through the stream. */
+
+#include "vice.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define FSIMAGE_HAVE_MMAP
+#endif
+
+#include "archdep.h"
+#include "cmdline.h"
+#include "diskimage.h"
+#include "fsimage-mmap.h"
+#include "fsimage.h"
+#include "lib.h"
+#include "log.h"
+#include "resources.h"
+#include "types.h"
+#include "util.h"
+
+/* #define DEBUG_FSIMAGE_MMAP */
+
+#ifdef DEBUG_FSIMAGE_MMAP
+#define DBG(x)  log_printf x
+#else
+#define DBG(x)
+#endif
+
+static log_t fsimage_mmap_log = LOG_DEFAULT;
+
+static int mmap_enabled = 0;
+
+/*-----------------------------------------------------------------------*/
+
+#ifdef FSIMAGE_HAVE_MMAP
+
+static int map_file(fsimage_t *fsimage, int shared)
+{
+    off_t size;
+    void *map;
+    int fd;
+
+    fd = fileno(fsimage->fd);
+    if (fd < 0) {
+        return -1;
+    }
+
+    size = archdep_file_size(fsimage->fd);
+    if (size <= 0) {
+        return -1;
+    }
+
+    if (shared) {
+        map = mmap(NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    } else {
+        map = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (map == MAP_FAILED) {
+        DBG(("fsimage_mmap: cannot map `%s'", fsimage->name));
+        return -1;
+    }
+
+    fsimage->map = map;
+    fsimage->map_size = (size_t)size;
+    fsimage->map_shared = shared;
+    return 0;
+}
+
+static void unmap_file(fsimage_t *fsimage)
+{
+    munmap(fsimage->map, fsimage->map_size);
+    fsimage->map = NULL;
+    fsimage->map_size = 0;
+}
+
+#endif
+
+/** \brief  Map a freshly opened image into memory
+ *
+ * Does nothing if "DiskImageMemoryMap" is disabled or the image cannot be
+ * mapped, the backends use the stream then.
+ *
+ * \param[in,out]   image   disk image
+ */
+void fsimage_mmap_open(disk_image_t *image)
+{
+#ifdef FSIMAGE_HAVE_MMAP
+    fsimage_t *fsimage = image->media.fsimage;
+
+    if (!mmap_enabled || fsimage->map != NULL) {
+        return;
+    }
+    if (image->type == DISK_IMAGE_TYPE_DHD && !image->read_only) {
+        return;
+    }
+
+    /* make sure nothing is left in the stream buffer */
+    fflush(fsimage->fd);
+
+    if (map_file(fsimage, !image->read_only) == 0) {
+        DBG(("fsimage_mmap: mapped %lu bytes of `%s' %s",
+             (unsigned long)fsimage->map_size, fsimage->name,
+             fsimage->map_shared ? "shared" : "private"));
+    }
+#endif
+}
+
+/** \brief  Unmap the image
+ *
+ * \param[in,out]   fsimage file system image
+ */
+void fsimage_mmap_close(fsimage_t *fsimage)
+{
+#ifdef FSIMAGE_HAVE_MMAP
+    if (fsimage->map != NULL) {
+        unmap_file(fsimage);
+    }
+#endif
+}
+
+/** \brief  Read from the image, like util_fpread()
+ *
+ * \param[in]   fsimage file system image
+ * \param[out]  buf     where to store the data
+ * \param[in]   num     number of bytes
+ * \param[in]   offset  offset in the image file
+ *
+ * \return  0 on success, -1 on error
+ */
+int fsimage_mmap_read(fsimage_t *fsimage, void *buf, size_t num, long offset)
+{
+    if (fsimage->map != NULL) {
+        if (offset < 0 || (size_t)offset > fsimage->map_size
+            || num > fsimage->map_size - (size_t)offset) {
+            return -1;
+        }
+        memcpy(buf, fsimage->map + offset, num);
+        return 0;
+    }
+    return util_fpread(fsimage->fd, buf, num, offset);
+}
+
+/** \brief  Write to the image, like util_fpwrite()
+ *
+ * \param[in,out]   fsimage file system image
+ * \param[in]       buf     data to write
+ * \param[in]       num     number of bytes
+ * \param[in]       offset  offset in the image file
+ *
+ * \return  0 on success, -1 on error
+ */
+int fsimage_mmap_write(fsimage_t *fsimage, const void *buf, size_t num, long offset)
+{
+#ifdef FSIMAGE_HAVE_MMAP
+    int shared;
+    int res;
+
+    if (fsimage->map != NULL) {
+        if (!fsimage->map_shared || offset < 0) {
+            return -1;
+        }
+        if ((size_t)offset <= fsimage->map_size
+            && num <= fsimage->map_size - (size_t)offset) {
+            memcpy(fsimage->map + offset, buf, num);
+            return 0;
+        }
+
+        /* the file grows, write through the stream and map it again */
+        shared = fsimage->map_shared;
+        unmap_file(fsimage);
+        res = util_fpwrite(fsimage->fd, buf, num, offset);
+        fflush(fsimage->fd);
+        if (map_file(fsimage, shared) < 0) {
+            log_error(fsimage_mmap_log, "Cannot map `%s' again, using the stream.",
+                      fsimage->name);
+        }
+        return res;
+    }
+#endif
+    return util_fpwrite(fsimage->fd, buf, num, offset);
+}
+
+/*-----------------------------------------------------------------------*/
+
+static int set_mmap_enabled(int val, void *param)
+{
+    mmap_enabled = val ? 1 : 0;
+    return 0;
+}
+
+static const resource_int_t resources_int[] = {
+    { "DiskImageMemoryMap", 0, RES_EVENT_NO, NULL,
+      &mmap_enabled, set_mmap_enabled, NULL },
+    RESOURCE_INT_LIST_END
+};
+
+int fsimage_mmap_resources_init(void)
+{
+    return resources_register_int(resources_int);
+}
+
+static const cmdline_option_t cmdline_options[] =
+{
+    { "-diskmmap", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "DiskImageMemoryMap", (resource_value_t)1,
+      NULL, "Map disk images into memory" },
+    { "+diskmmap", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "DiskImageMemoryMap", (resource_value_t)0,
+      NULL, "Access disk images through file I/O" },
+    CMDLINE_LIST_END
+};
+
+int fsimage_mmap_cmdline_options_init(void)
+{
+    return cmdline_register_options(cmdline_options);
+}
+
+void fsimage_mmap_init(void)
+{
+    fsimage_mmap_log = log_open("Disk Image Mmap");
+}
@@ -0,0 +1,44 @@
+/*
+ * fsimage-mmap.h - Memory mapped access to file system based disk images.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_FSIMAGE_MMAP_H
+#define VICE_FSIMAGE_MMAP_H
+
+#include <stdio.h>
+
+#include "types.h"
+
+struct disk_image_s;
+struct fsimage_s;
+
+void fsimage_mmap_init(void);
+int fsimage_mmap_resources_init(void);
+int fsimage_mmap_cmdline_options_init(void);
+
+void fsimage_mmap_open(struct disk_image_s *image);
+void fsimage_mmap_close(struct fsimage_s *fsimage);
+
+int fsimage_mmap_read(struct fsimage_s *fsimage, void *buf, size_t num, long offset);
+int fsimage_mmap_write(struct fsimage_s *fsimage, const void *buf, size_t num, long offset);
+
+#endif
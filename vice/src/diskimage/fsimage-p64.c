@@ -32,6 +32,7 @@
 #include "archdep.h"
 #include "diskconstants.h"
 #include "diskimage.h"
+#include "fsimage-mmap.h"
 #include "fsimage-p64.h"
 #include "fsimage.h"
 #include "cbmdos.h"
@@ -65,7 +66,7 @@ int fsimage_read_p64_image(const disk_image_t *image)
         return -1;
     }
     buffer = lib_malloc((size_t)lSize);
-    if (util_fpread(fsimage->fd, buffer, (size_t)lSize, 0) < 0) {
+    if (fsimage_mmap_read(fsimage, buffer, (size_t)lSize, 0) < 0) {
         lib_free(buffer);
         log_error(fsimage_p64_log, "Could not read P64 disk image.");
         return -1;
@@ -77,6 +78,7 @@ int fsimage_read_p64_image(const disk_image_t *image)
     P64MemoryStreamWrite(&P64MemoryStreamInstance, buffer, (p64_uint32_t)lSize);
     P64MemoryStreamSeek(&P64MemoryStreamInstance, 0);
     if (P64ImageReadFromStream(P64Image, &P64MemoryStreamInstance)) {
+        fsimage->p64_dirty = 0;
         rc = 0;
     } else {
         rc = -1;
@@ -102,11 +104,12 @@ int fsimage_write_p64_image(const disk_image_t *image)
     P64MemoryStreamCreate(&P64MemoryStreamInstance);
     P64MemoryStreamClear(&P64MemoryStreamInstance);
     if (P64ImageWriteToStream(P64Image, &P64MemoryStreamInstance)) {
-        if (util_fpwrite(fsimage->fd, P64MemoryStreamInstance.Data, P64MemoryStreamInstance.Size, 0) < 0) {
+        if (fsimage_mmap_write(fsimage, P64MemoryStreamInstance.Data, P64MemoryStreamInstance.Size, 0) < 0) {
             rc = -1;
             log_error(fsimage_p64_log, "Could not write P64 disk image.");
         } else {
             fflush(fsimage->fd);
+            fsimage->p64_dirty = 0;
             rc = 0;
         }
     } else {
@@ -184,6 +187,7 @@ int fsimage_p64_write_half_track(disk_image_t *image, unsigned int half_track,
     }
 
     P64PulseStreamConvertFromGCR(&P64Image->PulseStreams[0][half_track], (void*)raw->data, raw->size << 3);
+    image->media.fsimage->p64_dirty = 1;
 
     return 0;
     /* image flush will happen on close; added by Roberto Muscedere on 20210125 */
@@ -210,6 +214,7 @@ static int fsimage_p64_write_track(disk_image_t *image, unsigned int track,
     }
 
     P64PulseStreamConvertFromGCR(&P64Image->PulseStreams[0][track << 1], (void*)gcr_track_start_ptr, gcr_track_size << 3);
+    image->media.fsimage->p64_dirty = 1;
 
     return 0;
     /* image flush will happen on close; added by Roberto Muscedere on 20210125 */
@@ -32,8 +32,10 @@
 #include "archdep.h"
 #include "diskconstants.h"
 #include "diskimage.h"
+#include "fsimage-cache.h"
 #include "fsimage-dxx.h"
 #include "fsimage-gcr.h"
+#include "fsimage-mmap.h"
 #include "fsimage-p64.h"
 #include "fsimage-probe.h"
 #include "fsimage.h"
@@ -207,12 +209,18 @@ int fsimage_open(disk_image_t *image)
         }
     }
 
+    if (fsimage->fd != NULL && !image->read_only) {
+        fsimage_cache_replay_journal(fsimage);
+    }
+
     if (fsimage->fd == NULL) {
         log_error(fsimage_log, "Cannot open file `%s'.", fsimage->name);
         return -1;
     }
 
     if (fsimage_probe(image) == 0) {
+        fsimage_mmap_open(image);
+        fsimage_cache_open(image);
         return 0;
     }
 
@@ -233,11 +241,16 @@ int fsimage_close(disk_image_t *image)
         return -1;
     }
 
+    fsimage_cache_close(fsimage);
+
     /* flush the image when closed; added by Roberto Muscedere on 20210125 */
-    if (image->type == DISK_IMAGE_TYPE_P64) {
+    if (image->type == DISK_IMAGE_TYPE_P64 && fsimage->p64_dirty) {
         fsimage_write_p64_image(image);
     }
 
+    fsimage_mmap_close(fsimage);
+    fsimage_dxx_close(fsimage);
+
     if (fsimage->error_info.map) {
         lib_free(fsimage->error_info.map);
         fsimage->error_info.map = NULL;
@@ -344,6 +357,8 @@ int fsimage_write_sector(disk_image_t *image, const uint8_t *buf,
 void fsimage_init(void)
 {
     fsimage_log = log_open("Filesystem Image");
+    fsimage_cache_init();
+    fsimage_mmap_init();
     fsimage_dxx_init();
     fsimage_gcr_init();
     fsimage_p64_init();
@@ -357,5 +372,5 @@ off_t fsimage_size(const disk_image_t *image)
     fsimage_t *fsimage;
 
     fsimage = image->media.fsimage;
-    return archdep_file_size(fsimage->fd);
+    return fsimage_cache_size(fsimage);
 }
@@ -33,6 +33,8 @@
 
 struct disk_image_s;
 struct disk_addr_s;
+struct fsimage_cache_s;
+struct fsimage_dxx_track_s;
 
 typedef struct fsimage_s {
     FILE *fd;
@@ -42,6 +44,15 @@ typedef struct fsimage_s {
         int dirty;
         int len;
     } error_info;
+    struct fsimage_cache_s *cache;
+    uint8_t *map;
+    size_t map_size;
+    int map_shared;
+    /* layout of the GCR tracks made from sector based images */
+    struct fsimage_dxx_track_s *dxx_tracks;
+    unsigned int dxx_num_tracks;
+    /* P64 pulse streams changed since the image was read or written */
+    int p64_dirty;
 } fsimage_t;
 
 
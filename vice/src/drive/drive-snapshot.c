@@ -177,6 +177,7 @@ int drive_snapshot_write_module(snapshot_t *s, int save_disks, int save_roms)
     }
 
     drive_gcr_data_writeback_all();
+    disk_image_flush_all();
     rotation_table_get(rotation_table_ptr); /* FIXME: should this not be per drive rather than unit? */
 
     for (unr = 0; unr < NUM_DISK_UNITS; unr++) {
@@ -883,6 +884,10 @@ static int drive_snapshot_write_gcrimage_module(snapshot_t *s, unsigned int dnr)
         return -1;
     }
 
+    if (drive->image != NULL) {
+        disk_image_gcr_all_tracks(drive->image);
+    }
+
     /* Write half track data */
     for (i = 0; i < num_half_tracks; i++) {
         data = drive->gcr->tracks[i].data;
@@ -964,6 +969,7 @@ static int drive_snapshot_read_gcrimage_module(snapshot_t *s, unsigned int dnr)
         }
         data = drive->gcr->tracks[i].data;
         drive->gcr->tracks[i].size = track_size;
+        drive->gcr->pending[i] = 0;
 
         if (track_size && SMR_BA(m, data, track_size) < 0) {
             snapshot_module_close(m);
@@ -971,6 +977,7 @@ static int drive_snapshot_read_gcrimage_module(snapshot_t *s, unsigned int dnr)
         }
     }
     for (; i < MAX_GCR_TRACKS; i++) {
+        drive->gcr->pending[i] = 0;
         if (drive->gcr->tracks[i].data) {
             lib_free(drive->gcr->tracks[i].data);
             drive->gcr->tracks[i].data = NULL;
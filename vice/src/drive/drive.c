@@ -58,6 +58,7 @@
 #include "drivesync.h"
 #include "driverom.h"
 #include "drivetypes.h"
+#include "frametiming.h"
 #include "gcr.h"
 #include "iecbus.h"
 #include "iecdrive.h"
@@ -732,6 +733,11 @@ void drive_set_half_track(int num, int side, drive_t *dptr)
     /* FIXME: why would the offset be different for D71 and G71? */
     tmp = (dptr->image && dptr->image->type == DISK_IMAGE_TYPE_G71) ? DRIVE_HALFTRACKS_1571 : 70;
 
+    /* sector based images get their GCR data when the head reaches a track */
+    if (dptr->image != NULL) {
+        disk_image_gcr_track(dptr->image, dptr->current_half_track - 2 + (dptr->side * tmp));
+    }
+
     dptr->GCR_track_start_ptr = dptr->gcr->tracks[dptr->current_half_track - 2 + (dptr->side * tmp)].data;
 
     if (dptr->GCR_current_track_size != 0) {
@@ -1005,6 +1011,8 @@ int drive_num_leds(unsigned int dnr)
 /* run drive cpu for given main clock value */
 void drive_cpu_execute_one(diskunit_context_t *drv, CLOCK clk_value)
 {
+    frametiming_begin(FRAMETIMING_DRIVECPU);
+
     if (drv->type == DRIVE_TYPE_2000 ||
         drv->type == DRIVE_TYPE_4000 ||
         drv->type == DRIVE_TYPE_CMDHD) {
@@ -1012,6 +1020,8 @@ void drive_cpu_execute_one(diskunit_context_t *drv, CLOCK clk_value)
     } else {
         drivecpu_execute(drv, clk_value);
     }
+
+    frametiming_end();
 }
 
 /* execute the CPU of all (enabled) drives */
@@ -1104,6 +1114,7 @@ void drive_vsync_hook(void)
     unsigned int dnr;
 
     drive_update_ui_status();
+    disk_image_flush_check();
 
     for (dnr = 0; dnr < NUM_DISK_UNITS; dnr++) {
         diskunit_context_t *unit = diskunit_context[dnr];
@@ -207,6 +207,7 @@ int drive_image_attach(disk_image_t *image, unsigned int unit, unsigned int drv)
 
     drive->image = image;
     drive->image->gcr = drive->gcr;
+    memset(drive->gcr->pending, 0, sizeof(drive->gcr->pending));
     drive->image->p64 = (void*)drive->p64;
 
     if (disk_image_read_image(drive->image) < 0) {
@@ -266,9 +267,13 @@ int drive_image_detach(disk_image_t *image, unsigned int unit, unsigned int drv)
         }
     } else {
         drive_gcr_data_writeback(drive);
+        if (drive->image != NULL) {
+            disk_image_gcr_release(drive->image);
+        }
     }
 
     for (i = 0; i < MAX_GCR_TRACKS; i++) {
+        drive->gcr->pending[i] = 0;
         if (drive->gcr->tracks[i].data) {
             lib_free(drive->gcr->tracks[i].data);
             drive->gcr->tracks[i].data = NULL;
@@ -59,6 +59,7 @@
 #include "util.h"
 #include "version.h"
 #include "vice-event.h"
+#include "vsync.h"
 
 #ifdef EVENT_DEBUG
 #define DBG(x) log_printf  x
@@ -77,6 +78,13 @@
  */
 #define CRC32_SIZE  (sizeof(uint32_t))
 
+/** \brief  Size of the keyframe header
+ *
+ * A keyframe event holds the timestamp (seconds since the start of the
+ * recording, little endian) followed by a complete snapshot file.
+ */
+#define KEYFRAME_HEADER_SIZE    4
+
 
 struct event_image_list_s {
     char *orig_filename;
@@ -108,6 +116,14 @@ static char *event_end_snapshot = NULL;
 static char *event_snapshot_path_str = NULL;
 static int event_start_mode;
 static int event_image_include;
+static int event_keyframe_interval;
+
+/* seeking during playback: fast forward in warp mode until the timestamp
+   counter reaches seek_target */
+static int seek_active = 0;
+static int seek_warp_mode;
+static unsigned int seek_target;
+static int seek_pending = -1;
 
 static char *event_snapshot_path(const char *snapshot_file)
 {
@@ -350,6 +366,7 @@ void event_record_in_list(event_list_state_t *list, unsigned int type,
         case EVENT_ATTACHIMAGE:         /* fall through */
         case EVENT_INITIAL:             /* fall through */
         case EVENT_SYNC_TEST:           /* fall through */
+        case EVENT_KEYFRAME:            /* fall through */
         case EVENT_RESOURCE:
             event_data = lib_malloc(size);
             memcpy(event_data, data, size);
@@ -397,6 +414,189 @@ static void next_current_list(void)
     event_list->current = event_list->current->next;
 }
 
+/*-----------------------------------------------------------------------*/
+
+static unsigned int keyframe_timestamp(event_list_t *keyframe)
+{
+    uint8_t *data = keyframe->data;
+
+    return (unsigned int)data[0] | ((unsigned int)data[1] << 8)
+           | ((unsigned int)data[2] << 16) | ((unsigned int)data[3] << 24);
+}
+
+/* Snapshots can only be written to files, so go through a temporary one
+   and embed its contents in the event list. */
+static void event_record_keyframe_trap(uint16_t addr, void *data)
+{
+    char *filename = NULL;
+    FILE *fd;
+    off_t file_len;
+    uint8_t *keyframe;
+
+    if (record_active == 0) {
+        return;
+    }
+
+    fd = archdep_mkstemp_fd(&filename, MODE_WRITE);
+    if (fd == NULL) {
+        log_error(event_log, "Cannot create keyframe file.");
+        return;
+    }
+    fclose(fd);
+
+    if (machine_write_snapshot(filename, 0, 1, 0) < 0) {
+        log_error(event_log, "Cannot write keyframe snapshot %s.", filename);
+        goto error;
+    }
+
+    fd = fopen(filename, MODE_READ);
+    if (fd == NULL) {
+        log_error(event_log, "Cannot open keyframe snapshot %s.", filename);
+        goto error;
+    }
+
+    file_len = archdep_file_size(fd);
+    if (file_len > 0) {
+        keyframe = lib_malloc(KEYFRAME_HEADER_SIZE + (size_t)file_len);
+        keyframe[0] = (uint8_t)(current_timestamp & 0xff);
+        keyframe[1] = (uint8_t)((current_timestamp >> 8) & 0xff);
+        keyframe[2] = (uint8_t)((current_timestamp >> 16) & 0xff);
+        keyframe[3] = (uint8_t)((current_timestamp >> 24) & 0xff);
+        if (fread(keyframe + KEYFRAME_HEADER_SIZE, (size_t)file_len, 1, fd) == 1) {
+            event_record(EVENT_KEYFRAME, keyframe,
+                         KEYFRAME_HEADER_SIZE + (unsigned int)file_len);
+            DBG(("event: keyframe at %u, %u bytes", current_timestamp, (unsigned int)file_len));
+        } else {
+            log_error(event_log, "Cannot read keyframe snapshot %s.", filename);
+        }
+        lib_free(keyframe);
+    }
+    fclose(fd);
+
+error:
+    archdep_remove(filename);
+    lib_free(filename);
+}
+
+static int event_playback_restore_keyframe(event_list_t *keyframe)
+{
+    char *filename = NULL;
+    FILE *fd;
+    int result = -1;
+
+    fd = archdep_mkstemp_fd(&filename, MODE_WRITE);
+    if (fd == NULL) {
+        log_error(event_log, "Cannot create keyframe file.");
+        return -1;
+    }
+
+    if (fwrite((uint8_t *)keyframe->data + KEYFRAME_HEADER_SIZE,
+               keyframe->size - KEYFRAME_HEADER_SIZE, 1, fd) != 1) {
+        log_error(event_log, "Cannot write keyframe file %s.", filename);
+        fclose(fd);
+        goto error;
+    }
+    fclose(fd);
+
+    alarm_unset(event_alarm);
+
+    if (machine_read_snapshot(filename, 0) < 0) {
+        log_error(event_log, "Cannot read keyframe snapshot %s.", filename);
+        goto error;
+    }
+
+    event_list->current = keyframe->next;
+    current_timestamp = keyframe_timestamp(keyframe);
+    next_alarm_set();
+    result = 0;
+
+error:
+    archdep_remove(filename);
+    lib_free(filename);
+    return result;
+}
+
+static void event_playback_seek_done(void)
+{
+    if (seek_active) {
+        seek_active = 0;
+        vsync_set_warp_mode(seek_warp_mode);
+        log_message(event_log, "Seek done at %u seconds.", current_timestamp - 1);
+    }
+}
+
+static void event_playback_start_trap(uint16_t addr, void *unused);
+
+/* Restore the last keyframe before the target, unless playing on from the
+   current position is closer, then fast forward to the target. */
+static void event_playback_seek_trap(uint16_t addr, void *data)
+{
+    event_list_t *curr;
+    event_list_t *keyframe = NULL;
+
+    if (playback_active == 0) {
+        return;
+    }
+
+    for (curr = event_list->base;
+         curr != NULL && curr->type != EVENT_LIST_END;
+         curr = curr->next) {
+        if (curr->type == EVENT_KEYFRAME) {
+            if (keyframe_timestamp(curr) > seek_target) {
+                break;
+            }
+            keyframe = curr;
+        }
+    }
+
+    if (seek_target >= current_timestamp
+        && (keyframe == NULL || keyframe_timestamp(keyframe) <= current_timestamp)) {
+        /* nothing to restore, just play on */
+    } else if (keyframe != NULL) {
+        if (event_playback_restore_keyframe(keyframe) < 0) {
+            event_playback_stop();
+            return;
+        }
+    } else {
+        /* target is before the first keyframe, start over */
+        alarm_unset(event_alarm);
+        event_playback_start_trap(addr, NULL);
+        if (playback_active == 0) {
+            return;
+        }
+    }
+
+    if (current_timestamp >= seek_target) {
+        event_playback_seek_done();
+        return;
+    }
+
+    if (!seek_active) {
+        seek_active = 1;
+        seek_warp_mode = vsync_get_warp_mode();
+        vsync_set_warp_mode(1);
+    }
+}
+
+/** \brief  Seek to a position of the running playback
+ *
+ * \param[in]   seconds     position in seconds since the start of the history
+ *
+ * \return  0 on success, -1 if no playback is active
+ */
+int event_playback_seek(unsigned int seconds)
+{
+    if (playback_active == 0) {
+        return -1;
+    }
+
+    /* the timestamp counter is one ahead of the displayed time */
+    seek_target = seconds + 1;
+    interrupt_maincpu_trigger_trap(event_playback_seek_trap, (void *)0);
+
+    return 0;
+}
+
 static void event_alarm_handler(CLOCK offset, void *data)
 {
     alarm_unset(event_alarm);
@@ -406,6 +606,10 @@ static void event_alarm_handler(CLOCK offset, void *data)
         ui_display_event_time(current_timestamp++, 0);
         next_timestamp_clk = next_timestamp_clk + (CLOCK)machine_get_cycles_per_second();
         alarm_set(event_alarm, next_timestamp_clk);
+        if (event_keyframe_interval > 0
+            && (current_timestamp % (unsigned int)event_keyframe_interval) == 0) {
+            interrupt_maincpu_trigger_trap(event_record_keyframe_trap, (void *)0);
+        }
         return;
     }
 
@@ -452,6 +656,12 @@ static void event_alarm_handler(CLOCK offset, void *data)
             break;
         case EVENT_TIMESTAMP:
             ui_display_event_time(current_timestamp++, playback_time);
+            if (seek_active && current_timestamp >= seek_target) {
+                event_playback_seek_done();
+            }
+            break;
+        case EVENT_KEYFRAME:
+            /* only used for seeking */
             break;
         case EVENT_LIST_END:
             event_playback_stop();
@@ -480,6 +690,7 @@ void event_playback_event_list(event_list_state_t *list)
             current, current->type, current->size, current->data));
         switch (current->type) {
             case EVENT_SYNC_TEST:
+            case EVENT_KEYFRAME:
                 break;
             case EVENT_KEYBOARD_DELAY:
                 keyboard_register_delay(*(unsigned int*)current->data);
@@ -915,6 +1126,12 @@ static void event_playback_start_trap(uint16_t addr, void *unused)
 #ifdef  DEBUG
     debug_start_playback();
 #endif
+
+    if (seek_pending >= 0) {
+        seek_target = (unsigned int)seek_pending + 1;
+        seek_pending = -1;
+        event_playback_seek_trap(addr, NULL);
+    }
 }
 
 
@@ -939,6 +1156,8 @@ int event_playback_stop(void)
 
     alarm_unset(event_alarm);
 
+    event_playback_seek_done();
+
     ui_display_playback(0, NULL);
 
 #ifdef  DEBUG
@@ -1114,8 +1333,12 @@ int event_snapshot_read_module(struct snapshot_s *s, int event_mode)
                 next_timestamp_clk = clk;
             }
         } else {
-            /* insert timestamps each second */
-            while (next_timestamp_clk < clk)
+            /* insert timestamps each second. A keyframe is taken after the
+               timestamp counter was advanced, so a timestamp at the clock of
+               the keyframe goes before it, or seeking to the keyframe would
+               count that second twice. */
+            while (next_timestamp_clk < clk
+                   || (type == EVENT_KEYFRAME && next_timestamp_clk == clk))
             {
                 curr->type = EVENT_TIMESTAMP;
                 curr->clk = next_timestamp_clk;
@@ -1249,6 +1472,17 @@ static int set_event_image_include(int enable, void *param)
     return 0;
 }
 
+static int set_event_keyframe_interval(int val, void *param)
+{
+    if (val < 0) {
+        return -1;
+    }
+
+    event_keyframe_interval = val;
+
+    return 0;
+}
+
 static const resource_string_t resources_string[] = {
     { "EventSnapshotDir",
       ARCHDEP_FSDEVICE_DEFAULT_DIR ARCHDEP_DIR_SEP_STR, RES_EVENT_NO, NULL,
@@ -1265,6 +1499,8 @@ static const resource_int_t resources_int[] = {
       &event_start_mode, set_event_start_mode, NULL },
     { "EventImageInclude", 1, RES_EVENT_NO, NULL,
       &event_image_include, set_event_image_include, NULL },
+    { "EventKeyframeInterval", 0, RES_EVENT_NO, NULL,
+      &event_keyframe_interval, set_event_keyframe_interval, NULL },
     RESOURCE_INT_LIST_END
 };
 
@@ -1294,11 +1530,28 @@ static int cmdline_help(const char *param, void *extra_param)
     return event_playback_start();
 }
 
+static int cmdline_seek(const char *param, void *extra_param)
+{
+    char *endptr;
+    long seconds;
+
+    seconds = strtol(param, &endptr, 10);
+    if (*endptr != '\0' || seconds < 0) {
+        return -1;
+    }
+    seek_pending = (int)seconds;
+
+    return event_playback_start();
+}
+
 static const cmdline_option_t cmdline_options[] =
 {
     { "-playback", CALL_FUNCTION, CMDLINE_ATTRIB_NONE,
       cmdline_help, NULL, NULL, NULL,
       NULL, "Playback recorded events" },
+    { "-playbackseek", CALL_FUNCTION, CMDLINE_ATTRIB_NEED_ARGS,
+      cmdline_seek, NULL, NULL, NULL,
+      "<seconds>", "Playback recorded events, fast forwarding to the given position" },
     { "-eventsnapshotdir", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "EventSnapshotDir", NULL,
       "<Name>", "Set event snapshot directory" },
@@ -1317,6 +1570,9 @@ static const cmdline_option_t cmdline_options[] =
     { "+eventimageinc", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
       NULL, NULL, "EventImageInclude", (resource_value_t)0,
       NULL, "Disable including disk images" },
+    { "-eventkeyframes", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "EventKeyframeInterval", NULL,
+      "<seconds>", "Embed a keyframe snapshot every <seconds> seconds while recording (0: off)" },
     CMDLINE_LIST_END
 };
 
@@ -0,0 +1,309 @@
+/*
+ * frametiming.c - Per-frame timing of the emulator subsystems.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* The subsystems call frametiming_begin()/frametiming_end() around their
+   work. The wall clock time between two such calls is added to the counter
+   on top of a small stack, so nested sections (the renderer running from
+   within the video chip, the sound synthesis from within the sync wait) are
+   only counted once. Everything else is main CPU time. At the end of each
+   frame vsync_do_vsync() calls frametiming_frame_done(), which stores the
+   counters in a ring buffer for the binary monitor and optionally appends
+   them to a CSV file. */
+
+#include "vice.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "archdep.h"
+#include "cmdline.h"
+#include "frametiming.h"
+#include "lib.h"
+#include "log.h"
+#include "mainlock.h"
+#include "resources.h"
+#include "util.h"
+
+#define FRAMETIMING_STACK_SIZE  16
+
+bool frametiming_enabled = false;
+
+static int frametiming_resource = 0;
+static char *frametiming_file = NULL;
+static FILE *frametiming_fd = NULL;
+
+static int stack[FRAMETIMING_STACK_SIZE];
+static int stack_depth = 0;
+static int current_counter = FRAMETIMING_MAINCPU;
+static tick_t segment_start;
+static tick_t frame_start;
+static uint32_t counters[FRAMETIMING_NUM];
+
+static frametiming_frame_t ring[FRAMETIMING_RING_SIZE];
+static unsigned int ring_next = 0;
+static unsigned int ring_used = 0;
+static uint32_t frame_number = 0;
+
+static const char * const counter_names[FRAMETIMING_NUM] = {
+    "maincpu",
+    "drivecpu",
+    "videochip",
+    "sound",
+    "render",
+    "syncwait",
+    "uilockwait"
+};
+
+
+static void frametiming_reset(void)
+{
+    stack_depth = 0;
+    current_counter = FRAMETIMING_MAINCPU;
+    segment_start = tick_now();
+    frame_start = segment_start;
+    memset(counters, 0, sizeof(counters));
+    ring_next = 0;
+    ring_used = 0;
+    frame_number = 0;
+}
+
+static void frametiming_update_enabled(void)
+{
+    bool enable = frametiming_resource || frametiming_fd != NULL;
+
+    if (enable && !frametiming_enabled) {
+        frametiming_reset();
+    }
+    frametiming_enabled = enable;
+}
+
+/* add the time since the last switch to the running counter */
+static inline tick_t frametiming_account(void)
+{
+    tick_t now = tick_now();
+
+    counters[current_counter] += now - segment_start;
+    segment_start = now;
+
+    return now;
+}
+
+/** \brief  Start counting time for a subsystem
+ *
+ * Use frametiming_begin() instead, which skips the call when disabled.
+ *
+ * \param[in]   counter FRAMETIMING_* counter
+ */
+void frametiming_push(int counter)
+{
+    /* the UI thread may run emulation code at times, don't mix that in */
+    if (!mainlock_is_vice_thread()) {
+        return;
+    }
+
+    frametiming_account();
+
+    if (stack_depth < FRAMETIMING_STACK_SIZE) {
+        stack[stack_depth] = current_counter;
+    }
+    stack_depth++;
+    current_counter = counter;
+}
+
+/** \brief  Stop counting time for the subsystem of the last push
+ */
+void frametiming_pop(void)
+{
+    if (!mainlock_is_vice_thread()) {
+        return;
+    }
+
+    frametiming_account();
+
+    if (stack_depth > 0) {
+        stack_depth--;
+        if (stack_depth < FRAMETIMING_STACK_SIZE) {
+            current_counter = stack[stack_depth];
+        }
+    }
+}
+
+/** \brief  Store the counters of the frame that just ended
+ */
+void frametiming_frame_done(void)
+{
+    frametiming_frame_t *frame;
+    tick_t now;
+    int i;
+
+    if (!frametiming_enabled || !mainlock_is_vice_thread()) {
+        return;
+    }
+
+    now = frametiming_account();
+
+    frame = &ring[ring_next];
+    frame->frame = frame_number++;
+    frame->total = TICK_TO_MICRO(now - frame_start);
+    for (i = 0; i < FRAMETIMING_NUM; i++) {
+        frame->time[i] = TICK_TO_MICRO(counters[i]);
+        counters[i] = 0;
+    }
+    frame_start = now;
+
+    if (++ring_next == FRAMETIMING_RING_SIZE) {
+        ring_next = 0;
+    }
+    if (ring_used < FRAMETIMING_RING_SIZE) {
+        ring_used++;
+    }
+
+    if (frametiming_fd != NULL) {
+        fprintf(frametiming_fd, "%lu,%lu", (unsigned long)frame->frame,
+                (unsigned long)frame->total);
+        for (i = 0; i < FRAMETIMING_NUM; i++) {
+            fprintf(frametiming_fd, ",%lu", (unsigned long)frame->time[i]);
+        }
+        fputc('\n', frametiming_fd);
+    }
+}
+
+/** \brief  Get the most recent frames from the ring buffer
+ *
+ * \param[out]  frames  where to store the frames, oldest first
+ * \param[in]   max     maximum number of frames to get
+ *
+ * \return  number of frames stored
+ */
+unsigned int frametiming_get_frames(frametiming_frame_t *frames, unsigned int max)
+{
+    unsigned int count = ring_used < max ? ring_used : max;
+    unsigned int index;
+    unsigned int i;
+
+    index = (ring_next + FRAMETIMING_RING_SIZE - count) % FRAMETIMING_RING_SIZE;
+    for (i = 0; i < count; i++) {
+        frames[i] = ring[index];
+        if (++index == FRAMETIMING_RING_SIZE) {
+            index = 0;
+        }
+    }
+
+    return count;
+}
+
+const char *frametiming_get_counter_name(int counter)
+{
+    if (counter < 0 || counter >= FRAMETIMING_NUM) {
+        return NULL;
+    }
+    return counter_names[counter];
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void frametiming_close_file(void)
+{
+    if (frametiming_fd != NULL) {
+        fclose(frametiming_fd);
+        frametiming_fd = NULL;
+    }
+}
+
+static int set_frametiming_file(const char *val, void *param)
+{
+    int i;
+
+    util_string_set(&frametiming_file, val);
+    frametiming_close_file();
+
+    if (frametiming_file != NULL && *frametiming_file != '\0') {
+        frametiming_fd = fopen(frametiming_file, MODE_WRITE_TEXT);
+        if (frametiming_fd == NULL) {
+            log_error(LOG_DEFAULT, "Cannot open frame timing file '%s'.", frametiming_file);
+        } else {
+            fprintf(frametiming_fd, "frame,total");
+            for (i = 0; i < FRAMETIMING_NUM; i++) {
+                fprintf(frametiming_fd, ",%s", counter_names[i]);
+            }
+            fputc('\n', frametiming_fd);
+        }
+    }
+
+    frametiming_update_enabled();
+    return 0;
+}
+
+static int set_frametiming(int val, void *param)
+{
+    frametiming_resource = val ? 1 : 0;
+    frametiming_update_enabled();
+    return 0;
+}
+
+static const resource_string_t resources_string[] = {
+    { "FrameTimingFile", "", RES_EVENT_NO, NULL,
+      &frametiming_file, set_frametiming_file, NULL },
+    RESOURCE_STRING_LIST_END
+};
+
+static const resource_int_t resources_int[] = {
+    { "FrameTiming", 0, RES_EVENT_NO, NULL,
+      &frametiming_resource, set_frametiming, NULL },
+    RESOURCE_INT_LIST_END
+};
+
+int frametiming_resources_init(void)
+{
+    if (resources_register_string(resources_string) < 0) {
+        return -1;
+    }
+    return resources_register_int(resources_int);
+}
+
+static const cmdline_option_t cmdline_options[] =
+{
+    { "-frametiming", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "FrameTiming", (resource_value_t)1,
+      NULL, "Enable per-frame timing of the emulator subsystems" },
+    { "+frametiming", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "FrameTiming", (resource_value_t)0,
+      NULL, "Disable per-frame timing of the emulator subsystems" },
+    { "-frametimingfile", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "FrameTimingFile", NULL,
+      "<Name>", "Write the per-frame timing of the emulator subsystems to a CSV file" },
+    CMDLINE_LIST_END
+};
+
+int frametiming_cmdline_options_init(void)
+{
+    return cmdline_register_options(cmdline_options);
+}
+
+void frametiming_shutdown(void)
+{
+    frametiming_enabled = false;
+    frametiming_close_file();
+    lib_free(frametiming_file);
+    frametiming_file = NULL;
+}
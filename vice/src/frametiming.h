@@ -0,0 +1,82 @@
+/*
+ * frametiming.h - Per-frame timing of the emulator subsystems.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_FRAMETIMING_H
+#define VICE_FRAMETIMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The counters, in the order they appear in the CSV file and the binary
+   monitor response. Time not spent in any of the others is counted as
+   main CPU. */
+enum {
+    FRAMETIMING_MAINCPU = 0,
+    FRAMETIMING_DRIVECPU,
+    FRAMETIMING_VIDEOCHIP,
+    FRAMETIMING_SOUND,
+    FRAMETIMING_RENDER,
+    FRAMETIMING_SYNC_WAIT,
+    FRAMETIMING_UI_LOCK_WAIT,
+    FRAMETIMING_NUM
+};
+
+/* Number of frames kept for the binary monitor */
+#define FRAMETIMING_RING_SIZE   1024
+
+typedef struct frametiming_frame_s {
+    uint32_t frame;                     /* frame number since enabling */
+    uint32_t total;                     /* wall clock time of the frame in us */
+    uint32_t time[FRAMETIMING_NUM];     /* time per counter in us */
+} frametiming_frame_t;
+
+extern bool frametiming_enabled;
+
+void frametiming_push(int counter);
+void frametiming_pop(void);
+void frametiming_frame_done(void);
+
+unsigned int frametiming_get_frames(frametiming_frame_t *frames, unsigned int max);
+const char *frametiming_get_counter_name(int counter);
+
+int frametiming_resources_init(void);
+int frametiming_cmdline_options_init(void);
+void frametiming_shutdown(void);
+
+/* Attribute the time until the matching frametiming_end() to counter. These
+   nest, the time of an inner pair is not counted by the outer one. */
+static inline void frametiming_begin(int counter)
+{
+    if (frametiming_enabled) {
+        frametiming_push(counter);
+    }
+}
+
+static inline void frametiming_end(void)
+{
+    if (frametiming_enabled) {
+        frametiming_pop();
+    }
+}
+
+#endif
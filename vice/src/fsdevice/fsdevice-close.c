@@ -38,6 +38,7 @@
 
 #include "cbmdos.h"
 #include "fileio.h"
+#include "fsdevice-dir.h"
 #include "fsdevice-close.h"
 #include "fsdevice-read.h"
 #include "fsdevicetypes.h"
@@ -80,7 +81,7 @@ int fsdevice_close(vdrive_t *vdrive, unsigned int secondary)
                 return FLOPPY_ERROR;
             }
 
-            archdep_closedir(bufinfo->host_dir);
+            fsdevice_dir_close(bufinfo->host_dir);
             bufinfo->host_dir = NULL;
             break;
     }
@@ -0,0 +1,204 @@
+/*
+ * fsdevice-dir.c - File system device, cached host directory listings.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Listing a host directory means reading, stat()ing and sorting all of its
+   entries. The file system device used to do that for every "$", for every
+   file it opens (to expand short names) and for every long name in a
+   listing (to make the short name unique), which gets really slow on
+   directories with thousands of files.
+
+   The sorted listing of a directory is now kept until the modification time
+   of the directory changes. Every user gets its own view of the listing
+   (with its own position) that shares the name lists of the cache entry.
+
+   A listing made in the same second the directory was modified could miss
+   a change made later in that second, so it is only used again once the
+   directory is older than the listing. */
+
+#include "vice.h"
+
+#include <string.h>
+#include <time.h>
+
+#include "archdep.h"
+#include "fsdevice-dir.h"
+#include "lib.h"
+
+/* #define DEBUG_FSDEVICE_DIR */
+
+#ifdef DEBUG_FSDEVICE_DIR
+#define DBG(x) log_printf  x
+#include "log.h"
+#else
+#define DBG(x)
+#endif
+
+#define FSDEVICE_DIR_CACHE_SIZE 8
+
+typedef struct fsdevice_dir_entry_s {
+    char *path;
+    time_t mtime;       /* modification time of the directory */
+    time_t scanned;     /* time the listing was made */
+    archdep_dir_t *dir; /* NULL if the entry is free */
+    int refs;           /* number of views still open */
+    int stale;          /* directory changed, free when the last view is closed */
+    unsigned long used;
+} fsdevice_dir_entry_t;
+
+static fsdevice_dir_entry_t dir_cache[FSDEVICE_DIR_CACHE_SIZE];
+static unsigned long dir_cache_clock = 0;
+
+static void entry_free(fsdevice_dir_entry_t *entry)
+{
+    archdep_closedir(entry->dir);
+    lib_free(entry->path);
+    memset(entry, 0, sizeof *entry);
+}
+
+static fsdevice_dir_entry_t *entry_lookup(const char *path)
+{
+    unsigned int i;
+
+    for (i = 0; i < FSDEVICE_DIR_CACHE_SIZE; i++) {
+        fsdevice_dir_entry_t *entry = &dir_cache[i];
+
+        if (entry->dir != NULL && !entry->stale && strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static fsdevice_dir_entry_t *entry_alloc(void)
+{
+    fsdevice_dir_entry_t *victim = NULL;
+    unsigned int i;
+
+    for (i = 0; i < FSDEVICE_DIR_CACHE_SIZE; i++) {
+        fsdevice_dir_entry_t *entry = &dir_cache[i];
+
+        if (entry->dir == NULL) {
+            return entry;
+        }
+        if (entry->refs == 0 && (victim == NULL || entry->used < victim->used)) {
+            victim = entry;
+        }
+    }
+    if (victim != NULL) {
+        entry_free(victim);
+    }
+    return victim;
+}
+
+/** \brief  Open a host directory, using the cached listing if it is valid
+ *
+ * \param[in]   path    directory
+ *
+ * \return  directory object, close it with fsdevice_dir_close(), or `NULL`
+ *          if the directory cannot be opened
+ */
+archdep_dir_t *fsdevice_dir_open(const char *path)
+{
+    fsdevice_dir_entry_t *entry;
+    archdep_dir_t *dir;
+    time_t mtime;
+    time_t now;
+
+    if (archdep_stat_mtime(path, &mtime) < 0) {
+        return archdep_opendir(path, ARCHDEP_OPENDIR_ALL_FILES);
+    }
+
+    entry = entry_lookup(path);
+    if (entry != NULL && (entry->mtime != mtime || entry->scanned <= mtime)) {
+        DBG(("fsdevice_dir: `%s' changed", path));
+        if (entry->refs > 0) {
+            entry->stale = 1;
+        } else {
+            entry_free(entry);
+        }
+        entry = NULL;
+    }
+
+    if (entry == NULL) {
+        now = time(NULL);
+        dir = archdep_opendir(path, ARCHDEP_OPENDIR_ALL_FILES);
+        if (dir == NULL) {
+            return NULL;
+        }
+        entry = entry_alloc();
+        if (entry == NULL) {
+            /* all listings are in use, hand out one of our own */
+            return dir;
+        }
+        DBG(("fsdevice_dir: listed `%s', %d entries", path,
+             archdep_readdir_num_entries(dir)));
+        entry->path = lib_strdup(path);
+        entry->mtime = mtime;
+        entry->scanned = now;
+        entry->dir = dir;
+    }
+
+    entry->refs++;
+    entry->used = ++dir_cache_clock;
+
+    dir = lib_malloc(sizeof *dir);
+    *dir = *(entry->dir);
+    dir->pos = 0;
+    return dir;
+}
+
+/** \brief  Close a directory opened with fsdevice_dir_open()
+ *
+ * \param[in]   dir directory object
+ */
+void fsdevice_dir_close(archdep_dir_t *dir)
+{
+    unsigned int i;
+
+    for (i = 0; i < FSDEVICE_DIR_CACHE_SIZE; i++) {
+        fsdevice_dir_entry_t *entry = &dir_cache[i];
+
+        if (entry->dir != NULL && entry->dir->files == dir->files) {
+            lib_free(dir);
+            entry->refs--;
+            if (entry->refs == 0 && entry->stale) {
+                entry_free(entry);
+            }
+            return;
+        }
+    }
+    archdep_closedir(dir);
+}
+
+/** \brief  Free all cached listings
+ */
+void fsdevice_dir_shutdown(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < FSDEVICE_DIR_CACHE_SIZE; i++) {
+        if (dir_cache[i].dir != NULL) {
+            entry_free(&dir_cache[i]);
+        }
+    }
+}
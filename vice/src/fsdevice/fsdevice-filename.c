@@ -32,6 +32,7 @@
 
 #include "archdep.h"
 #include "charset.h"
+#include "fsdevice-dir.h"
 #include "fsdevicetypes.h"
 #include "lib.h"
 #include "log.h"
@@ -160,10 +161,10 @@ static int limit_longname(vdrive_t *vdrive, char *longname, int mode)
     prefix = fsdevice_get_path(vdrive->unit);
     DBG(("limit_longname path '%s'\n", prefix));
 
-    archdep_dir = archdep_opendir(prefix, ARCHDEP_OPENDIR_ALL_FILES);
+    archdep_dir = fsdevice_dir_open(prefix);
     if (archdep_dir != NULL) {
         ret = _limit_longname(archdep_dir, vdrive, longname, mode);
-        archdep_closedir(archdep_dir);
+        fsdevice_dir_close(archdep_dir);
     }
     return ret;
 }
@@ -196,7 +197,7 @@ static char *expand_shortname(vdrive_t *vdrive, char *shortname, int mode)
         prefix = fsdevice_get_path(vdrive->unit);
         DBG(("expand_shortname path '%s'\n", prefix));
 
-        host_dir = archdep_opendir(prefix, ARCHDEP_OPENDIR_ALL_FILES);
+        host_dir = fsdevice_dir_open(prefix);
         if (host_dir == NULL) {
             return NULL;
         }
@@ -218,11 +219,11 @@ static char *expand_shortname(vdrive_t *vdrive, char *shortname, int mode)
                 if (mode) {
                     charset_petconvstring((uint8_t *)longname, CONVERT_TO_PETSCII);   /* ASCII name to PETSCII */
                 }
-                archdep_closedir(host_dir);
+                fsdevice_dir_close(host_dir);
                 return longname;
             }
         }
-        archdep_closedir(host_dir);
+        fsdevice_dir_close(host_dir);
     }
     /* copy original string to the new name */
     strcpy(longname, shortname);
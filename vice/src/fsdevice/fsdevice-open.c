@@ -45,6 +45,7 @@
 #include "cbmdos.h"
 #include "charset.h"
 #include "fileio.h"
+#include "fsdevice-dir.h"
 #include "fsdevice-filename.h"
 #include "fsdevice-read.h"
 #include "fsdevice-resources.h"
@@ -145,14 +146,14 @@ static int fsdevice_open_directory(vdrive_t *vdrive, unsigned int secondary,
     }
 
     /* trying to open */
-    host_dir = archdep_opendir((char *)(cmd_parse->parsecmd), ARCHDEP_OPENDIR_ALL_FILES);
+    host_dir = fsdevice_dir_open((char *)(cmd_parse->parsecmd));
     if (host_dir == NULL) {
         for (p = (uint8_t *)(cmd_parse->parsecmd); *p; p++) {
             if (isupper((unsigned char)*p)) {
                 *p = tolower((unsigned char)*p);
             }
         }
-        host_dir = archdep_opendir((char *)(cmd_parse->parsecmd), ARCHDEP_OPENDIR_ALL_FILES);
+        host_dir = fsdevice_dir_open((char *)(cmd_parse->parsecmd));
         if (host_dir == NULL) {
             fsdevice_error(vdrive, CBMDOS_IPE_NOT_FOUND);
             return FLOPPY_ERROR;
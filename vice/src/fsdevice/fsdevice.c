@@ -46,6 +46,7 @@
 #include "cbmdos.h"
 #include "fileio.h"
 #include "fsdevice-close.h"
+#include "fsdevice-dir.h"
 #include "fsdevice-flush.h"
 #include "fsdevice-open.h"
 #include "fsdevice-read.h"
@@ -247,4 +248,6 @@ void fsdevice_shutdown(void)
         lib_free(fsdevice_dev[i].errorl);
         lib_free(fsdevice_dev[i].cmdbuf);
     }
+
+    fsdevice_dir_shutdown();
 }
@@ -65,48 +65,76 @@ static const uint8_t From_GCR_conv_data[32] =
 };
 
 
-static void gcr_convert_4bytes_to_GCR(const uint8_t *source, uint8_t *dest)
+/* Whole bytes are converted with these tables, built from the nybble tables
+   above on first use: a byte to its 10 GCR bits, 10 GCR bits back to a byte,
+   and the number of leading and trailing one bits of a byte for the sync
+   search. */
+static uint16_t GCR_encode_byte[256];
+static uint8_t GCR_decode_byte[1024];
+static uint8_t leading_ones[256];
+static uint8_t trailing_ones[256];
+static int gcr_tables_ready = 0;
+
+static void gcr_init_tables(void)
 {
-    int i;
-    register unsigned int tdest = 0;    /* at least 16 bits for overflow shifting */
-
-    for (i = 2; i < 10; i += 2, source++, dest++)
-    {
-        tdest <<= 5;  /* make room for the upper nybble */
-        tdest |= GCR_conv_data[(*source) >> 4];
+    unsigned int i, n;
 
-        tdest <<= 5;  /* make room for the lower nybble */
-        tdest |= GCR_conv_data[(*source) & 0x0f];
+    for (i = 0; i < 256; i++) {
+        GCR_encode_byte[i] = (uint16_t)((GCR_conv_data[i >> 4] << 5) | GCR_conv_data[i & 0x0f]);
 
-        *dest = (uint8_t)(tdest >> i);
+        for (n = 0; n < 8 && (i & (0x80 >> n)); n++) {
+        }
+        leading_ones[i] = (uint8_t)n;
+        for (n = 0; n < 8 && (i & (1 << n)); n++) {
+        }
+        trailing_ones[i] = (uint8_t)n;
     }
-
-    *dest = (uint8_t)tdest;
+    for (i = 0; i < 1024; i++) {
+        GCR_decode_byte[i] = (uint8_t)((From_GCR_conv_data[i >> 5] << 4) | From_GCR_conv_data[i & 0x1f]);
+    }
+    gcr_tables_ready = 1;
 }
 
-static void gcr_convert_GCR_to_4bytes(const uint8_t *source, uint8_t *dest)
+static inline void gcr_check_tables(void)
 {
-    int i;
-    /* at least 24 bits for shifting into bits 16...20 */
-    register uint32_t tdest = *source;
-
-    tdest <<= 13;
+    if (!gcr_tables_ready) {
+        gcr_init_tables();
+    }
+}
 
-    for (i = 5; i < 13; i += 2, dest++)
-    {
-        source++;
-        tdest |= ((uint32_t)(*source)) << i;
+/* 4 bytes become 40 GCR bits, stored as 5 bytes */
+static inline void gcr_convert_4bytes_to_GCR(const uint8_t *source, uint8_t *dest)
+{
+    uint64_t bits;
+
+    bits = ((uint64_t)GCR_encode_byte[source[0]] << 30)
+         | ((uint64_t)GCR_encode_byte[source[1]] << 20)
+         | ((uint64_t)GCR_encode_byte[source[2]] << 10)
+         | (uint64_t)GCR_encode_byte[source[3]];
+
+    dest[0] = (uint8_t)(bits >> 32);
+    dest[1] = (uint8_t)(bits >> 24);
+    dest[2] = (uint8_t)(bits >> 16);
+    dest[3] = (uint8_t)(bits >> 8);
+    dest[4] = (uint8_t)bits;
+}
 
-        /*  "tdest >> 16" could be optimized to a word
-         *  aligned access, hopefully the compiler does
-         *  this for us (in a portable way)
-         */
-        *dest = From_GCR_conv_data[(tdest >> 16) & 0x1f] << 4;
-        tdest <<= 5;
+/* 40 GCR bits in the low bits of bits become 4 bytes */
+static inline void gcr_convert_40bits_to_4bytes(uint64_t bits, uint8_t *dest)
+{
+    dest[0] = GCR_decode_byte[(bits >> 30) & 0x3ff];
+    dest[1] = GCR_decode_byte[(bits >> 20) & 0x3ff];
+    dest[2] = GCR_decode_byte[(bits >> 10) & 0x3ff];
+    dest[3] = GCR_decode_byte[bits & 0x3ff];
+}
 
-        *dest |= From_GCR_conv_data[(tdest >> 16) & 0x1f];
-        tdest <<= 5;
-    }
+static inline void gcr_convert_GCR_to_4bytes(const uint8_t *source, uint8_t *dest)
+{
+    gcr_convert_40bits_to_4bytes(((uint64_t)source[0] << 32)
+                                 | ((uint64_t)source[1] << 24)
+                                 | ((uint64_t)source[2] << 16)
+                                 | ((uint64_t)source[3] << 8)
+                                 | (uint64_t)source[4], dest);
 }
 
 void gcr_convert_sector_to_GCR(const uint8_t *buffer, uint8_t *data, const gcr_header_t *header,
@@ -115,6 +143,8 @@ void gcr_convert_sector_to_GCR(const uint8_t *buffer, uint8_t *data, const gcr_h
     int i;
     uint8_t buf[4], chksum, idm;
 
+    gcr_check_tables();
+
     idm = (error_code == CBMDOS_FDC_ERR_ID) ? 0xff : 0x00;
 
     memset(data, (error_code == CBMDOS_FDC_ERR_SYNC) ? 0x55 : 0xff, 5);       /* Sync */
@@ -167,38 +197,67 @@ void gcr_convert_sector_to_GCR(const uint8_t *buffer, uint8_t *data, const gcr_h
     gcr_convert_4bytes_to_GCR(buf, data);
 }
 
+/* Find the end of the next sync (10 or more one bits), searching \a s bits
+   from bit \a p on. Returns the position of the first zero bit after the
+   sync. Only the bits up to the next byte boundary and after the last one
+   are looked at one by one, whole bytes are checked using the number of
+   leading and trailing ones. */
 static int gcr_find_sync(const disk_track_t *raw, int p, int s)
 {
-    unsigned int w;
-    int b;
+    int end, run, b;
 
     if (!raw->data || !raw->size) {
         return -CBMDOS_FDC_ERR_SYNC;
     }
 
-    w = 0;
-    b = raw->data[p >> 3] << (p & 7);
-    while (s--) {
-        if (b & 0x80) {
-            w = (w << 1) | 1;
+    end = raw->size * 8;
+    run = 0;
+
+    while (s > 0 && (p & 7)) {
+        if (raw->data[p >> 3] & (0x80 >> (p & 7))) {
+            run++;
         } else {
-            if (~w & 0x3ff) {
-                w <<= 1;
-            } else {
+            if (run >= 10) {
                 return p;
             }
+            run = 0;
         }
-        if (~p & 7) {
-            p++;
-            b <<= 1;
+        p++;
+        s--;
+    }
+    if (p >= end) {
+        p = 0;
+    }
+
+    while (s >= 8) {
+        b = raw->data[p >> 3];
+        if (b == 0xff) {
+            run += 8;
         } else {
-            p++;
-            if (p >= raw->size * 8) {
-                p = 0;
+            if (run + leading_ones[b] >= 10) {
+                return p + leading_ones[b];
             }
-            b = raw->data[p >> 3];
+            run = trailing_ones[b];
+        }
+        p += 8;
+        s -= 8;
+        if (p >= end) {
+            p = 0;
         }
     }
+
+    while (s > 0) {
+        if (raw->data[p >> 3] & (0x80 >> (p & 7))) {
+            run++;
+        } else {
+            if (run >= 10) {
+                return p;
+            }
+            run = 0;
+        }
+        p++;
+        s--;
+    }
     return -CBMDOS_FDC_ERR_SYNC;
 }
 
@@ -207,10 +266,26 @@ static void gcr_decode_block(const disk_track_t *raw, int p, uint8_t *buf, int n
     int shift, i, j;
     uint8_t gcr[5], b;
     uint8_t *offset, *end = raw->data + raw->size;
+    uint64_t bits;
 
     shift = p & 7;
     offset = raw->data + (p >> 3);
 
+    /* unless the block wraps around the end of the track, take the 40 bits
+       of each group out of the 6 bytes they span */
+    if ((p >> 3) + num * 5 + 1 <= raw->size) {
+        for (i = 0; i < num; i++, buf += 4, offset += 5) {
+            bits = ((uint64_t)offset[0] << 40)
+                 | ((uint64_t)offset[1] << 32)
+                 | ((uint64_t)offset[2] << 24)
+                 | ((uint64_t)offset[3] << 16)
+                 | ((uint64_t)offset[4] << 8)
+                 | (uint64_t)offset[5];
+            gcr_convert_40bits_to_4bytes(bits >> (8 - shift), buf);
+        }
+        return;
+    }
+
     b = offset[0] << shift;
     for (i = 0; i < num; i++, buf += 4) {
         /* get 5 bytes of gcr data */
@@ -260,16 +335,12 @@ static int gcr_find_sector_header(const disk_track_t *raw, uint8_t sector)
     return -CBMDOS_FDC_ERR_HEADER;
 }
 
-fdc_err_t gcr_read_sector(const disk_track_t *raw, uint8_t *data, uint8_t sector)
+/* decode the data block following the header at \a p */
+static fdc_err_t gcr_read_sector_data(const disk_track_t *raw, int p, uint8_t *data)
 {
     uint8_t buffer[260];
     uint8_t b;
-    int i, p;
-
-    p = gcr_find_sector_header(raw, sector);
-    if (p < 0) {
-        return -p;
-    }
+    int i;
 
     p = gcr_find_sync(raw, p, 500 * 8);
     if (p < 0) {
@@ -291,6 +362,82 @@ fdc_err_t gcr_read_sector(const disk_track_t *raw, uint8_t *data, uint8_t sector
     return b ? CBMDOS_FDC_ERR_DCHECK : CBMDOS_FDC_ERR_OK;
 }
 
+fdc_err_t gcr_read_sector(const disk_track_t *raw, uint8_t *data, uint8_t sector)
+{
+    int p;
+
+    gcr_check_tables();
+
+    p = gcr_find_sector_header(raw, sector);
+    if (p < 0) {
+        return -p;
+    }
+
+    return gcr_read_sector_data(raw, p, data);
+}
+
+/** \brief  Decode all sectors of a track
+ *
+ * Gives the same results as calling gcr_read_sector() for each sector, but
+ * goes around the track only once to find the headers. Sectors that are
+ * not found are left alone in \a data.
+ *
+ * \param[in]   raw         GCR track
+ * \param[out]  data        \a num_sectors * 256 bytes of sector data
+ * \param[out]  errors      \a num_sectors error codes
+ * \param[in]   num_sectors number of sectors of the track
+ */
+void gcr_read_track(const disk_track_t *raw, uint8_t *data, fdc_err_t *errors,
+                    unsigned int num_sectors)
+{
+    uint8_t header[4];
+    int *header_pos;
+    int p, p2;
+    unsigned int sector;
+
+    gcr_check_tables();
+
+    header_pos = lib_malloc(num_sectors * sizeof(int));
+    for (sector = 0; sector < num_sectors; sector++) {
+        header_pos[sector] = -CBMDOS_FDC_ERR_HEADER;
+    }
+
+    /* same walk over the syncs as gcr_find_sector_header(), the first header
+       of each sector counts */
+    p = 0;
+    p2 = -CBMDOS_FDC_ERR_SYNC;
+    for (;; ) {
+        p = gcr_find_sync(raw, p, raw->size * 8);
+        if (p2 == p) {
+            break;
+        }
+        if (p2 < 0) {
+            p2 = p;
+        }
+        if (p < 0) {
+            break;
+        }
+        gcr_decode_block(raw, p, header, 1);
+
+        if (header[0] == 0x08 && header[2] < num_sectors
+            && header_pos[header[2]] < 0) {
+            header_pos[header[2]] = p;
+        }
+    }
+
+    for (sector = 0; sector < num_sectors; sector++) {
+        if (p2 < 0) {
+            errors[sector] = -p2;
+        } else if (header_pos[sector] < 0) {
+            errors[sector] = -header_pos[sector];
+        } else {
+            errors[sector] = gcr_read_sector_data(raw, header_pos[sector], data + sector * 256);
+        }
+    }
+
+    lib_free(header_pos);
+}
+
 fdc_err_t gcr_write_sector(disk_track_t *raw, const uint8_t *data, uint8_t sector)
 {
     uint8_t buffer[260], *offset, *buf;
@@ -298,6 +445,8 @@ fdc_err_t gcr_write_sector(disk_track_t *raw, const uint8_t *data, uint8_t secto
     uint8_t gcr[5], chksum, b;
     int i, j, shift, p;
 
+    gcr_check_tables();
+
     p = gcr_find_sector_header(raw, sector);
     if (p < 0) {
         return -p;
@@ -56,6 +56,9 @@ typedef struct disk_track_s {
 typedef struct gcr_s {
     /* Raw GCR image of the disk.  */
     disk_track_t tracks[MAX_GCR_TRACKS];
+    /* Tracks of sector based images which are not generated yet, this is
+       done when they are first accessed.  */
+    uint8_t pending[MAX_GCR_TRACKS];
 } gcr_t;
 
 typedef struct gcr_header_s {
@@ -65,6 +68,8 @@ typedef struct gcr_header_s {
 void gcr_convert_sector_to_GCR(const uint8_t *buffer, uint8_t *ptr, const gcr_header_t *header,
                                int gap, int sync, enum fdc_err_e error_code);
 enum fdc_err_e gcr_read_sector(const disk_track_t *raw, uint8_t *data, uint8_t sector);
+void gcr_read_track(const disk_track_t *raw, uint8_t *data, enum fdc_err_e *errors,
+                    unsigned int num_sectors);
 enum fdc_err_e gcr_write_sector(disk_track_t *raw, const uint8_t *data, uint8_t sector);
 
 gcr_t *gcr_create_image(void);
@@ -53,6 +53,8 @@
 
 #include <assert.h>
 
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -240,6 +242,40 @@ typedef struct {
 } VIDEOFrame;
 static VIDEOFrame *video_st_frame;
 
+/* Frames are handed from the emulation to a sender thread through a queue of
+   "FFMPEGVideoQueueSize" slots. A slot holds the palette indices of the frame
+   and the palette, the sender converts them to RGB and writes them to ffmpeg,
+   so neither the conversion nor a slow encoder hold up the emulation. When
+   the queue is full the frame is dropped ("FFMPEGVideoQueueDrop") or the
+   emulation waits for a free slot. With a size of 0 frames are converted and
+   written right away, like they used to be. */
+typedef struct video_queue_slot_s {
+    uint8_t *pixels;            /* palette indices, video_width * video_height */
+    uint8_t lut[256][4];        /* palette, red, green, blue and padding */
+    int count;                  /* number of times the frame is written */
+} video_queue_slot_t;
+
+static video_queue_slot_t *video_queue = NULL;
+static VIDEOFrame *video_queue_frame;   /* RGB frame of the sender thread */
+static int video_queue_slots;           /* number of slots in video_queue */
+static int video_queue_async;           /* use the sender thread */
+static int video_queue_head;            /* next slot to fill */
+static int video_queue_tail;            /* next slot to send */
+static int video_queue_used;            /* number of filled slots */
+static int video_queue_running;         /* sender thread is running */
+static int video_queue_stop;            /* sender thread should quit when done */
+static int video_queue_error;           /* writing to ffmpeg failed */
+static unsigned long video_queue_sent;
+static unsigned long video_queue_dropped;
+static unsigned long video_queue_waits;
+
+static pthread_t video_queue_thread;
+static pthread_mutex_t video_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t video_queue_filled = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t video_queue_freed = PTHREAD_COND_INITIALIZER;
+
+#define VIDEO_QUEUE_SIZE_MAX    64
+
 /* input audio stream */
 #define AUDIO_BUFFER_SAMPLES        0x400
 #define AUDIO_BUFFER_MAX_CHANNELS   2
@@ -278,6 +314,7 @@ log_t ffmpeg_log = LOG_DEFAULT;
 
 static int ffmpegexedrv_init_file(void);
 static void ffmpegexedrv_shutdown(void);
+static void video_queue_start(void);
 
 /******************************************************************************/
 /* resources */
@@ -289,6 +326,8 @@ static int video_codec;
 static int audio_bitrate;
 static int video_bitrate;
 static int video_halve_framerate;
+static int video_queue_size;
+static int video_queue_drop;
 
 static int set_container_format(const char *val, void *param)
 {
@@ -368,6 +407,22 @@ static int set_video_halve_framerate(int value, void *param)
     return 0;
 }
 
+static int set_video_queue_size(int val, void *param)
+{
+    if ((val < 0) || (val > VIDEO_QUEUE_SIZE_MAX)) {
+        return -1;
+    }
+    /* takes effect with the next recording */
+    video_queue_size = val;
+    return 0;
+}
+
+static int set_video_queue_drop(int val, void *param)
+{
+    video_queue_drop = val ? 1 : 0;
+    return 0;
+}
+
 /*---------- Resources ------------------------------------------------*/
 
 static const resource_string_t resources_string[] = {
@@ -391,6 +446,10 @@ static const resource_int_t resources_int[] = {
       &video_codec, set_video_codec, NULL },
     { "FFMPEGVideoHalveFramerate", 0, RES_EVENT_NO, NULL,
       &video_halve_framerate, set_video_halve_framerate, NULL },
+    { "FFMPEGVideoQueueSize", 8, RES_EVENT_NO, NULL,
+      &video_queue_size, set_video_queue_size, NULL },
+    { "FFMPEGVideoQueueDrop", 0, RES_EVENT_NO, NULL,
+      &video_queue_drop, set_video_queue_drop, NULL },
     RESOURCE_INT_LIST_END
 };
 
@@ -417,6 +476,15 @@ static const cmdline_option_t cmdline_options[] =
     { "-ffmpegvideobitrate", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "FFMPEGVideoBitrate", NULL,
       "<value>", "Set bitrate for video stream in media file" },
+    { "-ffmpegvideoqueuesize", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "FFMPEGVideoQueueSize", NULL,
+      "<frames>", "Set number of video frames queued for ffmpeg (0: write frames right away)" },
+    { "-ffmpegvideoqueuedrop", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "FFMPEGVideoQueueDrop", (resource_value_t)1,
+      NULL, "Drop video frames when the queue for ffmpeg is full" },
+    { "+ffmpegvideoqueuedrop", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "FFMPEGVideoQueueDrop", (resource_value_t)0,
+      NULL, "Wait for ffmpeg when the video queue is full" },
     CMDLINE_LIST_END
 };
 
@@ -436,6 +504,8 @@ static void log_resource_values(const char *func)
     DBG(("%s FFMPEGAudioCodec:%d:'%s'", func, audio_codec, av_codec_get_option(audio_codec)));
     DBG(("%s FFMPEGAudioBitrate:%d", func, audio_bitrate));
     DBG(("%s FFMPEGVideoHalveFramerate:%d", func, video_halve_framerate));
+    DBG(("%s FFMPEGVideoQueueSize:%d", func, video_queue_size));
+    DBG(("%s FFMPEGVideoQueueDrop:%d", func, video_queue_drop));
 }
 
 static void prepare_port_numbers(void)
@@ -896,6 +966,8 @@ static int start_ffmpeg_executable(void)
 #endif
 
     log_message(ffmpeg_log, "ffmpegexedrv: pipes are ready");
+
+    video_queue_start();
     return 0;
 }
 
@@ -1089,33 +1161,186 @@ static soundmovie_funcs_t ffmpegexedrv_soundmovie_funcs = {
    video stream encoding
  *****************************************************************************/
 
-static int video_fill_rgb_image(screenshot_t *screenshot, VIDEOFrame *pic)
+/* copy the palette indices of the visible part of the screen */
+static void video_fill_frame(screenshot_t *screenshot, video_queue_slot_t *slot)
 {
-    int x, y;
+    int y;
     int dx, dy;
-    int colnum;
+    unsigned int i;
     int bufferoffset;
     int x_dim = screenshot->width;
     int y_dim = screenshot->height;
-    int pix = 0;
+    const palette_t *palette = screenshot->palette;
+
     /* center the screenshot in the video */
-    pic->linesize = video_width * INPUT_VIDEO_BPP;
     dx = (video_width - x_dim) / 2;
     dy = (video_height - y_dim) / 2;
     bufferoffset = screenshot->x_offset + (dx < 0 ? -dx : 0)
         + (screenshot->y_offset + (dy < 0 ? -dy : 0)) * screenshot->draw_buffer_line_size;
 
     for (y = 0; y < video_height; y++) {
-        for (x = 0; x < video_width; x++) {
-            colnum = screenshot->draw_buffer[bufferoffset + x];
-            pic->data[pix + INPUT_VIDEO_BPP * x] = screenshot->palette->entries[colnum].red;
-            pic->data[pix + INPUT_VIDEO_BPP * x + 1] = screenshot->palette->entries[colnum].green;
-            pic->data[pix + INPUT_VIDEO_BPP * x + 2] = screenshot->palette->entries[colnum].blue;
-        }
+        memcpy(slot->pixels + y * video_width,
+               screenshot->draw_buffer + bufferoffset, (size_t)video_width);
         bufferoffset += screenshot->draw_buffer_line_size;
-        pix += pic->linesize;
     }
 
+    memset(slot->lut, 0, sizeof slot->lut);
+    for (i = 0; i < palette->num_entries && i < 256; i++) {
+        slot->lut[i][0] = palette->entries[i].red;
+        slot->lut[i][1] = palette->entries[i].green;
+        slot->lut[i][2] = palette->entries[i].blue;
+    }
+}
+
+/* Convert the palette indices to RGB. Each pixel is written as one 32 bit
+   word from the lookup table, the padding byte is overwritten by the next
+   pixel, which is a lot cheaper than three single byte lookups and stores. */
+static void video_expand_frame(const video_queue_slot_t *slot, VIDEOFrame *pic)
+{
+    const uint8_t *src = slot->pixels;
+    uint8_t *dst = pic->data;
+    size_t n = (size_t)video_width * (size_t)video_height;
+    size_t i;
+
+    pic->linesize = video_width * INPUT_VIDEO_BPP;
+    if (n == 0) {
+        return;
+    }
+    for (i = 0; i < n - 1; i++) {
+        memcpy(dst, slot->lut[src[i]], 4);
+        dst += INPUT_VIDEO_BPP;
+    }
+    memcpy(dst, slot->lut[src[i]], INPUT_VIDEO_BPP);
+}
+
+static void *video_queue_thread_main(void *arg)
+{
+    video_queue_slot_t *slot;
+    int error;
+    int i;
+#ifdef UNIX_COMPILE
+    sigset_t set;
+
+    /* a closed pipe is reported by the failing send() */
+    sigemptyset(&set);
+    sigaddset(&set, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+#endif
+
+    pthread_mutex_lock(&video_queue_lock);
+    for (;;) {
+        while (video_queue_used == 0 && !video_queue_stop) {
+            pthread_cond_wait(&video_queue_filled, &video_queue_lock);
+        }
+        if (video_queue_used == 0) {
+            break;
+        }
+        slot = &video_queue[video_queue_tail];
+        error = video_queue_error;
+        pthread_mutex_unlock(&video_queue_lock);
+
+        /* after an error the queue is only emptied */
+        if (!error) {
+            video_expand_frame(slot, video_queue_frame);
+            for (i = 0; i < slot->count; i++) {
+                if (write_video_frame(video_queue_frame) < 0) {
+                    log_error(ffmpeg_log, "ffmpegexedrv: Error writing to VIDEO socket");
+                    error = 1;
+                    break;
+                }
+            }
+        }
+
+        pthread_mutex_lock(&video_queue_lock);
+        if (error) {
+            video_queue_error = 1;
+        } else {
+            video_queue_sent += (unsigned long)slot->count;
+        }
+        video_queue_tail = (video_queue_tail + 1) % video_queue_slots;
+        video_queue_used--;
+        pthread_cond_signal(&video_queue_freed);
+    }
+    pthread_mutex_unlock(&video_queue_lock);
+    return NULL;
+}
+
+/* called by start_ffmpeg_executable() once the sockets are connected */
+static void video_queue_start(void)
+{
+    if (!video_queue_async || video_queue_running || video_queue == NULL) {
+        return;
+    }
+
+    video_queue_head = 0;
+    video_queue_tail = 0;
+    video_queue_used = 0;
+    video_queue_stop = 0;
+    video_queue_error = 0;
+    video_queue_sent = 0;
+    video_queue_dropped = 0;
+    video_queue_waits = 0;
+
+    if (pthread_create(&video_queue_thread, NULL, video_queue_thread_main, NULL) != 0) {
+        log_error(ffmpeg_log, "ffmpegexedrv: Cannot start video thread, writing frames directly.");
+        return;
+    }
+    video_queue_running = 1;
+}
+
+/* write the queued frames and stop the sender thread */
+static void video_queue_finish(void)
+{
+    if (!video_queue_running) {
+        return;
+    }
+
+    pthread_mutex_lock(&video_queue_lock);
+    video_queue_stop = 1;
+    pthread_cond_signal(&video_queue_filled);
+    pthread_mutex_unlock(&video_queue_lock);
+
+    pthread_join(video_queue_thread, NULL);
+    video_queue_running = 0;
+
+    log_message(ffmpeg_log, "ffmpegexedrv: %lu video frames written, %lu dropped, waited for ffmpeg %lu times.",
+                video_queue_sent, video_queue_dropped, video_queue_waits);
+}
+
+/* Queue a frame for the sender thread.
+   Returns 0 if the frame was queued, 1 if it was dropped and -1 on error. */
+static int video_queue_put(screenshot_t *screenshot, int count)
+{
+    video_queue_slot_t *slot;
+
+    pthread_mutex_lock(&video_queue_lock);
+    if (video_queue_used == video_queue_slots && !video_queue_error) {
+        if (video_queue_drop) {
+            video_queue_dropped += (unsigned long)count;
+            pthread_mutex_unlock(&video_queue_lock);
+            return 1;
+        }
+        video_queue_waits++;
+        while (video_queue_used == video_queue_slots && !video_queue_error) {
+            pthread_cond_wait(&video_queue_freed, &video_queue_lock);
+        }
+    }
+    if (video_queue_error) {
+        pthread_mutex_unlock(&video_queue_lock);
+        return -1;
+    }
+    slot = &video_queue[video_queue_head];
+    pthread_mutex_unlock(&video_queue_lock);
+
+    /* the sender does not touch the slot until it is counted as used */
+    video_fill_frame(screenshot, slot);
+    slot->count = count;
+
+    pthread_mutex_lock(&video_queue_lock);
+    video_queue_head = (video_queue_head + 1) % video_queue_slots;
+    video_queue_used++;
+    pthread_cond_signal(&video_queue_filled);
+    pthread_mutex_unlock(&video_queue_lock);
     return 0;
 }
 
@@ -1148,6 +1373,8 @@ static void video_free_picture(VIDEOFrame *picture)
 /* called by ffmpegexedrv_init_file */
 static int ffmpegexedrv_open_video(void)
 {
+    int i;
+
     DBG(("ffmpegexedrv_open_video w:%d h:%d", video_width, video_height));
 
     video_is_open = 1;
@@ -1159,19 +1386,48 @@ static int ffmpegexedrv_open_video(void)
         return -1;
     }
 
+    /* without the sender thread the first slot is used for every frame */
+    video_queue_async = (video_queue_size > 0);
+    video_queue_slots = video_queue_async ? video_queue_size : 1;
+    video_queue = lib_calloc((size_t)video_queue_slots, sizeof(video_queue_slot_t));
+    for (i = 0; i < video_queue_slots; i++) {
+        video_queue[i].pixels = lib_malloc((size_t)video_width * (size_t)video_height);
+    }
+    if (video_queue_async) {
+        video_queue_frame = video_alloc_picture(INPUT_VIDEO_BPP, video_width, video_height);
+        if (!video_queue_frame) {
+            log_debug(ffmpeg_log, "ffmpegexedrv: could not allocate picture");
+            return -1;
+        }
+    }
+
     return 0;
 }
 
 /* called by ffmpegexedrv_close() */
 static void ffmpegexedrv_close_video(void)
 {
+    int i;
+
     DBG(("ffmpegexedrv_close_video"));
+    video_queue_finish();
     close_video_stream();
     video_is_open = 0;
     if (video_st_frame) {
         video_free_picture(video_st_frame);
         video_st_frame = NULL;
     }
+    if (video_queue_frame) {
+        video_free_picture(video_queue_frame);
+        video_queue_frame = NULL;
+    }
+    if (video_queue) {
+        for (i = 0; i < video_queue_slots; i++) {
+            lib_free(video_queue[i].pixels);
+        }
+        lib_free(video_queue);
+        video_queue = NULL;
+    }
     framecounter = 0;
 }
 
@@ -1182,7 +1438,7 @@ static void ffmpegexedrv_init_video(screenshot_t *screenshot)
     video_init_done = 1;
 
     /* resolution should be a multiple of 16 */
-    /* video_fill_rgb_image only implements cutting so */
+    /* video_fill_frame only implements cutting so */
     /* adding black border was removed */
     video_width = screenshot->width & ~0xf;
     video_height = screenshot->height & ~0xf;
@@ -1322,6 +1578,8 @@ static int ffmpegexedrv_close(screenshot_t *screenshot)
 /* triggered by screenshot_record, periodically called to output video data stream */
 static int ffmpegexedrv_record(screenshot_t *screenshot)
 {
+    int count = 1;
+    int i;
     double frametime = (double)framecounter / fps;
     double audiotime = (double)audio_input_counter / (double)audio_input_sample_rate;
     DBGFRAMES(("ffmpegexedrv_record(framecount:%lu, audiocount:%lu frametime:%f, audiotime:%f)",
@@ -1348,19 +1606,34 @@ static int ffmpegexedrv_record(screenshot_t *screenshot)
         return 0;
     }
 
-    /*DBGFRAMES(("ffmpegexedrv_record (%u)", framecounter));*/
-    video_fill_rgb_image(screenshot, video_st_frame);
-
-    if (write_video_frame(video_st_frame) < 0) {
-        return -1;
-    }
-
     /* the video is late */
     if (frametime < (audiotime - (time_base * 1.5f))) {
         /* insert one frame */
         framecounter++;
         DBG(("video is late, inserting a frame (framecount:%lu, audiocount:%lu frametime:%f, audiotime:%f)",
             framecounter, audio_input_counter, frametime, audiotime));
+        count = 2;
+    }
+
+    /*DBGFRAMES(("ffmpegexedrv_record (%u)", framecounter));*/
+    if (video_queue_running) {
+        switch (video_queue_put(screenshot, count)) {
+            case 0:
+                return 0;
+            case 1:
+                /* the queue is full, the frame is inserted again once the
+                   video is late */
+                framecounter -= count;
+                return 0;
+            default:
+                return -1;
+        }
+    }
+
+    video_fill_frame(screenshot, &video_queue[0]);
+    video_expand_frame(&video_queue[0], video_st_frame);
+
+    for (i = 0; i < count; i++) {
         if (write_video_frame(video_st_frame) < 0) {
             return -1;
         }
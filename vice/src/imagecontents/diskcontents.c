@@ -42,7 +42,7 @@
 #include "vdrive.h"
 #include "vdrive-internal.h"
 
-image_contents_t *diskcontents_filesystem_read(const char *file_name)
+static image_contents_t *diskcontents_filesystem_read_image(const char *file_name)
 {
     vdrive_t *vdrive;
     image_contents_t *contents = NULL;
@@ -56,3 +56,8 @@ image_contents_t *diskcontents_filesystem_read(const char *file_name)
 
     return contents;
 }
+
+image_contents_t *diskcontents_filesystem_read(const char *file_name)
+{
+    return image_contents_read_cached(file_name, diskcontents_filesystem_read_image);
+}
@@ -38,7 +38,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
+#include "archdep.h"
 #include "charset.h"
 #include "diskcontents.h"
 #include "imagecontents.h"
@@ -87,6 +89,273 @@ void image_contents_destroy(image_contents_t *contents)
 }
 
 
+/** \brief  Make a copy of \a contents and its file list
+ *
+ * \param[in]   contents    image contents object
+ *
+ * \return  image contents object, free with image_contents_destroy()
+ */
+static image_contents_t *image_contents_dup(const image_contents_t *contents)
+{
+    image_contents_t *newimg;
+    image_contents_file_list_t *node;
+    image_contents_file_list_t *last = NULL;
+
+    newimg = lib_malloc(sizeof(image_contents_t));
+    *newimg = *contents;
+    newimg->file_list = NULL;
+
+    for (node = contents->file_list; node != NULL; node = node->next) {
+        image_contents_file_list_t *newnode;
+
+        newnode = lib_malloc(sizeof(image_contents_file_list_t));
+        *newnode = *node;
+        newnode->prev = last;
+        newnode->next = NULL;
+        if (last == NULL) {
+            newimg->file_list = newnode;
+        } else {
+            last->next = newnode;
+        }
+        last = newnode;
+    }
+    return newimg;
+}
+
+
+/* ------------------------------------------------------------------------- */
+
+/* The file choosers show the contents of every image they select, autostart
+   reads the directory of an image to find the file to load, and both do it
+   again and again for the same images. The parsed contents of the last few
+   images are kept here.
+
+   An entry is used as long as the size and modification time of the image
+   did not change. Otherwise the image is hashed, and if an entry with the
+   same contents exists (the image was only touched, or copied), it is used
+   anyway. Contents read in the same second the image was modified are not
+   trusted until the image is checked again. Images too large to be hashed
+   quickly are only compared by size and modification time. */
+
+#define IMAGE_CONTENTS_CACHE_SIZE       8
+#define IMAGE_CONTENTS_CACHE_MAX_HASH   (16 * 1024 * 1024)
+
+typedef struct image_contents_cache_entry_s {
+    char *path;
+    read_contents_func_type read_contents;
+    size_t size;
+    time_t mtime;
+    time_t checked;     /* time the contents were found to be valid */
+    int hashed;
+    uint64_t hash;      /* FNV-1a hash of the image file */
+    image_contents_t *contents;
+    unsigned long used;
+} image_contents_cache_entry_t;
+
+static image_contents_cache_entry_t contents_cache[IMAGE_CONTENTS_CACHE_SIZE];
+static unsigned long contents_cache_clock = 0;
+
+/* The UI thread reads contents for its file choosers while the emulation
+   thread reads them for autostart. */
+#ifdef USE_VICE_THREAD
+#include <pthread.h>
+static pthread_mutex_t contents_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#define LOCK()      pthread_mutex_lock(&contents_cache_lock)
+#define UNLOCK()    pthread_mutex_unlock(&contents_cache_lock)
+#else
+#define LOCK()
+#define UNLOCK()
+#endif
+
+static void cache_entry_free(image_contents_cache_entry_t *entry)
+{
+    if (entry->contents != NULL) {
+        image_contents_destroy(entry->contents);
+    }
+    lib_free(entry->path);
+    memset(entry, 0, sizeof *entry);
+}
+
+static int cache_hash_file(const char *file_name, uint64_t *hash)
+{
+    uint8_t buf[0x4000];
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t len;
+    size_t i;
+    FILE *fd;
+
+    fd = fopen(file_name, MODE_READ);
+    if (fd == NULL) {
+        return -1;
+    }
+    while ((len = fread(buf, 1, sizeof buf, fd)) > 0) {
+        for (i = 0; i < len; i++) {
+            h = (h ^ buf[i]) * 0x100000001b3ULL;
+        }
+    }
+    if (ferror(fd)) {
+        fclose(fd);
+        return -1;
+    }
+    fclose(fd);
+    *hash = h;
+    return 0;
+}
+
+static image_contents_cache_entry_t *cache_lookup_path(const char *file_name,
+                                                      read_contents_func_type read_contents)
+{
+    unsigned int i;
+
+    for (i = 0; i < IMAGE_CONTENTS_CACHE_SIZE; i++) {
+        image_contents_cache_entry_t *e = &contents_cache[i];
+
+        if (e->contents != NULL && e->read_contents == read_contents
+            && strcmp(e->path, file_name) == 0) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static image_contents_cache_entry_t *cache_lookup_hash(uint64_t hash, size_t size,
+                                                      read_contents_func_type read_contents)
+{
+    unsigned int i;
+
+    for (i = 0; i < IMAGE_CONTENTS_CACHE_SIZE; i++) {
+        image_contents_cache_entry_t *e = &contents_cache[i];
+
+        if (e->contents != NULL && e->hashed && e->hash == hash
+            && e->size == size && e->read_contents == read_contents) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+/** \brief  Read the contents of an image, using the cache when possible
+ *
+ * \param[in]   file_name       image file
+ * \param[in]   read_contents   function that reads the contents of the image
+ *
+ * \return  image contents object, free with image_contents_destroy(), or
+ *          `NULL` on error
+ */
+image_contents_t *image_contents_read_cached(const char *file_name,
+                                             read_contents_func_type read_contents)
+{
+    image_contents_cache_entry_t *entry;
+    image_contents_t *contents = NULL;
+    unsigned int isdir;
+    uint64_t hash = 0;
+    size_t size;
+    time_t mtime;
+    time_t now;
+    int hashed = 0;
+    unsigned int i;
+
+    if (archdep_stat(file_name, &size, &isdir) < 0 || isdir
+        || archdep_stat_mtime(file_name, &mtime) < 0) {
+        return read_contents(file_name);
+    }
+    now = time(NULL);
+
+    LOCK();
+    entry = cache_lookup_path(file_name, read_contents);
+    if (entry != NULL && entry->size == size && entry->mtime == mtime
+        && entry->checked > mtime) {
+        entry->used = ++contents_cache_clock;
+        contents = image_contents_dup(entry->contents);
+    }
+    UNLOCK();
+    if (contents != NULL) {
+        return contents;
+    }
+
+    if (size <= IMAGE_CONTENTS_CACHE_MAX_HASH
+        && cache_hash_file(file_name, &hash) == 0) {
+        hashed = 1;
+        LOCK();
+        entry = cache_lookup_hash(hash, size, read_contents);
+        if (entry != NULL) {
+            /* same image, maybe under another name */
+            image_contents_cache_entry_t *old;
+
+            old = cache_lookup_path(file_name, read_contents);
+            if (old != NULL && old != entry) {
+                cache_entry_free(old);
+            }
+            if (strcmp(entry->path, file_name) != 0) {
+                lib_free(entry->path);
+                entry->path = lib_strdup(file_name);
+            }
+            entry->mtime = mtime;
+            entry->checked = now;
+            entry->used = ++contents_cache_clock;
+            contents = image_contents_dup(entry->contents);
+        }
+        UNLOCK();
+        if (contents != NULL) {
+            return contents;
+        }
+    }
+
+    contents = read_contents(file_name);
+    if (contents == NULL) {
+        return NULL;
+    }
+
+    LOCK();
+    entry = cache_lookup_path(file_name, read_contents);
+    if (entry == NULL) {
+        for (i = 0; i < IMAGE_CONTENTS_CACHE_SIZE; i++) {
+            image_contents_cache_entry_t *e = &contents_cache[i];
+
+            if (e->contents == NULL) {
+                entry = e;
+                break;
+            }
+            if (entry == NULL || e->used < entry->used) {
+                entry = e;
+            }
+        }
+    }
+    cache_entry_free(entry);
+
+    entry->path = lib_strdup(file_name);
+    entry->read_contents = read_contents;
+    entry->size = size;
+    entry->mtime = mtime;
+    entry->checked = now;
+    entry->hashed = hashed;
+    entry->hash = hash;
+    entry->contents = image_contents_dup(contents);
+    entry->used = ++contents_cache_clock;
+    UNLOCK();
+
+    return contents;
+}
+
+
+/** \brief  Free the cached image contents
+ */
+void image_contents_cache_shutdown(void)
+{
+    unsigned int i;
+
+    LOCK();
+    for (i = 0; i < IMAGE_CONTENTS_CACHE_SIZE; i++) {
+        if (contents_cache[i].contents != NULL) {
+            cache_entry_free(&contents_cache[i]);
+        }
+    }
+    UNLOCK();
+}
+
+
+/* ------------------------------------------------------------------------- */
+
 /** \brief  Free memory used by image contents as a list of screen codes
  *
  * \param[in,out]   c   screencode contents object
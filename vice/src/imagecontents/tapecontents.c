@@ -85,7 +85,7 @@ static void tape_read_contents(tape_image_t *tape_image, image_contents_t *new)
     }
 }
 
-image_contents_t *tapecontents_read(const char *file_name)
+static image_contents_t *tapecontents_read_image(const char *file_name)
 {
     tape_image_t *tape_image;
     image_contents_t *new;
@@ -107,3 +107,8 @@ image_contents_t *tapecontents_read(const char *file_name)
     tape_internal_close_tape_image(tape_image);
     return new;
 }
+
+image_contents_t *tapecontents_read(const char *file_name)
+{
+    return image_contents_read_cached(file_name, tapecontents_read_image);
+}
@@ -31,6 +31,8 @@
 #include "attach.h"
 #include "cmdline.h"
 #include "console.h"
+#include "coverage.h"
+#include "frametiming.h"
 #include "debug.h"
 #include "drive.h"
 #include "initcmdline.h"
@@ -120,6 +122,14 @@ int init_resources(void)
         init_resource_fail("vsync");
         return -1;
     }
+    if (coverage_resources_init() < 0) {
+        init_resource_fail("coverage");
+        return -1;
+    }
+    if (frametiming_resources_init() < 0) {
+        init_resource_fail("frame timing");
+        return -1;
+    }
     if (sound_resources_init() < 0) {
         init_resource_fail("sound");
         return -1;
@@ -205,6 +215,14 @@ int init_cmdline_options(void)
         init_cmdline_options_fail("vsync");
         return -1;
     }
+    if (coverage_cmdline_options_init() < 0) {
+        init_cmdline_options_fail("coverage");
+        return -1;
+    }
+    if (frametiming_cmdline_options_init() < 0) {
+        init_cmdline_options_fail("frame timing");
+        return -1;
+    }
     if (sound_cmdline_options_init() < 0) {
         init_cmdline_options_fail("sound");
         return -1;
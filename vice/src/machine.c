@@ -37,12 +37,15 @@
 #include "autostart.h"
 #include "cmdline.h"
 #include "console.h"
+#include "coverage.h"
+#include "frametiming.h"
 #include "diskimage.h"
 #include "drive.h"
 #include "vice-event.h"
 #include "fliplist.h"
 #include "fsdevice.h"
 #include "gfxoutput.h"
+#include "imagecontents.h"
 #include "initcmdline.h"
 #include "interrupt.h"
 #include "joystick.h"
@@ -370,6 +373,8 @@ void machine_shutdown(void)
     screenshot_at_exit();
     screenshot_shutdown();
 
+    frametiming_shutdown();
+
     file_system_detach_disk_shutdown();
 
     machine_specific_shutdown();
@@ -388,6 +393,7 @@ void machine_shutdown(void)
     fliplist_shutdown();
     file_system_shutdown();
     fsdevice_shutdown();
+    image_contents_cache_shutdown();
 
     tape_shutdown();
 
@@ -396,6 +402,9 @@ void machine_shutdown(void)
     kbdbuf_shutdown();
     keyboard_shutdown();
 
+    /* uses the monitor labels */
+    coverage_shutdown();
+
     monitor_shutdown();
 
     console_close_all();
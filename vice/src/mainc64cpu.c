@@ -39,6 +39,7 @@
 #include "c64pla.h"
 #endif
 
+#include "coverage.h"
 #include "debug.h"
 #include "drive.h"
 #include "cmdline.h"
@@ -51,6 +52,7 @@
 #include "mem.h"
 #include "monitor.h"
 #include "mos6510.h"
+#include "profiler.h"
 #include "reu.h"
 #include "resources.h"
 #include "snapshot.h"
@@ -78,6 +80,14 @@ CLOCK stolen_cycles;
 
 static int reu_dma_triggered = 0;
 
+#ifdef FEATURE_CPUMEMHISTORY
+/* record CPU history and memory map for the monitor */
+static int maincpu_history_enabled = 1;
+#endif
+
+/* opcode that made the CPU jam, shared by both copies of the main loop */
+static uint8_t maincpu_jam_opcode = 0;
+
 #define NEED_REG_PC
 
 /* ------------------------------------------------------------------------- */
@@ -259,37 +269,47 @@ inline static void memmap_mem_update(unsigned int addr, int write, int dummy)
     monitor_memmap_store(addr, type);
 }
 
-static void memmap_mem_store(unsigned int addr, unsigned int value)
+/* The memory map is only updated by the instrumented copy of the main loop,
+   "instrumented" is always the constant CPU_INSTRUMENTED of the copy. */
+inline static void memmap_mem_store(unsigned int addr, unsigned int value, int instrumented)
 {
-    memmap_mem_update(addr, 1, 0);
+    if (instrumented) {
+        memmap_mem_update(addr, 1, 0);
+    }
     (*_mem_write_tab_ptr[(addr) >> 8])((uint16_t)(addr), (uint8_t)(value));
 }
 
-static void memmap_mem_store_dummy(unsigned int addr, unsigned int value)
+inline static void memmap_mem_store_dummy(unsigned int addr, unsigned int value, int instrumented)
 {
-    memmap_mem_update(addr, 1, 1);
+    if (instrumented) {
+        memmap_mem_update(addr, 1, 1);
+    }
     (*_mem_write_tab_ptr_dummy[(addr) >> 8])((uint16_t)(addr), (uint8_t)(value));
 }
 
 /* read byte, check BA and mark as read */
-static uint8_t memmap_mem_read(unsigned int addr)
+inline static uint8_t memmap_mem_read(unsigned int addr, int instrumented)
 {
     check_ba();
-    memmap_mem_update(addr, 0, 0);
+    if (instrumented) {
+        memmap_mem_update(addr, 0, 0);
+    }
     return (*_mem_read_tab_ptr[(addr) >> 8])((uint16_t)(addr));
 }
 
-static uint8_t memmap_mem_read_dummy(unsigned int addr)
+inline static uint8_t memmap_mem_read_dummy(unsigned int addr, int instrumented)
 {
     check_ba();
-    memmap_mem_update(addr, 0, 1);
+    if (instrumented) {
+        memmap_mem_update(addr, 0, 1);
+    }
     return (*(_mem_read_tab_ptr_dummy[(addr) >> 8]))((uint16_t)(addr));
 }
 
 #ifndef STORE
 #define STORE(addr, value) \
     if (reu_dma_triggered == 0) { \
-        memmap_mem_store(addr, value); \
+        memmap_mem_store(addr, value, CPU_INSTRUMENTED); \
         if (addr == 0xff00) { \
             reu_dma(-1); \
         } \
@@ -299,7 +319,7 @@ static uint8_t memmap_mem_read_dummy(unsigned int addr)
 
 #ifndef STORE_DUMMY
 #define STORE_DUMMY(addr, value) \
-    memmap_mem_store_dummy(addr, value); \
+    memmap_mem_store_dummy(addr, value, CPU_INSTRUMENTED); \
     if (addr == 0xff00) { \
         reu_dma_triggered = reu_dma(-1); \
     }
@@ -307,53 +327,53 @@ static uint8_t memmap_mem_read_dummy(unsigned int addr)
 
 #ifndef LOAD
 #define LOAD(addr) \
-    memmap_mem_read(addr)
+    memmap_mem_read(addr, CPU_INSTRUMENTED)
 #endif
 
 #ifndef LOAD_DUMMY
 #define LOAD_DUMMY(addr) \
-    memmap_mem_read_dummy(addr)
+    memmap_mem_read_dummy(addr, CPU_INSTRUMENTED)
 #endif
 
 #ifndef LOAD_CHECK_BA_LOW
 #define LOAD_CHECK_BA_LOW(addr) \
     check_ba_low = 1;           \
-    memmap_mem_read(addr);\
+    memmap_mem_read(addr, CPU_INSTRUMENTED);\
     check_ba_low = 0
 #endif
 
 #ifndef LOAD_CHECK_BA_LOW_DUMMY
 #define LOAD_CHECK_BA_LOW_DUMMY(addr) \
     check_ba_low = 1;           \
-    memmap_mem_read_dummy(addr);\
+    memmap_mem_read_dummy(addr, CPU_INSTRUMENTED);\
     check_ba_low = 0
 #endif
 
 #ifndef STORE_ZERO
 #define STORE_ZERO(addr, value) \
-    memmap_mem_store((addr) & 0xff, value)
+    memmap_mem_store((addr) & 0xff, value, CPU_INSTRUMENTED)
 #endif
 
 #ifndef STORE_ZERO_DUMMY
 #define STORE_ZERO_DUMMY(addr, value) \
-    memmap_mem_store_dummy((addr) & 0xff, value)
+    memmap_mem_store_dummy((addr) & 0xff, value, CPU_INSTRUMENTED)
 #endif
 
 #ifndef LOAD_ZERO
 #define LOAD_ZERO(addr) \
-    memmap_mem_read((addr) & 0xff)
+    memmap_mem_read((addr) & 0xff, CPU_INSTRUMENTED)
 #endif
 
 #ifndef LOAD_ZERO_DUMMY
 #define LOAD_ZERO_DUMMY(addr) \
-    memmap_mem_read_dummy((addr) & 0xff)
+    memmap_mem_read_dummy((addr) & 0xff, CPU_INSTRUMENTED)
 #endif
 
 /* Route stack operations through memmap */
 
-#define PUSH(val) memmap_mem_store((0x100 + (reg_sp--)), (uint8_t)(val))
-#define PULL()    memmap_mem_read(0x100 + (++reg_sp))
-#define STACK_PEEK()  memmap_mem_read_dummy(0x100 + reg_sp)
+#define PUSH(val) memmap_mem_store((0x100 + (reg_sp--)), (uint8_t)(val), CPU_INSTRUMENTED)
+#define PULL()    memmap_mem_read(0x100 + (++reg_sp), CPU_INSTRUMENTED)
+#define STACK_PEEK()  memmap_mem_read_dummy(0x100 + reg_sp, CPU_INSTRUMENTED)
 
 #endif /* FEATURE_CPUMEMHISTORY */
 
@@ -538,11 +558,23 @@ static int set_lxa_log_level(int val, void *param)
     return 0;
 }
 
+#ifdef FEATURE_CPUMEMHISTORY
+static int set_maincpu_history_enabled(int val, void *param)
+{
+    maincpu_history_enabled = val ? 1 : 0;
+    return 0;
+}
+#endif
+
 static const resource_int_t maincpu_resources_int[] = {
     { "LogLevelANE", 0, RES_EVENT_NO, NULL,
       &ane_log_level, set_ane_log_level, NULL },
     { "LogLevelLXA", 0, RES_EVENT_NO, NULL,
       &lxa_log_level, set_lxa_log_level, NULL },
+#ifdef FEATURE_CPUMEMHISTORY
+    { "MainCPUHistory", 1, RES_EVENT_NO, NULL,
+      &maincpu_history_enabled, set_maincpu_history_enabled, NULL },
+#endif
     RESOURCE_INT_LIST_END
 };
 
@@ -559,6 +591,14 @@ static const cmdline_option_t cmdline_options_maincpu[] =
     { "-lxaloglevel", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
       NULL, NULL, "LogLevelLXA", NULL,
       "<Type>", "Set LXA log level: (0: None, 1: Unstable, 2: All)" },
+#ifdef FEATURE_CPUMEMHISTORY
+    { "-maincpuhistory", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "MainCPUHistory", (resource_value_t)1,
+      NULL, "Record the main CPU history and memory map for the monitor" },
+    { "+maincpuhistory", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "MainCPUHistory", (resource_value_t)0,
+      NULL, "Do not record the main CPU history and memory map for the monitor" },
+#endif
     CMDLINE_LIST_END
 };
 
@@ -729,6 +769,21 @@ void maincpu_resync_limits(void)
     }
 }
 
+/* The CPU emulation below is included twice, with and without the hooks for
+   the monitor. Checked before every instruction, so a change (setting a
+   checkpoint, starting the profiler, enabling the CPU history) takes effect
+   with the next opcode. Watchpoints set MI_WATCH, so the read tables that
+   check them are only installed while the instrumented copy runs. */
+inline static int maincpu_instrumented(void)
+{
+#ifdef FEATURE_CPUMEMHISTORY
+    if (maincpu_history_enabled) {
+        return 1;
+    }
+#endif
+    return monitor_mask[e_comp_space] || maincpu_profiling || coverage_enabled;
+}
+
 /* This doesn't return. The thread will directly exit when requested. */
 void maincpu_mainloop(void)
 {
@@ -808,7 +863,21 @@ void maincpu_mainloop(void)
 
 #define GLOBAL_REGS maincpu_regs
 
+#define CPU_JAM_OPCODE maincpu_jam_opcode
+
+        if (maincpu_instrumented()) {
+#define CPU_INSTRUMENTED 1
+#define TRAP_SKIPPED_LABEL trap_skipped_instrumented
 #include "6510dtvcore.c"
+#undef CPU_INSTRUMENTED
+#undef TRAP_SKIPPED_LABEL
+        } else {
+#define CPU_INSTRUMENTED 0
+#define TRAP_SKIPPED_LABEL trap_skipped
+#include "6510dtvcore.c"
+#undef CPU_INSTRUMENTED
+#undef TRAP_SKIPPED_LABEL
+        }
 
         maincpu_int_status->num_dma_per_opcode = 0;
 
@@ -43,6 +43,7 @@
 
 #include "archdep.h"
 #include "debug.h"
+#include "frametiming.h"
 #include "log.h"
 #include "machine.h"
 #include "mainlock.h"
@@ -163,6 +164,8 @@ void mainlock_yield_begin(void)
 {
     mainlock_assert_is_vice_thread();
 
+    frametiming_begin(FRAMETIMING_UI_LOCK_WAIT);
+
     pthread_mutex_unlock(&main_lock);
 
     /*
@@ -179,6 +182,8 @@ void mainlock_yield_begin(void)
         pthread_cond_wait(&ui_has_lock_cond, &internal_lock);
     }
     pthread_mutex_unlock(&internal_lock);
+
+    frametiming_end();
 }
 
 
@@ -186,7 +191,9 @@ void mainlock_yield_begin(void)
  */
 void mainlock_yield_end(void)
 {
+    frametiming_begin(FRAMETIMING_UI_LOCK_WAIT);
     pthread_mutex_lock(&main_lock);
+    frametiming_end();
 
     /* After the UI *might* have had the lock, check if we should exit. */
     consider_exit();
@@ -210,6 +210,12 @@ int mon_scrcode_upper_out(int maxlen, const char *format, ...) VICE_ATTR_PRINTF2
 /* Prototypes */
 int monitor_check_breakpoints(MEMSPACE mem, uint16_t addr);
 
+/** Label interface.  */
+typedef void monitor_label_func_t(uint16_t addr, const char *name, void *param);
+
+/* Prototypes */
+void monitor_label_foreach(MEMSPACE mem, monitor_label_func_t *func, void *param);
+
 /** Disassemble interace */
 /* Prototypes */
 const char *mon_disassemble_to_string(MEMSPACE, unsigned int addr, unsigned int x,
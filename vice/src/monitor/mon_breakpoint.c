@@ -37,6 +37,7 @@
 #include "lib.h"
 #include "log.h"
 #include "mon_breakpoint.h"
+#include "mon_condition.h"
 #include "mon_disassemble.h"
 #include "mon_util.h"
 #include "montypes.h"
@@ -214,6 +215,7 @@ static void remove_checkpoint(mon_checkpoint_t *cp)
     mem = addr_memspace(cp->start_addr);
 
     mon_delete_conditional(cp->condition);
+    mon_condition_free(cp->compiled_condition);
     lib_free(cp->command);
     cp->command = NULL;
 
@@ -390,7 +392,10 @@ void mon_breakpoint_set_checkpoint_condition(int cp_num,
         if (!cp) {
             mon_out("#%d not a valid checkpoint\n", cp_num);
         } else {
+            mon_delete_conditional(cp->condition);
+            mon_condition_free(cp->compiled_condition);
             cp->condition = cnode;
+            cp->compiled_condition = mon_condition_compile(cnode);
 
             mon_out("Setting checkpoint %d condition to: ", cp_num);
             mon_print_conditional(cnode);
@@ -541,7 +546,11 @@ bool mon_breakpoint_check_checkpoint(MEMSPACE mem, unsigned int addr, unsigned i
             mon_is_in_range(cp->start_addr, cp->end_addr, addr)) {
 
             /* If condition test fails, skip this checkpoint */
-            if (cp->condition) {
+            if (cp->compiled_condition) {
+                if (!mon_condition_evaluate(cp->compiled_condition, is_loadstore ? loadstorepc : instpc)) {
+                    continue;
+                }
+            } else if (cp->condition) {
                 if (!mon_evaluate_conditional(cp->condition, is_loadstore ? loadstorepc : instpc)) {
                     continue;
                 }
@@ -671,6 +680,7 @@ int breakpoint_add_checkpoint(MON_ADDR start_addr, MON_ADDR end_addr,
     new_cp->hit_count = 0;
     new_cp->ignore_count = 0;
     new_cp->condition = NULL;
+    new_cp->compiled_condition = NULL;
     new_cp->command = NULL;
     new_cp->check_load = memory_op & e_load;
     new_cp->check_store = memory_op & e_store;
@@ -42,6 +42,7 @@ struct mon_checkpoint_s {
     int hit_count;
     int ignore_count;
     cond_node_t *condition;
+    struct mon_cond_program_s *compiled_condition;
     char *command;
     bool stop;
     bool enabled;
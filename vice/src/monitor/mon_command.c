@@ -555,6 +555,15 @@ static const mon_cmds_t mon_cmd_array[] = {
       NO_FILENAME_ARG
     },
 
+    { "condtime", "",
+      "<checknum> [<count>]",
+      "Evaluate the condition of checkpoint `checknum' `count' times (default"
+      " 1000000), once by walking the expression tree and once using the compiled"
+      " form that is used when the checkpoint is hit, and show the time taken by"
+      " each. Registers and memory are read in their current state.",
+      NO_FILENAME_ARG
+    },
+
     { "delete", "del",
       "<checknum>",
       "Delete checkpoint `checknum'. If no checkpoint is specified delete all checkpoints.",
@@ -0,0 +1,518 @@
+/** \file   mon_condition.c
+ * \brief   Compiled checkpoint conditions for the monitor.
+ *
+ * Conditions attached to checkpoints are parsed into a tree of cond_node_t,
+ * which mon_evaluate_conditional() walks recursively on every hit. For
+ * checkpoints in hot loops this is costly, so when a condition is set it is
+ * also translated into a flat program for a small stack machine: constant
+ * subexpressions are folded, register and memory operands are turned into
+ * single instructions and the logical operators short-circuit.
+ *
+ * The tree is kept around for printing, and as a fallback for conditions
+ * that can not be compiled.
+ */
+
+/*
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#include "vice.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "archdep.h"
+#include "lib.h"
+#include "log.h"
+#include "mon_breakpoint.h"
+#include "mon_condition.h"
+#include "montypes.h"
+#include "monitor.h"
+#include "uimon.h"
+
+/*#define DEBUG_CONDITION*/
+
+#ifdef DEBUG_CONDITION
+#define DBG(x)  log_printf x
+#else
+#define DBG(x)
+#endif
+
+/** \brief  Maximum depth of the evaluation stack
+ *
+ * Conditions that need a deeper stack are not compiled, they are evaluated
+ * by walking the tree instead.
+ */
+#define MON_COND_STACK_SIZE 32
+
+enum mon_cond_opcode_e {
+    COND_OP_CONST,      /**< push value */
+    COND_OP_REG,        /**< push register `value` of memspace `arg` */
+    COND_OP_RASTERLINE, /**< push current raster line */
+    COND_OP_CYCLE,      /**< push current cycle in the line */
+    COND_OP_PC,         /**< push the effective PC */
+    COND_OP_MEM,        /**< push byte at address `value` in bank `arg` */
+    COND_OP_MEM_IND,    /**< replace top with the byte it points to in bank `arg` */
+    COND_OP_AND_JUMP,   /**< if top is zero jump to `value`, else pop */
+    COND_OP_OR_JUMP,    /**< if top is non-zero set it to 1 and jump to `value`, else pop */
+    COND_OP_BOOL,       /**< normalize top to 0/1 */
+    COND_OP_EQU,
+    COND_OP_NEQ,
+    COND_OP_GT,
+    COND_OP_LT,
+    COND_OP_GTE,
+    COND_OP_LTE,
+    COND_OP_ADD,
+    COND_OP_SUB,
+    COND_OP_MUL,
+    COND_OP_DIV,
+    COND_OP_BINARY_AND,
+    COND_OP_BINARY_OR
+};
+
+typedef struct mon_cond_insn_s {
+    int op;
+    int value;
+    int arg;
+} mon_cond_insn_t;
+
+struct mon_cond_program_s {
+    mon_cond_insn_t *code;
+    unsigned int len;
+    unsigned int size;
+    unsigned int max_depth;
+    bool uses_memory;
+};
+
+
+/* *** COMPILER *** */
+
+
+static int emit(mon_cond_program_t *prog, int op, int value, int arg)
+{
+    if (prog->len == prog->size) {
+        prog->size = prog->size ? prog->size * 2 : 16;
+        prog->code = lib_realloc(prog->code, prog->size * sizeof(mon_cond_insn_t));
+    }
+    prog->code[prog->len].op = op;
+    prog->code[prog->len].value = value;
+    prog->code[prog->len].arg = arg;
+    return (int)prog->len++;
+}
+
+/* map a CONDITIONAL operator to its opcode, -1 for the logical operators */
+static int binary_opcode(int operation)
+{
+    switch (operation) {
+        case e_EQU:         return COND_OP_EQU;
+        case e_NEQ:         return COND_OP_NEQ;
+        case e_GT:          return COND_OP_GT;
+        case e_LT:          return COND_OP_LT;
+        case e_GTE:         return COND_OP_GTE;
+        case e_LTE:         return COND_OP_LTE;
+        case e_ADD:         return COND_OP_ADD;
+        case e_SUB:         return COND_OP_SUB;
+        case e_MUL:         return COND_OP_MUL;
+        case e_DIV:         return COND_OP_DIV;
+        case e_BINARY_AND:  return COND_OP_BINARY_AND;
+        case e_BINARY_OR:   return COND_OP_BINARY_OR;
+        default:
+            break;
+    }
+    return -1;
+}
+
+/* returns true if the subtree does not depend on machine state */
+static bool is_constant(const cond_node_t *cnode)
+{
+    if (cnode->operation != e_INV) {
+        return cnode->child1 != NULL && cnode->child2 != NULL
+               && is_constant(cnode->child1) && is_constant(cnode->child2);
+    }
+    return !cnode->is_reg && cnode->banknum < 0;
+}
+
+/* fold a constant subtree, returns false if it can not be done at compile time */
+static bool fold_constant(const cond_node_t *cnode, int *result)
+{
+    int v1, v2;
+
+    if (cnode->operation == e_INV) {
+        *result = cnode->value;
+        return true;
+    }
+    if (!fold_constant(cnode->child1, &v1) || !fold_constant(cnode->child2, &v2)) {
+        return false;
+    }
+
+    switch (cnode->operation) {
+        case e_EQU:         *result = (v1 == v2); break;
+        case e_NEQ:         *result = (v1 != v2); break;
+        case e_GT:          *result = (v1 > v2); break;
+        case e_LT:          *result = (v1 < v2); break;
+        case e_GTE:         *result = (v1 >= v2); break;
+        case e_LTE:         *result = (v1 <= v2); break;
+        case e_LOGICAL_AND: *result = (v1 && v2); break;
+        case e_LOGICAL_OR:  *result = (v1 || v2); break;
+        case e_ADD:         *result = (v1 + v2); break;
+        case e_SUB:         *result = (v1 - v2); break;
+        case e_MUL:         *result = (v1 * v2); break;
+        case e_BINARY_AND:  *result = (v1 & v2); break;
+        case e_BINARY_OR:   *result = (v1 | v2); break;
+        case e_DIV:
+            /* leave the error reporting to run time */
+            if (v2 == 0) {
+                return false;
+            }
+            *result = (v1 / v2);
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static void push_depth(mon_cond_program_t *prog, unsigned int depth)
+{
+    if (depth > prog->max_depth) {
+        prog->max_depth = depth;
+    }
+}
+
+/* compile `cnode` with `depth` values already on the stack */
+static bool compile_node(mon_cond_program_t *prog, const cond_node_t *cnode, unsigned int depth)
+{
+    int value, jump;
+
+    if (cnode->operation != e_INV) {
+        if (!(cnode->child1 && cnode->child2)) {
+            return false;
+        }
+
+        if (is_constant(cnode) && fold_constant(cnode, &value)) {
+            emit(prog, COND_OP_CONST, value, 0);
+            push_depth(prog, depth + 1);
+            return true;
+        }
+
+        if (cnode->operation == e_LOGICAL_AND || cnode->operation == e_LOGICAL_OR) {
+            if (!compile_node(prog, cnode->child1, depth)) {
+                return false;
+            }
+            jump = emit(prog, (cnode->operation == e_LOGICAL_AND) ?
+                        COND_OP_AND_JUMP : COND_OP_OR_JUMP, 0, 0);
+            if (!compile_node(prog, cnode->child2, depth)) {
+                return false;
+            }
+            emit(prog, COND_OP_BOOL, 0, 0);
+            prog->code[jump].value = (int)prog->len;
+            return true;
+        }
+
+        if (binary_opcode(cnode->operation) < 0) {
+            return false;
+        }
+        if (!compile_node(prog, cnode->child1, depth)
+            || !compile_node(prog, cnode->child2, depth + 1)) {
+            return false;
+        }
+        emit(prog, binary_opcode(cnode->operation), 0, 0);
+        return true;
+    }
+
+    if (cnode->is_reg) {
+        switch (reg_regid(cnode->reg_num)) {
+            case e_Rasterline:
+                emit(prog, COND_OP_RASTERLINE, 0, 0);
+                break;
+            case e_Cycle:
+                emit(prog, COND_OP_CYCLE, 0, 0);
+                break;
+            case e_PC:
+                emit(prog, COND_OP_PC, 0, 0);
+                break;
+            default:
+                emit(prog, COND_OP_REG, (int)reg_regid(cnode->reg_num),
+                     (int)reg_memspace(cnode->reg_num));
+                break;
+        }
+    } else if (cnode->banknum >= 0) {
+        prog->uses_memory = true;
+        if (cnode->child1 != NULL) {
+            if (!compile_node(prog, cnode->child1, depth)) {
+                return false;
+            }
+            emit(prog, COND_OP_MEM_IND, 0, cnode->banknum);
+        } else {
+            emit(prog, COND_OP_MEM, (int)addr_location(cnode->value), cnode->banknum);
+        }
+    } else {
+        emit(prog, COND_OP_CONST, cnode->value, 0);
+    }
+    push_depth(prog, depth + 1);
+    return true;
+}
+
+/** \brief  Compile a condition tree
+ *
+ * \param[in]   cnode   condition tree
+ *
+ * \return  compiled program, or NULL if the tree has to be interpreted
+ */
+mon_cond_program_t *mon_condition_compile(cond_node_t *cnode)
+{
+    mon_cond_program_t *prog;
+
+    if (cnode == NULL) {
+        return NULL;
+    }
+
+    prog = lib_calloc(1, sizeof(mon_cond_program_t));
+
+    if (!compile_node(prog, cnode, 0) || prog->max_depth > MON_COND_STACK_SIZE) {
+        DBG(("mon_condition_compile: falling back to the interpreter"));
+        mon_condition_free(prog);
+        return NULL;
+    }
+
+    DBG(("mon_condition_compile: %u instructions, stack depth %u",
+         prog->len, prog->max_depth));
+    return prog;
+}
+
+/** \brief  Free a compiled condition
+ *
+ * \param[in]   prog    compiled program (can be NULL)
+ */
+void mon_condition_free(mon_cond_program_t *prog)
+{
+    if (prog != NULL) {
+        lib_free(prog->code);
+        lib_free(prog);
+    }
+}
+
+
+/* *** EVALUATION *** */
+
+
+/** \brief  Evaluate a compiled condition
+ *
+ * Gives the same result as mon_evaluate_conditional() on the tree the
+ * program was compiled from.
+ *
+ * \param[in]   prog            compiled program
+ * \param[in]   effective_pc    value used for the PC register
+ *
+ * \return  value of the condition
+ */
+int mon_condition_evaluate(mon_cond_program_t *prog, unsigned int effective_pc)
+{
+    int stack[MON_COND_STACK_SIZE];
+    int sp = -1;
+    unsigned int ip = 0;
+    unsigned int line, cycle;
+    int half_cycle;
+    int old_sidefx = sidefx;
+    const mon_cond_insn_t *insn;
+
+    /* make sure memory operands are peeked, not read */
+    if (prog->uses_memory) {
+        sidefx = 0;
+    }
+
+    while (ip < prog->len) {
+        insn = &prog->code[ip++];
+        switch (insn->op) {
+            case COND_OP_CONST:
+                stack[++sp] = insn->value;
+                break;
+            case COND_OP_REG:
+                stack[++sp] = (int)(monitor_cpu_for_memspace[insn->arg]->mon_register_get_val)
+                                  (insn->arg, insn->value);
+                break;
+            case COND_OP_RASTERLINE:
+                mon_interfaces[e_comp_space]->get_line_cycle(&line, &cycle, &half_cycle);
+                stack[++sp] = (int)line;
+                break;
+            case COND_OP_CYCLE:
+                mon_interfaces[e_comp_space]->get_line_cycle(&line, &cycle, &half_cycle);
+                stack[++sp] = (int)cycle;
+                break;
+            case COND_OP_PC:
+                stack[++sp] = (int)addr_mask(effective_pc);
+                break;
+            case COND_OP_MEM:
+                stack[++sp] = mon_get_mem_val_ex(e_comp_space, insn->arg,
+                                                 (uint16_t)insn->value);
+                break;
+            case COND_OP_MEM_IND:
+                stack[sp] = mon_get_mem_val_ex(e_comp_space, insn->arg,
+                                               (uint16_t)stack[sp]);
+                break;
+            case COND_OP_AND_JUMP:
+                if (stack[sp] == 0) {
+                    ip = (unsigned int)insn->value;
+                } else {
+                    sp--;
+                }
+                break;
+            case COND_OP_OR_JUMP:
+                if (stack[sp] != 0) {
+                    stack[sp] = 1;
+                    ip = (unsigned int)insn->value;
+                } else {
+                    sp--;
+                }
+                break;
+            case COND_OP_BOOL:
+                stack[sp] = (stack[sp] != 0);
+                break;
+            case COND_OP_EQU:
+                sp--;
+                stack[sp] = (stack[sp] == stack[sp + 1]);
+                break;
+            case COND_OP_NEQ:
+                sp--;
+                stack[sp] = (stack[sp] != stack[sp + 1]);
+                break;
+            case COND_OP_GT:
+                sp--;
+                stack[sp] = (stack[sp] > stack[sp + 1]);
+                break;
+            case COND_OP_LT:
+                sp--;
+                stack[sp] = (stack[sp] < stack[sp + 1]);
+                break;
+            case COND_OP_GTE:
+                sp--;
+                stack[sp] = (stack[sp] >= stack[sp + 1]);
+                break;
+            case COND_OP_LTE:
+                sp--;
+                stack[sp] = (stack[sp] <= stack[sp + 1]);
+                break;
+            case COND_OP_ADD:
+                sp--;
+                stack[sp] = stack[sp] + stack[sp + 1];
+                break;
+            case COND_OP_SUB:
+                sp--;
+                stack[sp] = stack[sp] - stack[sp + 1];
+                break;
+            case COND_OP_MUL:
+                sp--;
+                stack[sp] = stack[sp] * stack[sp + 1];
+                break;
+            case COND_OP_DIV:
+                sp--;
+                if (stack[sp + 1] == 0) {
+                    log_error(LOG_DEFAULT, "Division by zero in conditional\n");
+                    stack[sp] = 0;
+                } else {
+                    stack[sp] = stack[sp] / stack[sp + 1];
+                }
+                break;
+            case COND_OP_BINARY_AND:
+                sp--;
+                stack[sp] = stack[sp] & stack[sp + 1];
+                break;
+            case COND_OP_BINARY_OR:
+                sp--;
+                stack[sp] = stack[sp] | stack[sp + 1];
+                break;
+            default:
+                log_error(LOG_DEFAULT, "Unexpected conditional opcode: %d\n", insn->op);
+                sidefx = old_sidefx;
+                return 0;
+        }
+    }
+
+    sidefx = old_sidefx;
+    return stack[0];
+}
+
+
+/* *** MONITOR COMMAND *** */
+
+
+/** \brief  Time the evaluation of a checkpoint condition
+ *
+ * Evaluates the condition of checkpoint \a brk_num \a count times, both by
+ * walking the tree and by running the compiled program, and prints how long
+ * each took.
+ *
+ * \param[in]   brk_num checkpoint number
+ * \param[in]   count   number of evaluations (defaults to 1000000 if <= 0)
+ */
+void mon_condition_time(int brk_num, int count)
+{
+    mon_checkpoint_t *cp;
+    MEMSPACE mem;
+    unsigned int pc;
+    tick_t start, interpreted, compiled;
+    int i, result_i = 0, result_c = 0;
+
+    cp = mon_breakpoint_find_checkpoint(brk_num);
+    if (cp == NULL) {
+        mon_out("#%d not a valid checkpoint\n", brk_num);
+        return;
+    }
+    if (cp->condition == NULL) {
+        mon_out("Checkpoint %d has no condition\n", brk_num);
+        return;
+    }
+    if (count <= 0) {
+        count = 1000000;
+    }
+
+    mem = addr_memspace(cp->start_addr);
+    pc = new_addr(mem, (monitor_cpu_for_memspace[mem]->mon_register_get_val)(mem, e_PC));
+
+    start = tick_now();
+    for (i = 0; i < count; i++) {
+        result_i = mon_evaluate_conditional(cp->condition, pc);
+    }
+    interpreted = tick_now_delta(start);
+
+    if (cp->compiled_condition == NULL) {
+        mon_out("Interpreted: %d evaluations in %u ms (result %d), condition is not compiled\n",
+                count, TICK_TO_MILLI(interpreted), result_i);
+        return;
+    }
+
+    start = tick_now();
+    for (i = 0; i < count; i++) {
+        result_c = mon_condition_evaluate(cp->compiled_condition, pc);
+    }
+    compiled = tick_now_delta(start);
+
+    mon_out("Interpreted: %d evaluations in %u ms (result %d)\n",
+            count, TICK_TO_MILLI(interpreted), result_i);
+    mon_out("Compiled:    %d evaluations in %u ms (result %d), %u instructions\n",
+            count, TICK_TO_MILLI(compiled), result_c, cp->compiled_condition->len);
+    if (compiled > 0) {
+        mon_out("Speedup:     %.2fx\n", (double)interpreted / (double)compiled);
+    }
+    if (result_i != result_c) {
+        mon_out("Warning: results differ!\n");
+    }
+}
@@ -54,6 +54,7 @@ char *alloca();
 #include "lib.h"
 #include "machine.h"
 #include "mon_breakpoint.h"
+#include "mon_condition.h"
 #include "mon_command.h"
 #include "mon_disassemble.h"
 #include "mon_drive.h"
@@ -141,7 +142,7 @@ void set_yydebug(int val);
 %token CMD_LOAD CMD_BASICLOAD CMD_SAVE CMD_VERIFY CMD_BVERIFY CMD_IGNORE CMD_HUNT CMD_FILL CMD_MOVE
 %token CMD_GOTO CMD_REGISTERS CMD_READSPACE CMD_WRITESPACE CMD_RADIX
 %token CMD_MEM_DISPLAY CMD_BREAK CMD_TRACE CMD_IO CMD_BRMON CMD_COMPARE
-%token CMD_DUMP CMD_UNDUMP CMD_EXIT CMD_DELETE CMD_CONDITION CMD_COMMAND
+%token CMD_DUMP CMD_UNDUMP CMD_EXIT CMD_DELETE CMD_CONDITION CMD_CONDITION_TIME CMD_COMMAND
 %token CMD_ASSEMBLE CMD_DISASSEMBLE CMD_NEXT CMD_STEP CMD_PRINT CMD_DEVICE
 %token CMD_HELP CMD_WATCH CMD_DISK CMD_QUIT CMD_CHDIR CMD_BANK
 %token CMD_LOAD_LABELS CMD_SAVE_LABELS CMD_ADD_LABEL CMD_DEL_LABEL CMD_SHOW_LABELS CMD_CLEAR_LABELS
@@ -458,6 +459,10 @@ checkpoint_control_rules: CMD_CHECKPT_ON checkpt_num end_cmd
                           { mon_breakpoint_delete_checkpoint(-1); }
                         | CMD_CONDITION checkpt_num IF cond_expr end_cmd
                           { mon_breakpoint_set_checkpoint_condition($2, $4); }
+                        | CMD_CONDITION_TIME checkpt_num end_cmd
+                          { mon_condition_time($2, -1); }
+                        | CMD_CONDITION_TIME checkpt_num opt_sep expression end_cmd
+                          { mon_condition_time($2, $4); }
                         | CMD_COMMAND checkpt_num opt_sep STRING end_cmd
                           { mon_breakpoint_set_checkpoint_command($2, $4); }
                         | CMD_COMMAND checkpt_num error end_cmd
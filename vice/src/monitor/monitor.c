@@ -2422,6 +2422,22 @@ char *mon_symbol_table_lookup_name(MEMSPACE mem, uint16_t addr)
     return NULL;
 }
 
+/* call func for every label of the given memspace */
+void monitor_label_foreach(MEMSPACE mem, monitor_label_func_t *func, void *param)
+{
+    symbol_entry_t *sym_ptr;
+
+    if (mem == e_default_space) {
+        mem = default_memspace;
+    }
+
+    sym_ptr = monitor_labels[mem].name_list;
+    while (sym_ptr) {
+        func(sym_ptr->addr, sym_ptr->name, param);
+        sym_ptr = sym_ptr->next;
+    }
+}
+
 /* look up a symbol in the given memspace, returns address or -1 on error */
 int mon_symbol_table_lookup_addr(MEMSPACE mem, char *name)
 {
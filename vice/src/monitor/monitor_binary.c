@@ -36,6 +36,7 @@
 #include "archdep_defs.h"
 #include "cmdline.h"
 #include "drive.h"
+#include "frametiming.h"
 #include "interrupt.h"
 #include "lib.h"
 #include "log.h"
@@ -49,6 +50,7 @@
 #include "vicesocket.h"
 #include "machine.h"
 #include "screenshot.h"
+#include "screenshot-compare.h"
 #include "machine-video.h"
 #include "palette.h"
 
@@ -112,6 +114,8 @@ enum t_binary_command {
     e_MON_CMD_DISPLAY_GET = 0x84,
     e_MON_CMD_VICE_INFO = 0x85,
     e_MON_CMD_CPUHISTORY_GET = 0x86,
+    e_MON_CMD_FRAMETIMING_GET = 0x87,
+    e_MON_CMD_DISPLAY_COMPARE = 0x88,
 
     e_MON_CMD_PALETTE_GET = 0x91,
 
@@ -161,6 +165,8 @@ enum t_binary_response {
     e_MON_RESPONSE_DISPLAY_GET = 0x84,
     e_MON_RESPONSE_VICE_INFO = 0x85,
     e_MON_RESPONSE_CPUHISTORY_GET = 0x86,
+    e_MON_RESPONSE_FRAMETIMING_GET = 0x87,
+    e_MON_RESPONSE_DISPLAY_COMPARE = 0x88,
 
     e_MON_RESPONSE_PALETTE_GET = 0x91,
 
@@ -1628,6 +1634,103 @@ static void monitor_binary_process_cpuhistory(binary_command_t *command)
 }
 #endif /* FEATURE_CPUMEMHISTORY */
 
+static void monitor_binary_process_frametiming_get(binary_command_t *command)
+{
+    frametiming_frame_t *frames;
+    unsigned char *response;
+    unsigned char *response_cursor;
+    uint32_t requested_count;
+    uint32_t response_size;
+    unsigned int count;
+    unsigned int i;
+    int j;
+
+    if (command->length < 4) {
+        monitor_binary_error(e_MON_ERR_CMD_INVALID_LENGTH, command->request_id);
+        return;
+    }
+
+    requested_count = little_endian_to_uint32(command->body);
+    if (requested_count > FRAMETIMING_RING_SIZE) {
+        requested_count = FRAMETIMING_RING_SIZE;
+    }
+
+    frames = lib_malloc(sizeof(frametiming_frame_t) * (requested_count + 1));
+    count = frametiming_get_frames(frames, requested_count);
+
+    response_size = 5 + count * (8 + FRAMETIMING_NUM * 4);
+    response = lib_malloc(response_size);
+    response_cursor = response;
+
+    response_cursor = write_uint32(count, response_cursor);
+    *response_cursor = FRAMETIMING_NUM;
+    ++response_cursor;
+
+    for (i = 0; i < count; i++) {
+        response_cursor = write_uint32(frames[i].frame, response_cursor);
+        response_cursor = write_uint32(frames[i].total, response_cursor);
+        for (j = 0; j < FRAMETIMING_NUM; j++) {
+            response_cursor = write_uint32(frames[i].time[j], response_cursor);
+        }
+    }
+
+    monitor_binary_response(response_size, e_MON_RESPONSE_FRAMETIMING_GET, e_MON_ERR_OK, command->request_id, response);
+
+    lib_free(response);
+    lib_free(frames);
+}
+
+static void monitor_binary_process_display_compare(binary_command_t *command)
+{
+    screenshot_compare_result_t result;
+    struct video_canvas_s *canvas;
+    unsigned char *body = command->body;
+    unsigned char response[17];
+    unsigned char *response_cursor = response;
+    uint8_t use_vic;
+    uint8_t filename_length;
+    unsigned char *filename = &body[2];
+
+    if (command->length < 2) {
+        monitor_binary_error(e_MON_ERR_CMD_INVALID_LENGTH, command->request_id);
+        return;
+    }
+
+    use_vic = !!body[0];
+    filename_length = body[1];
+
+    if (command->length < 2 + filename_length) {
+        monitor_binary_error(e_MON_ERR_CMD_INVALID_LENGTH, command->request_id);
+        return;
+    }
+
+    /* This should be changed later if other fields are added after it */
+    filename[filename_length] = '\0';
+
+    if (machine_class == VICE_MACHINE_C128 && use_vic) {
+        canvas = machine_video_canvas_get(1);
+    } else {
+        canvas = machine_video_canvas_get(0);
+    }
+
+    if (screenshot_compare(canvas, (char *)filename, &result) < 0) {
+        monitor_binary_error(e_MON_ERR_CMD_FAILURE, command->request_id);
+        return;
+    }
+
+    *response_cursor = (unsigned char)result.differs;
+    ++response_cursor;
+    response_cursor = write_uint32(result.pixels, response_cursor);
+    response_cursor = write_uint16(result.x1, response_cursor);
+    response_cursor = write_uint16(result.y1, response_cursor);
+    response_cursor = write_uint16(result.x2, response_cursor);
+    response_cursor = write_uint16(result.y2, response_cursor);
+    response_cursor = write_uint16(result.width, response_cursor);
+    write_uint16(result.height, response_cursor);
+
+    monitor_binary_response(sizeof response, e_MON_RESPONSE_DISPLAY_COMPARE, e_MON_ERR_OK, command->request_id, response);
+}
+
 static void monitor_binary_process_mem_get(binary_command_t *command)
 {
     unsigned char *response;
@@ -1847,6 +1950,10 @@ static void monitor_binary_process_command(unsigned char * pbuffer)
         monitor_binary_process_vice_info(&command);
     } else if (command_type == e_MON_CMD_CPUHISTORY_GET) {
         monitor_binary_process_cpuhistory(&command);
+    } else if (command_type == e_MON_CMD_FRAMETIMING_GET) {
+        monitor_binary_process_frametiming_get(&command);
+    } else if (command_type == e_MON_CMD_DISPLAY_COMPARE) {
+        monitor_binary_process_display_compare(&command);
 
     } else if (command_type == e_MON_CMD_EXIT) {
         monitor_binary_process_exit(&command);
@@ -30,6 +30,7 @@
 
 #include <string.h>
 
+#include "lib.h"
 #include "raster-cache-fill.h"
 #include "raster-cache-fill-1fff.h"
 #include "raster-cache-nibbles.h"
@@ -105,6 +106,130 @@ static uint8_t *const aligned_line_buffer = (uint8_t *)_aligned_line_buffer;
 
 /*-----------------------------------------------------------------------*/
 
+/* The uncached draw functions remember what each raster line was drawn
+   from: the graphics bytes fetched for the line (after blink, cursor and
+   reverse handling), the video matrix and color (including luminance)
+   bytes, and the background colors.  If none of it has changed since the
+   line was last drawn, the pixels in the draw buffer are still valid and
+   the line is not drawn again.  */
+typedef struct ted_line_cache_s {
+    uint8_t *gfx_ptr;           /* where the line was drawn, NULL = invalid */
+    unsigned int mode;
+    int display_xstart;
+    int display_xstop;
+    int colors[4];              /* background and extended background colors */
+    uint8_t data[TED_SCREEN_TEXTCOLS];
+    uint8_t vbuf[TED_SCREEN_TEXTCOLS];
+    uint8_t cbuf[TED_SCREEN_TEXTCOLS];
+} ted_line_cache_t;
+
+static ted_line_cache_t *line_cache = NULL;
+static unsigned int line_cache_size = 0;
+
+/* Graphics bytes of the current line, filled by the fetch functions */
+static uint8_t line_data[TED_SCREEN_TEXTCOLS];
+
+/* Compare the current line with what it was drawn from last time, and
+   remember it.  Returns non-zero if the line must be drawn.  */
+static int line_cache_update(unsigned int mode)
+{
+    ted_line_cache_t *line;
+    raster_cache_t *cache;
+    unsigned int current_line = ted.raster.current_line;
+    int changed = 0;
+
+    if (current_line >= line_cache_size) {
+        line_cache = lib_realloc(line_cache, (current_line + 1) * sizeof(ted_line_cache_t));
+        memset(line_cache + line_cache_size, 0,
+               (current_line + 1 - line_cache_size) * sizeof(ted_line_cache_t));
+        line_cache_size = current_line + 1;
+    }
+    line = &line_cache[current_line];
+
+    /* The line has been blanked or drawn by other code since */
+    cache = &ted.raster.cache[current_line];
+    if (cache->is_dirty || cache->blank) {
+        changed = 1;
+    }
+
+    if (changed
+        || line->gfx_ptr != GFX_PTR()
+        || line->mode != mode
+        || line->display_xstart != ted.raster.display_xstart
+        || line->display_xstop != ted.raster.display_xstop
+        || line->colors[0] != (int)ted.raster.background_color
+        || line->colors[1] != ted.ext_background_color[0]
+        || line->colors[2] != ted.ext_background_color[1]
+        || line->colors[3] != ted.ext_background_color[2]) {
+        line->gfx_ptr = GFX_PTR();
+        line->mode = mode;
+        line->display_xstart = ted.raster.display_xstart;
+        line->display_xstop = ted.raster.display_xstop;
+        line->colors[0] = (int)ted.raster.background_color;
+        line->colors[1] = ted.ext_background_color[0];
+        line->colors[2] = ted.ext_background_color[1];
+        line->colors[3] = ted.ext_background_color[2];
+        changed = 1;
+    }
+    if (memcmp(line->data, line_data, TED_SCREEN_TEXTCOLS) != 0) {
+        memcpy(line->data, line_data, TED_SCREEN_TEXTCOLS);
+        changed = 1;
+    }
+    if (memcmp(line->vbuf, ted.vbuf, TED_SCREEN_TEXTCOLS) != 0) {
+        memcpy(line->vbuf, ted.vbuf, TED_SCREEN_TEXTCOLS);
+        changed = 1;
+    }
+    if (memcmp(line->cbuf, ted.cbuf, TED_SCREEN_TEXTCOLS) != 0) {
+        memcpy(line->cbuf, ted.cbuf, TED_SCREEN_TEXTCOLS);
+        changed = 1;
+    }
+    return changed;
+}
+
+/* Forget what the current raster line was drawn from */
+static void line_cache_invalidate_line(void)
+{
+    if (ted.raster.current_line < line_cache_size) {
+        line_cache[ted.raster.current_line].gfx_ptr = NULL;
+    }
+}
+
+/* Forget the contents of all lines, e.g. after the geometry changed */
+void ted_draw_invalidate_lines(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < line_cache_size; i++) {
+        line_cache[i].gfx_ptr = NULL;
+    }
+}
+
+/* Fetch the character data of the current line, `mask' selects the bits of
+   the video matrix byte used as the character code */
+static void fetch_char_data(uint8_t mask)
+{
+    uint8_t *char_ptr;
+    unsigned int i;
+
+    char_ptr = ted.chargen_ptr + ted.raster.ycounter;
+    for (i = 0; i < TED_SCREEN_TEXTCOLS; i++) {
+        line_data[i] = char_ptr[(ted.vbuf[i] & mask) * 8];
+    }
+}
+
+/* Fetch the bitmap data of the current line */
+static void fetch_bitmap_data(void)
+{
+    unsigned int i, j;
+
+    for (j = ((ted.memptr << 3) + ted.raster.ycounter) & 0x1fff, i = 0;
+         i < TED_SCREEN_TEXTCOLS; i++, j = (j + 8) & 0x1fff) {
+        line_data[i] = ted.bitmap_ptr[j];
+    }
+}
+
+/*-----------------------------------------------------------------------*/
+
 inline static uint8_t get_char_data(uint8_t c, uint8_t col, int l, uint8_t *char_mem,
                                  int bytes_per_char, int curpos, int index)
 {
@@ -231,14 +356,12 @@ static int get_std_text(raster_cache_t *cache, unsigned int *xs,
 }
 
 /* without video cache */
-inline static void _draw_std_text(uint8_t *p, unsigned int xs, unsigned int xe)
+static void fetch_std_text(void)
 {
-    uint32_t *table_ptr;
     uint8_t *char_ptr;
     unsigned int i;
     int cursor_pos = -1;
 
-    table_ptr = hr_table + (ted.raster.background_color << 4);
     char_ptr = ted.chargen_ptr + ted.raster.ycounter;
 
     if (ted.cursor_visible) {
@@ -249,9 +372,8 @@ inline static void _draw_std_text(uint8_t *p, unsigned int xs, unsigned int xe)
     }
 
     if (ted.reverse_mode) {
-        for (i = xs; i <= xe; i++) {
+        for (i = 0; i < TED_SCREEN_TEXTCOLS; i++) {
             int d;
-            uint32_t *ptr = table_ptr + ((ted.cbuf[i] & 0x7f) << 11);
 
             if ((ted.cbuf[i] & 0x80) && (!ted.cursor_visible)) {
                 d = 0;
@@ -261,13 +383,11 @@ inline static void _draw_std_text(uint8_t *p, unsigned int xs, unsigned int xe)
             if ((int)i == cursor_pos) {
                 d ^= 0xff;
             }
-            *((uint32_t *)p + i * 2) = *(ptr + (d >> 4));
-            *((uint32_t *)p + i * 2 + 1) = *(ptr + (d & 0xf));
+            line_data[i] = (uint8_t)d;
         }
     } else {
-        for (i = xs; i <= xe; i++) {
+        for (i = 0; i < TED_SCREEN_TEXTCOLS; i++) {
             int d;
-            uint32_t *ptr = table_ptr + ((ted.cbuf[i] & 0x7f) << 11);
 
             if ((ted.cbuf[i] & 0x80) && (!ted.cursor_visible)) {
                 d = (ted.vbuf[i] & 0x80 ? 0xff : 0x00);
@@ -278,15 +398,33 @@ inline static void _draw_std_text(uint8_t *p, unsigned int xs, unsigned int xe)
             if ((int)i == cursor_pos) {
                 d ^= 0xff;
             }
-            *((uint32_t *)p + i * 2) = *(ptr + (d >> 4));
-            *((uint32_t *)p + i * 2 + 1) = *(ptr + (d & 0xf));
+            line_data[i] = (uint8_t)d;
         }
     }
 }
 
+inline static void _draw_std_text(uint8_t *p, unsigned int xs, unsigned int xe)
+{
+    uint32_t *table_ptr;
+    unsigned int i;
+
+    table_ptr = hr_table + (ted.raster.background_color << 4);
+
+    for (i = xs; i <= xe; i++) {
+        int d = line_data[i];
+        uint32_t *ptr = table_ptr + ((ted.cbuf[i] & 0x7f) << 11);
+
+        *((uint32_t *)p + i * 2) = *(ptr + (d >> 4));
+        *((uint32_t *)p + i * 2 + 1) = *(ptr + (d & 0xf));
+    }
+}
+
 static void draw_std_text(void)
 {
-    ALIGN_DRAW_FUNC(_draw_std_text, 0, TED_SCREEN_TEXTCOLS - 1);
+    fetch_std_text();
+    if (line_cache_update(TED_NORMAL_TEXT_MODE)) {
+        ALIGN_DRAW_FUNC(_draw_std_text, 0, TED_SCREEN_TEXTCOLS - 1);
+    }
 }
 
 /* with video cache */
@@ -321,6 +459,7 @@ inline static void _draw_std_text_cached(uint8_t *p, unsigned int xs,
 static void draw_std_text_cached(raster_cache_t *cache, unsigned int xs,
                                  unsigned int xe)
 {
+    line_cache_invalidate_line();
     ALIGN_DRAW_FUNC_CACHE(_draw_std_text_cached, xs, xe, cache);
 }
 
@@ -461,7 +600,10 @@ inline static void _draw_hires_bitmap(uint8_t *p, unsigned int xs,
 
 static void draw_hires_bitmap(void)
 {
-    ALIGN_DRAW_FUNC(_draw_hires_bitmap, 0, TED_SCREEN_TEXTCOLS - 1);
+    fetch_bitmap_data();
+    if (line_cache_update(TED_HIRES_BITMAP_MODE)) {
+        ALIGN_DRAW_FUNC(_draw_hires_bitmap, 0, TED_SCREEN_TEXTCOLS - 1);
+    }
 
     /* Overscan color in HIRES is determined by last char of previous line */
     ted.raster.idle_background_color = ted.vbuf[TED_SCREEN_TEXTCOLS - 1] & 0x7f;
@@ -470,6 +612,7 @@ static void draw_hires_bitmap(void)
 static void draw_hires_bitmap_cached(raster_cache_t *cache, unsigned int xs,
                                      unsigned int xe)
 {
+    line_cache_invalidate_line();
     ALIGN_DRAW_FUNC(_draw_hires_bitmap, xs, xe);
 
     /* Overscan color in HIRES is determined by last char of previous line */
@@ -551,12 +694,16 @@ inline static void _draw_mc_text(uint8_t *p, unsigned int xs, unsigned int xe)
 
 static void draw_mc_text(void)
 {
-    ALIGN_DRAW_FUNC(_draw_mc_text, 0, TED_SCREEN_TEXTCOLS - 1);
+    fetch_char_data(ted.reverse_mode ? 0xff : 0x7f);
+    if (line_cache_update(TED_MULTICOLOR_TEXT_MODE)) {
+        ALIGN_DRAW_FUNC(_draw_mc_text, 0, TED_SCREEN_TEXTCOLS - 1);
+    }
 }
 
 static void draw_mc_text_cached(raster_cache_t *cache, unsigned int xs,
                                 unsigned int xe)
 {
+    line_cache_invalidate_line();
     ALIGN_DRAW_FUNC(_draw_mc_text, xs, xe);
 }
 
@@ -701,12 +848,16 @@ inline static void _draw_mc_bitmap(uint8_t *p, unsigned int xs, unsigned int xe)
 
 static void draw_mc_bitmap(void)
 {
-    ALIGN_DRAW_FUNC(_draw_mc_bitmap, 0, TED_SCREEN_TEXTCOLS - 1);
+    fetch_bitmap_data();
+    if (line_cache_update(TED_MULTICOLOR_BITMAP_MODE)) {
+        ALIGN_DRAW_FUNC(_draw_mc_bitmap, 0, TED_SCREEN_TEXTCOLS - 1);
+    }
 }
 
 static void draw_mc_bitmap_cached(raster_cache_t *cache, unsigned int xs,
                                   unsigned int xe)
 {
+    line_cache_invalidate_line();
     ALIGN_DRAW_FUNC(_draw_mc_bitmap, xs, xe);
 }
 
@@ -801,12 +952,16 @@ inline static void _draw_ext_text(uint8_t *p, unsigned int xs, unsigned int xe)
 
 static void draw_ext_text(void)
 {
-    ALIGN_DRAW_FUNC(_draw_ext_text, 0, TED_SCREEN_TEXTCOLS - 1);
+    fetch_char_data(0x3f);
+    if (line_cache_update(TED_EXTENDED_TEXT_MODE)) {
+        ALIGN_DRAW_FUNC(_draw_ext_text, 0, TED_SCREEN_TEXTCOLS - 1);
+    }
 }
 
 static void draw_ext_text_cached(raster_cache_t *cache, unsigned int xs,
                                  unsigned int xe)
 {
+    line_cache_invalidate_line();
     ALIGN_DRAW_FUNC(_draw_ext_text, xs, xe);
 }
 
@@ -858,6 +1013,8 @@ static void draw_black(void)
 {
     uint8_t *p;
 
+    line_cache_invalidate_line();
+
     p = GFX_PTR();
 
     memset(p, 0, TED_SCREEN_TEXTCOLS * 8);
@@ -868,6 +1025,8 @@ static void draw_black_cached(raster_cache_t *cache, unsigned int xs,
 {
     uint8_t *p;
 
+    line_cache_invalidate_line();
+
     p = GFX_PTR();
 
     memset(p, 0, TED_SCREEN_TEXTCOLS * 8);
@@ -908,6 +1067,8 @@ inline static void _draw_idle(unsigned int xs, unsigned int xe)
     uint8_t d = 0;
     unsigned int i;
 
+    line_cache_invalidate_line();
+
     if (!ted.raster.blank_enabled) {
         d = (uint8_t)ted.idle_data;
     }
@@ -1081,3 +1242,10 @@ void ted_draw_init(void)
 
     setup_modes();
 }
+
+void ted_draw_shutdown(void)
+{
+    lib_free(line_cache);
+    line_cache = NULL;
+    line_cache_size = 0;
+}
@@ -29,5 +29,7 @@
 #define VICE_TED_DRAW_H
 
 void ted_draw_init(void);
+void ted_draw_shutdown(void);
+void ted_draw_invalidate_lines(void);
 
 #endif
@@ -306,6 +306,7 @@ static void ted_set_geometry(void)
                         ted.screen_leftborderwidth - ted.screen_rightborderwidth + TED_RASTER_X(0)) /* extra offscreen border right */;
     ted.raster.geometry->pixel_aspect_ratio = ted_get_pixel_aspect();
     ted.raster.viewport->crt_type = ted_get_crt_type();
+    ted_draw_invalidate_lines();
 }
 
 static int init_raster(void)
@@ -858,6 +859,7 @@ void ted_raster_draw_alarm_handler(CLOCK offset, void *data)
 void ted_shutdown(void)
 {
     raster_shutdown(&ted.raster);
+    ted_draw_shutdown();
 }
 
 void ted_screenshot(screenshot_t *screenshot)
@@ -428,6 +428,27 @@ char *resources_write_item_to_string(const char *name, const char *delim)
     return NULL;
 }
 
+/* Return the values of all resources that are relevant for events (tagged
+   with RES_EVENT_SAME or RES_EVENT_STRICT), one per line. Resources that
+   differ in this list make the emulated machine behave differently. */
+char *resources_write_event_relevant_to_string(void)
+{
+    unsigned int i;
+    char *list;
+    char *line;
+
+    list = lib_strdup("");
+    for (i = 0; i < num_resources; i++) {
+        if (resources[i].event_relevant != RES_EVENT_NO) {
+            line = string_resource_item((int)i, "\n");
+            if (line != NULL) {
+                util_addline_free(&list, line);
+            }
+        }
+    }
+    return list;
+}
+
 static void resource_create_event_data(char **event_data, int *data_size,
                                        resource_ram_t *r,
                                        resource_value_t value)
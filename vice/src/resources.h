@@ -179,6 +179,7 @@ void resources_log_active(void);
 int resources_write_item_to_file(FILE *fp, const char *name);
 int resources_read_item_from_file(FILE *fp);
 char *resources_write_item_to_string(const char *name, const char *delim);
+char *resources_write_event_relevant_to_string(void);
 
 int resources_set_defaults(void);
 int resources_set_default_int(const char *name, int value);
@@ -0,0 +1,604 @@
+/*
+ * screenshot-compare.c - Compare frames with reference images.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* Screenshot based regression tests used to save a PNG of the screen and
+   compare it with a reference image outside of VICE. Here the visible area
+   of the draw buffer (the same area a screenshot contains) is compared with
+   reference images directly, which are loaded into memory only once.
+
+   References can be PNG files of any kind, like the ones saved as
+   screenshots, which are compared by color, or PGM files with palette
+   indices saved by the screenshot sequence recorder, which are compared
+   index by index.
+
+   screenshot_compare() compares the current frame with one reference file,
+   it is used by the binary monitor and keeps the last references in a small
+   cache. With "ScreenshotCompareName" set, all frames which have a reference
+   "<name>-<frame>.png" or "<name>-<frame>.pgm" (as saved by
+   "ScreenshotSequenceName") are compared, and the emulator quits with exit
+   code 1 at the first one that differs, or with 0 after the last one. */
+
+#include "vice.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_PNG
+#include <png.h>
+#endif
+
+#include "archdep.h"
+#include "cmdline.h"
+#include "lib.h"
+#include "log.h"
+#include "machine-video.h"
+#include "machine.h"
+#include "palette.h"
+#include "resources.h"
+#include "screenshot-compare.h"
+#include "screenshot.h"
+#include "types.h"
+#include "util.h"
+
+/* #define DEBUG_SCREENSHOT_COMPARE */
+
+#ifdef DEBUG_SCREENSHOT_COMPARE
+#define DBG(x) log_printf x
+#else
+#define DBG(x)
+#endif
+
+#define REFERENCE_CACHE_SIZE    16
+
+typedef struct reference_s {
+    char *path;
+    time_t mtime;
+    unsigned long frame;        /* frame number, for the sequence */
+    unsigned int width;
+    unsigned int height;
+    uint8_t *indices;           /* palette indices (PGM), or NULL */
+    uint32_t *colors;           /* colors as 0xRRGGBB (PNG), or NULL */
+    unsigned long used;
+} reference_t;
+
+static log_t compare_log = LOG_DEFAULT;
+
+static reference_t reference_cache[REFERENCE_CACHE_SIZE];
+static unsigned long reference_clock = 0;
+
+/* resources */
+static char *compare_name = NULL;
+
+/* reference sequence, sorted by frame */
+static int compare_running = 0;
+static reference_t *compare_refs = NULL;
+static int compare_num_refs = 0;
+static int compare_next;
+static unsigned long compare_frame_count;
+
+/* ------------------------------------------------------------------------- */
+
+static void reference_free(reference_t *ref)
+{
+    lib_free(ref->path);
+    lib_free(ref->indices);
+    lib_free(ref->colors);
+    memset(ref, 0, sizeof *ref);
+}
+
+/* skip white space and comments in a PGM header */
+static int pgm_skip(FILE *fd)
+{
+    int c;
+
+    for (;;) {
+        c = fgetc(fd);
+        if (c == '#') {
+            while (c != '\n' && c != EOF) {
+                c = fgetc(fd);
+            }
+        } else if (c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+            return c;
+        }
+    }
+}
+
+static int pgm_number(FILE *fd, unsigned int *value)
+{
+    int c = pgm_skip(fd);
+
+    if (c < '0' || c > '9') {
+        return -1;
+    }
+    *value = 0;
+    while (c >= '0' && c <= '9') {
+        if (*value > 0xffff) {
+            return -1;
+        }
+        *value = *value * 10 + (unsigned int)(c - '0');
+        c = fgetc(fd);
+    }
+    /* exactly one white space character follows the last number */
+    return (c == ' ' || c == '\t' || c == '\r' || c == '\n') ? 0 : -1;
+}
+
+static int load_pgm(FILE *fd, reference_t *ref)
+{
+    unsigned int maxval;
+    size_t size;
+
+    if (pgm_number(fd, &ref->width) < 0
+        || pgm_number(fd, &ref->height) < 0
+        || pgm_number(fd, &maxval) < 0
+        || maxval > 255 || ref->width == 0 || ref->height == 0) {
+        return -1;
+    }
+    size = (size_t)ref->width * ref->height;
+    ref->indices = lib_malloc(size);
+    if (fread(ref->indices, size, 1, fd) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+#ifdef HAVE_PNG
+static int load_png(FILE *fd, reference_t *ref)
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+    png_bytepp rows;
+    unsigned int x, y;
+
+    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (png_ptr == NULL) {
+        return -1;
+    }
+    info_ptr = png_create_info_struct(png_ptr);
+    if (info_ptr == NULL) {
+        png_destroy_read_struct(&png_ptr, NULL, NULL);
+        return -1;
+    }
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+        return -1;
+    }
+
+    png_init_io(png_ptr, fd);
+    png_set_sig_bytes(png_ptr, 8);
+    /* whatever the file contains, get 8 bit RGB */
+    png_read_png(png_ptr, info_ptr,
+                 PNG_TRANSFORM_EXPAND | PNG_TRANSFORM_STRIP_16
+                 | PNG_TRANSFORM_STRIP_ALPHA | PNG_TRANSFORM_GRAY_TO_RGB, NULL);
+
+    ref->width = png_get_image_width(png_ptr, info_ptr);
+    ref->height = png_get_image_height(png_ptr, info_ptr);
+    rows = png_get_rows(png_ptr, info_ptr);
+
+    ref->colors = lib_malloc((size_t)ref->width * ref->height * sizeof(uint32_t));
+    for (y = 0; y < ref->height; y++) {
+        const png_byte *p = rows[y];
+        uint32_t *dest = ref->colors + (size_t)y * ref->width;
+
+        for (x = 0; x < ref->width; x++) {
+            dest[x] = ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2];
+            p += 3;
+        }
+    }
+
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    return 0;
+}
+#endif
+
+static int reference_load(reference_t *ref, const char *path)
+{
+    uint8_t magic[8];
+    FILE *fd;
+    int result = -1;
+
+    memset(ref, 0, sizeof *ref);
+
+    fd = fopen(path, MODE_READ);
+    if (fd == NULL) {
+        log_error(compare_log, "Cannot open reference `%s'.", path);
+        return -1;
+    }
+    if (fread(magic, 1, 2, fd) == 2 && magic[0] == 'P' && magic[1] == '5') {
+        result = load_pgm(fd, ref);
+#ifdef HAVE_PNG
+    } else if (fread(magic + 2, 1, 6, fd) == 6 && png_sig_cmp(magic, 0, 8) == 0) {
+        result = load_png(fd, ref);
+#endif
+    }
+    fclose(fd);
+
+    if (result < 0) {
+        log_error(compare_log, "Cannot read reference `%s'.", path);
+        reference_free(ref);
+        return -1;
+    }
+    ref->path = lib_strdup(path);
+    archdep_stat_mtime(path, &ref->mtime);
+    DBG(("screenshot_compare: loaded `%s', %ux%u", path, ref->width, ref->height));
+    return 0;
+}
+
+/* get a reference from the cache, or load it */
+static reference_t *reference_get(const char *path)
+{
+    reference_t *victim = &reference_cache[0];
+    time_t mtime = 0;
+    unsigned int i;
+
+    archdep_stat_mtime(path, &mtime);
+
+    for (i = 0; i < REFERENCE_CACHE_SIZE; i++) {
+        reference_t *ref = &reference_cache[i];
+
+        if (ref->path != NULL && strcmp(ref->path, path) == 0) {
+            if (ref->mtime == mtime) {
+                ref->used = ++reference_clock;
+                return ref;
+            }
+            /* the file changed */
+            reference_free(ref);
+        }
+    }
+
+    for (i = 0; i < REFERENCE_CACHE_SIZE; i++) {
+        if (reference_cache[i].path == NULL) {
+            victim = &reference_cache[i];
+            break;
+        }
+        if (reference_cache[i].used < victim->used) {
+            victim = &reference_cache[i];
+        }
+    }
+    reference_free(victim);
+    if (reference_load(victim, path) < 0) {
+        return NULL;
+    }
+    victim->used = ++reference_clock;
+    return victim;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void mark(screenshot_compare_result_t *result, unsigned int x, unsigned int y)
+{
+    if (result->pixels == 0) {
+        result->x1 = result->x2 = x;
+        result->y1 = result->y2 = y;
+    } else {
+        if (x < result->x1) {
+            result->x1 = x;
+        }
+        if (x > result->x2) {
+            result->x2 = x;
+        }
+        if (y < result->y1) {
+            result->y1 = y;
+        }
+        if (y > result->y2) {
+            result->y2 = y;
+        }
+    }
+    result->pixels++;
+}
+
+/* compare the visible area of the frame, as saved by screenshots */
+static void compare_frame(const screenshot_t *screenshot, const reference_t *ref,
+                          screenshot_compare_result_t *result)
+{
+    uint32_t palette[256];
+    const uint8_t *line;
+    unsigned int width, height;
+    unsigned int w, h;
+    unsigned int x, y;
+    unsigned int i;
+
+    width = screenshot->max_width & ~3;
+    height = screenshot->last_displayed_line - screenshot->first_displayed_line + 1;
+
+    memset(result, 0, sizeof *result);
+    result->width = width;
+    result->height = height;
+
+    memset(palette, 0, sizeof palette);
+    for (i = 0; i < screenshot->palette->num_entries && i < 256; i++) {
+        palette[i] = ((uint32_t)screenshot->palette->entries[i].red << 16)
+                     | ((uint32_t)screenshot->palette->entries[i].green << 8)
+                     | screenshot->palette->entries[i].blue;
+    }
+
+    w = width < ref->width ? width : ref->width;
+    h = height < ref->height ? height : ref->height;
+
+    for (y = 0; y < h; y++) {
+        line = screenshot->draw_buffer
+               + (size_t)(y + screenshot->first_displayed_line)
+                 * screenshot->size_height * screenshot->draw_buffer_line_size
+               + screenshot->x_offset;
+
+        if (ref->indices != NULL) {
+            const uint8_t *expected = ref->indices + (size_t)y * ref->width;
+
+            if (screenshot->size_width == 1 && memcmp(line, expected, w) == 0) {
+                continue;
+            }
+            for (x = 0; x < w; x++) {
+                if (line[x * screenshot->size_width] != expected[x]) {
+                    mark(result, x, y);
+                }
+            }
+        } else {
+            const uint32_t *expected = ref->colors + (size_t)y * ref->width;
+
+            for (x = 0; x < w; x++) {
+                if (palette[line[x * screenshot->size_width]] != expected[x]) {
+                    mark(result, x, y);
+                }
+            }
+        }
+    }
+
+    /* everything outside the common area differs */
+    if (width != ref->width || height != ref->height) {
+        unsigned int max_w = width > ref->width ? width : ref->width;
+        unsigned int max_h = height > ref->height ? height : ref->height;
+
+        if (result->pixels == 0) {
+            result->x1 = w < max_w ? w : 0;
+            result->y1 = h < max_h ? h : 0;
+        }
+        result->x2 = max_w - 1;
+        result->y2 = max_h - 1;
+        result->pixels += max_w * max_h - w * h;
+    }
+
+    result->differs = (result->pixels != 0);
+}
+
+/** \brief  Compare the current frame of a canvas with a reference image
+ *
+ * The reference is loaded only once, and loaded again if the file changed.
+ *
+ * \param[in]   canvas      video canvas
+ * \param[in]   reference   PNG file, or PGM file with palette indices
+ * \param[out]  result      result of the comparison
+ *
+ * \return  0 on success, -1 if the reference or the frame is not available
+ */
+int screenshot_compare(struct video_canvas_s *canvas, const char *reference,
+                       screenshot_compare_result_t *result)
+{
+    screenshot_t screenshot;
+    reference_t *ref;
+
+    memset(&screenshot, 0, sizeof screenshot);
+    if (machine_screenshot(&screenshot, canvas) < 0) {
+        return -1;
+    }
+    ref = reference_get(reference);
+    if (ref == NULL) {
+        return -1;
+    }
+    compare_frame(&screenshot, ref, result);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int reference_cmp(const void *a, const void *b)
+{
+    const reference_t *ra = a;
+    const reference_t *rb = b;
+
+    if (ra->frame < rb->frame) {
+        return -1;
+    }
+    return ra->frame > rb->frame ? 1 : 0;
+}
+
+static void compare_finish(void)
+{
+    int i;
+
+    for (i = 0; i < compare_num_refs; i++) {
+        reference_free(&compare_refs[i]);
+    }
+    lib_free(compare_refs);
+    compare_refs = NULL;
+    compare_num_refs = 0;
+    compare_running = 0;
+}
+
+/* load all "<name>-<frame>.png" and "<name>-<frame>.pgm" files */
+static int compare_start(void)
+{
+    archdep_dir_t *dir;
+    const char *entry;
+    char *path;
+    char *dirname;
+    char *basename;
+    char *end;
+    size_t len;
+    unsigned long frame;
+    int i;
+
+    util_fname_split(compare_name, &dirname, &basename);
+    len = strlen(basename);
+
+    dir = archdep_opendir(*dirname != '\0' ? dirname : ARCHDEP_DIR_SEP_STR,
+                          ARCHDEP_OPENDIR_ALL_FILES);
+    if (dir != NULL) {
+        while ((entry = archdep_readdir(dir)) != NULL) {
+            if (strncmp(entry, basename, len) != 0 || entry[len] != '-') {
+                continue;
+            }
+            frame = strtoul(entry + len + 1, &end, 10);
+            if (end == entry + len + 1
+                || (strcmp(end, ".png") != 0 && strcmp(end, ".pgm") != 0)) {
+                continue;
+            }
+            path = util_concat(dirname, ARCHDEP_DIR_SEP_STR, entry, NULL);
+            compare_refs = lib_realloc(compare_refs,
+                                       (compare_num_refs + 1) * sizeof(reference_t));
+            if (reference_load(&compare_refs[compare_num_refs], path) == 0) {
+                compare_refs[compare_num_refs++].frame = frame;
+            }
+            lib_free(path);
+        }
+        archdep_closedir(dir);
+    }
+    lib_free(dirname);
+    lib_free(basename);
+
+    if (compare_num_refs == 0) {
+        log_error(compare_log, "No reference images `%s-<frame>.png/.pgm' found.",
+                  compare_name);
+        return -1;
+    }
+    qsort(compare_refs, (size_t)compare_num_refs, sizeof(reference_t), reference_cmp);
+
+    /* one frame can only be compared with one image */
+    for (i = 1; i < compare_num_refs; i++) {
+        if (compare_refs[i].frame == compare_refs[i - 1].frame) {
+            log_error(compare_log, "Both `%s' and `%s' are reference images for frame %lu.",
+                      compare_refs[i - 1].path, compare_refs[i].path,
+                      compare_refs[i].frame);
+            compare_finish();
+            return -1;
+        }
+    }
+
+    log_message(compare_log, "Comparing frames with %d reference images `%s-*'.",
+                compare_num_refs, compare_name);
+    compare_next = 0;
+    compare_frame_count = 0;
+    compare_running = 1;
+    return 0;
+}
+
+/** \brief  Compare the current frame with the reference sequence
+ *
+ * Called at the end of every frame by screenshot_record().
+ */
+void screenshot_compare_record(void)
+{
+    screenshot_t screenshot;
+    screenshot_compare_result_t result;
+    reference_t *ref;
+    unsigned long frame;
+
+    if (compare_name == NULL || *compare_name == '\0') {
+        return;
+    }
+    if (!compare_running && compare_start() < 0) {
+        archdep_vice_exit(1);
+        return;
+    }
+
+    frame = compare_frame_count++;
+    if (compare_refs[compare_next].frame != frame) {
+        return;
+    }
+    ref = &compare_refs[compare_next++];
+
+    /* FIXME: this always uses the first canvas, for x128 this is the VDC */
+    memset(&screenshot, 0, sizeof screenshot);
+    if (machine_screenshot(&screenshot, machine_video_canvas_get(0)) < 0) {
+        return;
+    }
+    compare_frame(&screenshot, ref, &result);
+
+    if (result.differs) {
+        log_message(compare_log, "Frame %lu differs from `%s': %u pixels in %u,%u-%u,%u.",
+                    frame, ref->path, result.pixels,
+                    result.x1, result.y1, result.x2, result.y2);
+        archdep_vice_exit(1);
+        return;
+    }
+    DBG(("screenshot_compare: frame %lu matches", frame));
+
+    if (compare_next == compare_num_refs) {
+        log_message(compare_log, "All %d reference images match.", compare_num_refs);
+        archdep_vice_exit(0);
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int set_compare_name(const char *val, void *param)
+{
+    if (compare_name != NULL && val != NULL && strcmp(compare_name, val) == 0) {
+        return 0;
+    }
+    /* the next frame starts a new comparison */
+    compare_finish();
+    util_string_set(&compare_name, val);
+    return 0;
+}
+
+static const resource_string_t resources_string[] = {
+    { "ScreenshotCompareName", "", RES_EVENT_NO, NULL,
+      &compare_name, set_compare_name, NULL },
+    RESOURCE_STRING_LIST_END
+};
+
+int screenshot_compare_resources_init(void)
+{
+    compare_log = log_open("Screenshot");
+
+    return resources_register_string(resources_string);
+}
+
+static const cmdline_option_t cmdline_options[] =
+{
+    { "-screenshotcompare", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "ScreenshotCompareName", NULL,
+      "<Name>", "Compare frames with <Name>-<frame>.png/.pgm, quit at the first difference" },
+    CMDLINE_LIST_END
+};
+
+int screenshot_compare_cmdline_options_init(void)
+{
+    return cmdline_register_options(cmdline_options);
+}
+
+/** \brief  Free all reference images
+ */
+void screenshot_compare_shutdown(void)
+{
+    unsigned int i;
+
+    compare_finish();
+    for (i = 0; i < REFERENCE_CACHE_SIZE; i++) {
+        reference_free(&reference_cache[i]);
+    }
+    lib_free(compare_name);
+    compare_name = NULL;
+}
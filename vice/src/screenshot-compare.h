@@ -0,0 +1,48 @@
+/*
+ * screenshot-compare.h - Compare frames with reference images.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_SCREENSHOT_COMPARE_H
+#define VICE_SCREENSHOT_COMPARE_H
+
+struct video_canvas_s;
+
+typedef struct screenshot_compare_result_s {
+    int differs;            /* 0 if the frame matches the reference */
+    unsigned int pixels;    /* number of differing pixels */
+    unsigned int x1;        /* area containing all differences, inclusive */
+    unsigned int y1;
+    unsigned int x2;
+    unsigned int y2;
+    unsigned int width;     /* size of the frame */
+    unsigned int height;
+} screenshot_compare_result_t;
+
+int screenshot_compare(struct video_canvas_s *canvas, const char *reference,
+                       screenshot_compare_result_t *result);
+
+int screenshot_compare_resources_init(void);
+int screenshot_compare_cmdline_options_init(void);
+void screenshot_compare_record(void);
+void screenshot_compare_shutdown(void);
+
+#endif
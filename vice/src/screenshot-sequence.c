@@ -0,0 +1,618 @@
+/*
+ * screenshot-sequence.c - Save a sequence of frames as image files.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* While "ScreenshotSequenceName" is set, every "ScreenshotSequenceEvery"th
+   frame (optionally only if it differs from the last saved one) is saved as
+   "<name>-<frame>.png" or "<name>-<frame>.pgm", counting frames from the
+   moment the name was set. This works in warp mode too, which makes it
+   useful for regression tests.
+
+   At the end of a frame only the palette indices of the visible area are
+   copied into a free slot. A pool of worker threads writes the slots to
+   files, so the emulation only has to wait when all slots are in use.
+
+   PNG files are written with the palette of the machine and the fastest zlib
+   level. The raw format is a binary PGM file with the palette indices as
+   grey values, the palette is saved as "<name>.vpl" next to it. */
+
+#include "vice.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_PNG
+#include <png.h>
+#include <zlib.h>
+#endif
+
+#include "archdep.h"
+#include "cmdline.h"
+#include "lib.h"
+#include "log.h"
+#include "machine-video.h"
+#include "machine.h"
+#include "palette.h"
+#include "resources.h"
+#include "screenshot-sequence.h"
+#include "screenshot.h"
+#include "types.h"
+#include "util.h"
+
+/* #define DEBUG_SCREENSHOT_SEQUENCE */
+
+#ifdef DEBUG_SCREENSHOT_SEQUENCE
+#define DBG(x) log_printf x
+#else
+#define DBG(x)
+#endif
+
+#define SEQUENCE_THREADS_MAX    16
+
+#ifdef HAVE_PNG
+#define SEQUENCE_FORMAT_DEFAULT SCREENSHOT_SEQUENCE_FORMAT_PNG
+#else
+#define SEQUENCE_FORMAT_DEFAULT SCREENSHOT_SEQUENCE_FORMAT_RAW
+#endif
+
+enum {
+    SLOT_FREE = 0,
+    SLOT_FILLED,
+    SLOT_BUSY
+};
+
+typedef struct sequence_slot_s {
+    int state;
+    unsigned long frame;
+    unsigned int width;
+    unsigned int height;
+    uint8_t *pixels;            /* palette indices, width * height */
+    size_t size;                /* allocated size of pixels */
+    unsigned int num_colors;
+    uint8_t colors[256][3];
+} sequence_slot_t;
+
+static log_t sequence_log = LOG_DEFAULT;
+
+/* resources */
+static char *sequence_name = NULL;
+static int sequence_format = SEQUENCE_FORMAT_DEFAULT;
+static int sequence_every = 1;
+static int sequence_changed = 0;
+static int sequence_threads = 4;
+
+/* state of a running sequence, only touched by the emulation */
+static int sequence_running = 0;
+static char *sequence_base = NULL;      /* name the sequence was started with */
+static int sequence_format_used;
+static unsigned long sequence_frame;
+static uint8_t *last_pixels = NULL;     /* last saved frame, for ScreenshotSequenceChanged */
+static size_t last_size;
+static unsigned int last_width;
+static unsigned int last_height;
+static unsigned int last_num_colors;    /* last palette saved for the raw format */
+static uint8_t last_colors[256][3];
+
+/* everything below is protected by the lock */
+static pthread_mutex_t sequence_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sequence_filled = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t sequence_freed = PTHREAD_COND_INITIALIZER;
+static pthread_t sequence_thread[SEQUENCE_THREADS_MAX];
+static int sequence_num_threads = 0;
+static sequence_slot_t *sequence_slots = NULL;
+static int sequence_num_slots = 0;
+static int sequence_stop = 0;
+static unsigned long sequence_saved;
+static unsigned long sequence_failed;
+static unsigned long sequence_waits;
+
+/* ------------------------------------------------------------------------- */
+
+static int write_raw(FILE *fd, const sequence_slot_t *slot)
+{
+    fprintf(fd, "P5\n# VICE palette indices\n%u %u\n255\n", slot->width, slot->height);
+    if (fwrite(slot->pixels, (size_t)slot->width * slot->height, 1, fd) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+#ifdef HAVE_PNG
+static int write_png(FILE *fd, const sequence_slot_t *slot)
+{
+    png_structp png_ptr;
+    png_infop info_ptr;
+    png_color palette[256];
+    unsigned int i;
+
+    png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (png_ptr == NULL) {
+        return -1;
+    }
+    info_ptr = png_create_info_struct(png_ptr);
+    if (info_ptr == NULL) {
+        png_destroy_write_struct(&png_ptr, NULL);
+        return -1;
+    }
+    if (setjmp(png_jmpbuf(png_ptr))) {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        return -1;
+    }
+
+    png_init_io(png_ptr, fd);
+    png_set_compression_level(png_ptr, Z_BEST_SPEED);
+    png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+
+    png_set_IHDR(png_ptr, info_ptr, slot->width, slot->height,
+                 8, PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    for (i = 0; i < slot->num_colors; i++) {
+        palette[i].red = slot->colors[i][0];
+        palette[i].green = slot->colors[i][1];
+        palette[i].blue = slot->colors[i][2];
+    }
+    png_set_PLTE(png_ptr, info_ptr, palette, (int)slot->num_colors);
+    png_write_info(png_ptr, info_ptr);
+
+    for (i = 0; i < slot->height; i++) {
+        png_write_row(png_ptr, slot->pixels + (size_t)i * slot->width);
+    }
+    png_write_end(png_ptr, info_ptr);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    return 0;
+}
+#endif
+
+/* write one slot to its file, called by the workers without the lock */
+static int write_slot(const sequence_slot_t *slot, const char *base, int format)
+{
+    char *filename;
+    FILE *fd;
+    int result;
+
+    filename = lib_msprintf("%s-%06lu.%s", base, slot->frame,
+                            format == SCREENSHOT_SEQUENCE_FORMAT_PNG ? "png" : "pgm");
+    fd = fopen(filename, MODE_WRITE);
+    if (fd == NULL) {
+        log_error(sequence_log, "Cannot create `%s'.", filename);
+        lib_free(filename);
+        return -1;
+    }
+#ifdef HAVE_PNG
+    if (format == SCREENSHOT_SEQUENCE_FORMAT_PNG) {
+        result = write_png(fd, slot);
+    } else
+#endif
+    {
+        result = write_raw(fd, slot);
+    }
+    if (fclose(fd) != 0) {
+        result = -1;
+    }
+    if (result < 0) {
+        log_error(sequence_log, "Cannot write `%s'.", filename);
+    }
+    lib_free(filename);
+    return result;
+}
+
+static void *worker_main(void *arg)
+{
+    sequence_slot_t *slot;
+    int result;
+    int i;
+
+    pthread_mutex_lock(&sequence_lock);
+    for (;;) {
+        slot = NULL;
+        /* oldest frame first, so the files appear roughly in order */
+        for (i = 0; i < sequence_num_slots; i++) {
+            if (sequence_slots[i].state == SLOT_FILLED
+                && (slot == NULL || sequence_slots[i].frame < slot->frame)) {
+                slot = &sequence_slots[i];
+            }
+        }
+        if (slot == NULL) {
+            if (sequence_stop) {
+                break;
+            }
+            pthread_cond_wait(&sequence_filled, &sequence_lock);
+            continue;
+        }
+        slot->state = SLOT_BUSY;
+        pthread_mutex_unlock(&sequence_lock);
+
+        /* sequence_base and sequence_format_used don't change while the
+           workers are running */
+        result = write_slot(slot, sequence_base, sequence_format_used);
+
+        pthread_mutex_lock(&sequence_lock);
+        if (result < 0) {
+            sequence_failed++;
+        } else {
+            sequence_saved++;
+        }
+        slot->state = SLOT_FREE;
+        pthread_cond_signal(&sequence_freed);
+    }
+    pthread_mutex_unlock(&sequence_lock);
+    return NULL;
+}
+
+static int sequence_start(void)
+{
+    int i;
+
+    sequence_base = lib_strdup(sequence_name);
+    sequence_format_used = sequence_format;
+    sequence_frame = 0;
+    sequence_stop = 0;
+    sequence_saved = 0;
+    sequence_failed = 0;
+    sequence_waits = 0;
+
+    /* enough slots to keep all workers busy while the next frames come in */
+    sequence_num_slots = sequence_threads * 2;
+    sequence_slots = lib_calloc((size_t)sequence_num_slots, sizeof(sequence_slot_t));
+
+    for (i = 0; i < sequence_threads; i++) {
+        if (pthread_create(&sequence_thread[i], NULL, worker_main, NULL) != 0) {
+            break;
+        }
+    }
+    sequence_num_threads = i;
+    if (sequence_num_threads == 0) {
+        log_error(sequence_log, "Cannot start worker threads.");
+        lib_free(sequence_slots);
+        sequence_slots = NULL;
+        lib_free(sequence_base);
+        sequence_base = NULL;
+        return -1;
+    }
+
+    log_message(sequence_log, "Saving frames to `%s-*.%s' with %d threads.",
+                sequence_base,
+                sequence_format_used == SCREENSHOT_SEQUENCE_FORMAT_PNG ? "png" : "pgm",
+                sequence_num_threads);
+    sequence_running = 1;
+    return 0;
+}
+
+/* wait until all frames are written and stop the workers */
+static void sequence_finish(void)
+{
+    int i;
+
+    if (!sequence_running) {
+        return;
+    }
+
+    pthread_mutex_lock(&sequence_lock);
+    sequence_stop = 1;
+    pthread_cond_broadcast(&sequence_filled);
+    pthread_mutex_unlock(&sequence_lock);
+
+    for (i = 0; i < sequence_num_threads; i++) {
+        pthread_join(sequence_thread[i], NULL);
+    }
+    sequence_num_threads = 0;
+
+    log_message(sequence_log, "Saved %lu of %lu frames (%lu failed), waited for the writers %lu times.",
+                sequence_saved, sequence_frame, sequence_failed, sequence_waits);
+
+    for (i = 0; i < sequence_num_slots; i++) {
+        lib_free(sequence_slots[i].pixels);
+    }
+    lib_free(sequence_slots);
+    sequence_slots = NULL;
+    sequence_num_slots = 0;
+
+    lib_free(sequence_base);
+    sequence_base = NULL;
+    lib_free(last_pixels);
+    last_pixels = NULL;
+    last_size = 0;
+    last_num_colors = 0;
+    sequence_running = 0;
+}
+
+/* save the palette for the raw format whenever it changes */
+static void save_raw_palette(const palette_t *palette, const sequence_slot_t *slot)
+{
+    char *filename;
+
+    if (slot->num_colors == last_num_colors
+        && memcmp(slot->colors, last_colors, slot->num_colors * 3) == 0) {
+        return;
+    }
+    last_num_colors = slot->num_colors;
+    memcpy(last_colors, slot->colors, slot->num_colors * 3);
+
+    filename = util_concat(sequence_base, ".vpl", NULL);
+    if (palette_save(filename, palette) < 0) {
+        log_error(sequence_log, "Cannot write palette `%s'.", filename);
+    }
+    lib_free(filename);
+}
+
+/* copy the visible area like screenshot_line_data() does */
+static void copy_pixels(const screenshot_t *screenshot, uint8_t *dest,
+                        unsigned int width, unsigned int height,
+                        unsigned int y_offset)
+{
+    const uint8_t *line_base;
+    unsigned int x, y;
+
+    for (y = 0; y < height; y++) {
+        line_base = screenshot->draw_buffer
+                    + (size_t)(y + y_offset) * screenshot->size_height
+                      * screenshot->draw_buffer_line_size
+                    + screenshot->x_offset;
+        if (screenshot->size_width == 1) {
+            memcpy(dest, line_base, width);
+        } else {
+            for (x = 0; x < width; x++) {
+                dest[x] = line_base[x * screenshot->size_width];
+            }
+        }
+        dest += width;
+    }
+}
+
+/* compare the visible area with the last saved frame */
+static int frame_changed(const screenshot_t *screenshot, unsigned int width,
+                         unsigned int height)
+{
+    const uint8_t *line_base;
+    unsigned int y;
+
+    if (last_pixels == NULL || width != last_width || height != last_height
+        || screenshot->size_width != 1) {
+        return 1;
+    }
+    for (y = 0; y < height; y++) {
+        line_base = screenshot->draw_buffer
+                    + (size_t)(y + screenshot->first_displayed_line)
+                      * screenshot->size_height
+                      * screenshot->draw_buffer_line_size
+                    + screenshot->x_offset;
+        if (memcmp(line_base, last_pixels + (size_t)y * width, width) != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/** \brief  Save the current frame if a sequence is being recorded
+ *
+ * Called at the end of every frame by screenshot_record().
+ */
+void screenshot_sequence_record(void)
+{
+    screenshot_t screenshot;
+    sequence_slot_t *slot = NULL;
+    unsigned int width, height;
+    unsigned int i;
+    size_t size;
+    unsigned long frame;
+    int n;
+
+    if (sequence_name == NULL || *sequence_name == '\0') {
+        return;
+    }
+    if (!sequence_running && sequence_start() < 0) {
+        resources_set_string("ScreenshotSequenceName", "");
+        return;
+    }
+
+    frame = sequence_frame++;
+    if ((frame % (unsigned long)sequence_every) != 0) {
+        return;
+    }
+
+    /* FIXME: this always uses the first canvas, for x128 this is the VDC */
+    memset(&screenshot, 0, sizeof screenshot);
+    if (machine_screenshot(&screenshot, machine_video_canvas_get(0)) < 0) {
+        return;
+    }
+    width = screenshot.max_width & ~3;
+    height = screenshot.last_displayed_line - screenshot.first_displayed_line + 1;
+    size = (size_t)width * height;
+
+    if (sequence_changed && !frame_changed(&screenshot, width, height)) {
+        return;
+    }
+
+    pthread_mutex_lock(&sequence_lock);
+    for (;;) {
+        for (n = 0; n < sequence_num_slots; n++) {
+            if (sequence_slots[n].state == SLOT_FREE) {
+                slot = &sequence_slots[n];
+                break;
+            }
+        }
+        if (slot != NULL) {
+            break;
+        }
+        sequence_waits++;
+        pthread_cond_wait(&sequence_freed, &sequence_lock);
+    }
+    pthread_mutex_unlock(&sequence_lock);
+
+    /* the workers leave free slots alone */
+    if (slot->size < size) {
+        lib_free(slot->pixels);
+        slot->pixels = lib_malloc(size);
+        slot->size = size;
+    }
+    slot->frame = frame;
+    slot->width = width;
+    slot->height = height;
+    copy_pixels(&screenshot, slot->pixels, width, height, screenshot.first_displayed_line);
+    slot->num_colors = screenshot.palette->num_entries < 256 ? screenshot.palette->num_entries : 256;
+    for (i = 0; i < slot->num_colors; i++) {
+        slot->colors[i][0] = screenshot.palette->entries[i].red;
+        slot->colors[i][1] = screenshot.palette->entries[i].green;
+        slot->colors[i][2] = screenshot.palette->entries[i].blue;
+    }
+
+    if (sequence_format_used == SCREENSHOT_SEQUENCE_FORMAT_RAW) {
+        save_raw_palette(screenshot.palette, slot);
+    }
+
+    if (sequence_changed) {
+        if (last_size < size) {
+            lib_free(last_pixels);
+            last_pixels = lib_malloc(size);
+            last_size = size;
+        }
+        memcpy(last_pixels, slot->pixels, size);
+        last_width = width;
+        last_height = height;
+    }
+
+    DBG(("screenshot_sequence_record: frame %lu queued", frame));
+
+    pthread_mutex_lock(&sequence_lock);
+    slot->state = SLOT_FILLED;
+    pthread_cond_signal(&sequence_filled);
+    pthread_mutex_unlock(&sequence_lock);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int set_sequence_name(const char *val, void *param)
+{
+    if (sequence_name != NULL && val != NULL && strcmp(sequence_name, val) == 0) {
+        return 0;
+    }
+    /* the next frame starts a new sequence */
+    sequence_finish();
+    util_string_set(&sequence_name, val);
+    return 0;
+}
+
+static int set_sequence_format(int val, void *param)
+{
+    switch (val) {
+        case SCREENSHOT_SEQUENCE_FORMAT_RAW:
+#ifdef HAVE_PNG
+        case SCREENSHOT_SEQUENCE_FORMAT_PNG:
+#endif
+            break;
+        default:
+            return -1;
+    }
+    sequence_format = val;
+    return 0;
+}
+
+static int set_sequence_every(int val, void *param)
+{
+    if (val < 1) {
+        return -1;
+    }
+    sequence_every = val;
+    return 0;
+}
+
+static int set_sequence_changed(int val, void *param)
+{
+    sequence_changed = val ? 1 : 0;
+    return 0;
+}
+
+static int set_sequence_threads(int val, void *param)
+{
+    if ((val < 1) || (val > SEQUENCE_THREADS_MAX)) {
+        return -1;
+    }
+    /* takes effect with the next sequence */
+    sequence_threads = val;
+    return 0;
+}
+
+static const resource_string_t resources_string[] = {
+    { "ScreenshotSequenceName", "", RES_EVENT_NO, NULL,
+      &sequence_name, set_sequence_name, NULL },
+    RESOURCE_STRING_LIST_END
+};
+
+static const resource_int_t resources_int[] = {
+    { "ScreenshotSequenceFormat", SEQUENCE_FORMAT_DEFAULT, RES_EVENT_NO, NULL,
+      &sequence_format, set_sequence_format, NULL },
+    { "ScreenshotSequenceEvery", 1, RES_EVENT_NO, NULL,
+      &sequence_every, set_sequence_every, NULL },
+    { "ScreenshotSequenceChanged", 0, RES_EVENT_NO, NULL,
+      &sequence_changed, set_sequence_changed, NULL },
+    { "ScreenshotSequenceThreads", 4, RES_EVENT_NO, NULL,
+      &sequence_threads, set_sequence_threads, NULL },
+    RESOURCE_INT_LIST_END
+};
+
+int screenshot_sequence_resources_init(void)
+{
+    sequence_log = log_open("Screenshot");
+
+    if (resources_register_string(resources_string) < 0) {
+        return -1;
+    }
+    return resources_register_int(resources_int);
+}
+
+static const cmdline_option_t cmdline_options[] =
+{
+    { "-screenshotseq", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "ScreenshotSequenceName", NULL,
+      "<Name>", "Save frames as <Name>-<frame>.png/.pgm" },
+    { "-screenshotseqformat", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "ScreenshotSequenceFormat", NULL,
+      "<Format>", "Set format of saved frames (0: PGM with palette indices, 1: PNG)" },
+    { "-screenshotseqevery", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "ScreenshotSequenceEvery", NULL,
+      "<value>", "Save only every <value>th frame" },
+    { "-screenshotseqchanged", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "ScreenshotSequenceChanged", (resource_value_t)1,
+      NULL, "Save only frames that differ from the last saved one" },
+    { "+screenshotseqchanged", SET_RESOURCE, CMDLINE_ATTRIB_NONE,
+      NULL, NULL, "ScreenshotSequenceChanged", (resource_value_t)0,
+      NULL, "Save frames even if they did not change" },
+    { "-screenshotseqthreads", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "ScreenshotSequenceThreads", NULL,
+      "<value>", "Set number of threads writing the frames (1-16)" },
+    CMDLINE_LIST_END
+};
+
+int screenshot_sequence_cmdline_options_init(void)
+{
+    return cmdline_register_options(cmdline_options);
+}
+
+/** \brief  Write the remaining frames and free all resources
+ */
+void screenshot_sequence_shutdown(void)
+{
+    sequence_finish();
+    lib_free(sequence_name);
+    sequence_name = NULL;
+}
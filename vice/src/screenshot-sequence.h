@@ -0,0 +1,35 @@
+/*
+ * screenshot-sequence.h - Save a sequence of frames as image files.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_SCREENSHOT_SEQUENCE_H
+#define VICE_SCREENSHOT_SEQUENCE_H
+
+#define SCREENSHOT_SEQUENCE_FORMAT_RAW  0
+#define SCREENSHOT_SEQUENCE_FORMAT_PNG  1
+
+int screenshot_sequence_resources_init(void);
+int screenshot_sequence_cmdline_options_init(void);
+void screenshot_sequence_record(void);
+void screenshot_sequence_shutdown(void);
+
+#endif
@@ -45,6 +45,8 @@
 #include "machine.h"
 #include "palette.h"
 #include "resources.h"
+#include "screenshot-compare.h"
+#include "screenshot-sequence.h"
 #include "screenshot.h"
 #include "uiapi.h"
 #include "util.h"
@@ -96,6 +98,8 @@ void screenshot_shutdown(void)
     lib_free(reopen_recording_drivername);
     lib_free(reopen_filename);
     lib_free(autosave_screenshot_format);
+    screenshot_sequence_shutdown();
+    screenshot_compare_shutdown();
 }
 
 
@@ -266,6 +270,9 @@ int screenshot_record(void)
     screenshot_t screenshot;
     int result;
 
+    screenshot_sequence_record();
+    screenshot_compare_record();
+
     if (recording_driver == NULL) {
         return 0;
     }
@@ -456,12 +463,24 @@ static cmdline_option_t cmdline_options[] =
 
 int screenshot_resources_init(void)
 {
-    return resources_register_string(resources_string);
+    if (resources_register_string(resources_string) < 0) {
+        return -1;
+    }
+    if (screenshot_sequence_resources_init() < 0) {
+        return -1;
+    }
+    return screenshot_compare_resources_init();
 }
 
 int screenshot_cmdline_options_init(void)
 {
-    return cmdline_register_options(cmdline_options);
+    if (cmdline_register_options(cmdline_options) < 0) {
+        return -1;
+    }
+    if (screenshot_sequence_cmdline_options_init() < 0) {
+        return -1;
+    }
+    return screenshot_compare_cmdline_options_init();
 }
 
 
@@ -53,6 +53,8 @@ extern int traps_enabled_device[MAX_DEVICES]; /* FIXME */
 /* Warning: these are only valid for the VIC20, C64 and C128, but *not* for
    the PET.  (FIXME?)  */
 #define BSOUR 0x95 /* Buffered Character for IEEE Bus */
+#define VERCK 0x93 /* Load or Verify Flag */
+#define EAL   0xae /* Current Load Address */
 
 /* FIXME: code here assumes 4 bits for device number; should be 5? */
 #define DEVNR_MASK      0x0F    /* should be 0x1F */
@@ -274,6 +276,70 @@ int serial_trap_receive(void)
     return 1;
 }
 
+/* Load the rest of a file in one go.
+
+   The trap sits on the `JSR IECIN' in the byte loop of the Kernal LOAD
+   routine and resumes at the `BIT STATUS' which ends the loop. Instead of
+   going through the receive trap for every byte, all bytes up to EOF are
+   stored (or verified) starting at EAL here. On a timeout the Kernal gets
+   control back and retries as usual.  */
+int serial_trap_load(void)
+{
+    uint8_t data = 0;
+    uint16_t addr;
+    unsigned int count;
+    int verify;
+
+    if (!device_uses_serial_traps(ActiveDevice)) {
+        DBG(("serial_trap_load aborted (dev %d) no traps", ActiveDevice));
+        return 0;
+    }
+
+    DBG(("serial_trap_load (TrapDevice 0x%02x)", TrapDevice));
+
+    if (TrapSecondary == 0) {
+        send_listen_talk_secondary(SECONDARY + 0);
+    }
+
+    addr = (uint16_t)(mem_read(EAL) | (mem_read(EAL + 1) << 8));
+    verify = mem_read(VERCK) != 0;
+
+    /* the Kernal wraps at $ffff as well, stop there to not run forever */
+    for (count = 0; count < 0x10000; count++) {
+        data = serial_iec_bus_read(TrapDevice, TrapSecondary, serial_set_st);
+        if (serial_get_st() & 0x02) {
+            break;
+        }
+        if (verify) {
+            if (mem_read(addr) != data) {
+                serial_set_st(0x10);
+            }
+        } else {
+            mem_store(addr, data);
+        }
+        addr++;
+        if (serial_get_st() & 0x40) {
+            break;
+        }
+    }
+
+    mem_store(EAL, (uint8_t)(addr & 0xff));
+    mem_store(EAL + 1, (uint8_t)(addr >> 8));
+    mem_store(tmp_in, data);
+
+    /* If at EOF, call specified callback function.  */
+    if ((serial_get_st() & 0x40) && eof_callback_func != NULL) {
+        eof_callback_func();
+    }
+
+    /* Set registers like the Kernal loop does.  */
+    maincpu_set_a(data);
+    maincpu_set_x(data);
+    maincpu_set_carry(0);
+    maincpu_set_interrupt(0);
+
+    return 1;
+}
 
 /* Kernal loops serial-port (0xdd00) to see when serial is ready: fake it.
    EEA9 Get serial data and clk in (TKSA subroutine).  */
@@ -44,6 +44,7 @@
 #include "cmdline.h"
 #include "debug.h"
 #include "fixpoint.h"
+#include "frametiming.h"
 #include "lib.h"
 #include "log.h"
 #include "machine.h"
@@ -1396,12 +1397,14 @@ static int sound_run_sound(void)
     if (cycle_based) {
         delta_t = maincpu_clk - snddata.lastclk;
         bufferptr = snddata.buffer + snddata.bufptr * snddata.sound_output_channels;
+        frametiming_begin(FRAMETIMING_SOUND);
         nr = sound_machine_calculate_samples(snddata.psid,
                                              bufferptr,
                                              snddata.bufsize - snddata.bufptr,
                                              snddata.sound_output_channels,
                                              snddata.sound_chip_channels,
                                              &delta_t);
+        frametiming_end();
         if (delta_t && !archdep_is_exiting()) {
 #if 0
             sound_error_log_only("Sound buffer overflow (cycle based)");
@@ -1429,12 +1432,14 @@ static int sound_run_sound(void)
              nr = snddata.bufsize - snddata.bufptr;
          }
          bufferptr = snddata.buffer + snddata.bufptr * snddata.sound_output_channels;
+         frametiming_begin(FRAMETIMING_SOUND);
          sound_machine_calculate_samples(snddata.psid,
                                          bufferptr,
                                          nr,
                                          snddata.sound_output_channels,
                                          snddata.sound_chip_channels,
                                          &delta_t);
+         frametiming_end();
          snddata.fclk += nr * snddata.clkstep;
      }
 
@@ -31,6 +31,7 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "lib.h"
 #include "raster-cache-const.h"
 #include "raster-cache-fill.h"
 #include "raster-cache.h"
@@ -122,6 +123,35 @@ static unsigned int semi_gfx_test;   /* a combo flag & bitmask, if 0 there is no
 static unsigned int semi_gfx_mask;   /* used to mask 'on' the remainder of the character, e.g. for semi_gfx_test 0x08, semi_gfx_mask= 0x07 to mask on bits 0-2 inclusive */
 static unsigned int semi_gfx_type;   /* 0 = semi-graphics does not extend through intercharacter gap, 0xFF = it does */
 
+/* Everything draw_std_text() and draw_std_bitmap() depend on for one raster
+   line. If it is the same as when the line was last drawn, the pixels are
+   still in the draw buffer and the line is not rendered again. */
+typedef struct vdc_line_key_s {
+    uint8_t *draw_ptr;          /* where the line was drawn, NULL = invalid */
+    uint64_t ram_generation;    /* last write to the charset or bitmap data */
+    unsigned int mode;
+    unsigned int cols;
+    unsigned int data_index;    /* character row / bitmap address */
+    unsigned int bytes_per_char;
+    unsigned int charwidth;
+    unsigned int border_width;
+    unsigned int xsmooth;
+    unsigned int ycounter;
+    unsigned int cursor_col;    /* column the cursor reverses, or ~0 */
+    int vdc_address_mask;
+    int attribute_blink;
+    uint8_t regs[7];            /* R22 - R26, R28, R29 */
+} vdc_line_key_t;
+
+typedef struct vdc_line_cache_s {
+    vdc_line_key_t key;
+    uint8_t scrnbuf[0x100];
+    uint8_t attrbuf[0x100];
+} vdc_line_cache_t;
+
+static vdc_line_cache_t *line_cache = NULL;
+static unsigned int line_cache_size = 0;
+
 
 /* These functions draw the background from `start_pixel' to `end_pixel'.  */
 /*
@@ -254,6 +284,126 @@ static void calculate_draw_masks(void)
 }
 
 
+/* Return non-zero if the cursor is shown on the current raster line */
+static int cursor_visible(void)
+{
+    if ((vdc.frame_counter | 1) & crsrblink[(vdc.regs[10] >> 5) & 3]) {
+        /* the cursor covers the raster lines from R10 to R11 */
+        if (((vdc.raster.ycounter >= (vdc.regs[10] & 0x1F)) && (vdc.raster.ycounter < (vdc.regs[11] & 0x1F)))
+            || ((vdc.raster.ycounter == (vdc.regs[10] & 0x1F)) && (vdc.raster.ycounter == (vdc.regs[11] & 0x1F)))
+            || (((vdc.regs[10] & 0x1F) > (vdc.regs[11] & 0x1F)) && ((vdc.raster.ycounter >= (vdc.regs[10] & 0x1F)) || (vdc.raster.ycounter < (vdc.regs[11] & 0x1F))))
+            ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Return the last write to the character set, remembering the result until
+   the VDC RAM or the character set address changes */
+static uint64_t charset_generation(void)
+{
+    static uint64_t ram_generation = 0, generation = 0;
+    static unsigned int base = 0, size = 0;
+    static int address_mask = 0;
+    static uint8_t reg28 = 0;
+
+    if (ram_generation != vdc.ram_generation
+        || base != (vdc.chargen_adr & vdc.vdc_address_mask)
+        || size != 0x200 * vdc.bytes_per_char
+        || address_mask != vdc.vdc_address_mask
+        || reg28 != (vdc.regs[28] & 0x10)) {
+        ram_generation = vdc.ram_generation;
+        base = vdc.chargen_adr & vdc.vdc_address_mask;
+        size = 0x200 * vdc.bytes_per_char; /* including the alternate character set */
+        address_mask = vdc.vdc_address_mask;
+        reg28 = vdc.regs[28] & 0x10;
+        generation = vdc_ram_generation((uint16_t)base, size);
+    }
+    return generation;
+}
+
+/* Compare the state for the current raster line with what it was drawn from
+   last time, and remember it. Returns non-zero if the line must be drawn. */
+static int line_cache_update(const vdc_line_key_t *key, unsigned int attr_cols,
+                             int text)
+{
+    vdc_line_cache_t *line;
+    raster_cache_t *cache;
+    unsigned int current_line = vdc.raster.current_line;
+    int changed = 0;
+
+    if (current_line >= line_cache_size) {
+        line_cache = lib_realloc(line_cache, (current_line + 1) * sizeof(vdc_line_cache_t));
+        memset(line_cache + line_cache_size, 0,
+               (current_line + 1 - line_cache_size) * sizeof(vdc_line_cache_t));
+        line_cache_size = current_line + 1;
+    }
+    line = &line_cache[current_line];
+
+    /* The line has been blanked or drawn by other code since */
+    cache = &vdc.raster.cache[current_line];
+    if (cache->is_dirty || cache->blank) {
+        changed = 1;
+    }
+
+    if (changed || memcmp(&line->key, key, sizeof(vdc_line_key_t)) != 0) {
+        line->key = *key;
+        changed = 1;
+    }
+    if (memcmp(line->attrbuf, &vdc.attrbuf[vdc.attrbufdraw], attr_cols) != 0) {
+        memcpy(line->attrbuf, &vdc.attrbuf[vdc.attrbufdraw], attr_cols);
+        changed = 1;
+    }
+    if (text && memcmp(line->scrnbuf, &vdc.scrnbuf[vdc.attrbufdraw], key->cols) != 0) {
+        memcpy(line->scrnbuf, &vdc.scrnbuf[vdc.attrbufdraw], key->cols);
+        changed = 1;
+    }
+    return changed;
+}
+
+/* Forget what the current raster line was drawn from */
+static void line_cache_invalidate_line(void)
+{
+    if (vdc.raster.current_line < line_cache_size) {
+        line_cache[vdc.raster.current_line].key.draw_ptr = NULL;
+    }
+}
+
+/* Forget the contents of all lines, e.g. after the draw buffer changed */
+void vdc_draw_invalidate_lines(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < line_cache_size; i++) {
+        line_cache[i].key.draw_ptr = NULL;
+    }
+}
+
+/* Fill in the parts of the line key common to text and bitmap mode */
+static void line_key_init(vdc_line_key_t *key, unsigned int mode, unsigned int cols)
+{
+    memset(key, 0, sizeof(vdc_line_key_t));
+    key->draw_ptr = vdc.raster.draw_buffer_ptr;
+    key->mode = mode;
+    key->cols = cols;
+    key->bytes_per_char = vdc.bytes_per_char;
+    key->charwidth = vdc.charwidth;
+    key->border_width = vdc.border_width;
+    key->xsmooth = vdc.xsmooth;
+    key->ycounter = vdc.raster.ycounter;
+    key->cursor_col = ~0U;
+    key->vdc_address_mask = vdc.vdc_address_mask;
+    key->regs[0] = vdc.regs[22];
+    key->regs[1] = vdc.regs[23];
+    key->regs[2] = vdc.regs[24];
+    key->regs[3] = vdc.regs[25];
+    key->regs[4] = vdc.regs[26];
+    key->regs[5] = vdc.regs[28];
+    key->regs[6] = vdc.regs[29];
+}
+
+
 /*-----------------------------------------------------------------------*/
 
 inline static uint8_t get_attr_char_data(uint8_t c, uint8_t a, int l, uint8_t *char_mem,
@@ -571,6 +721,8 @@ static void draw_std_text_cached(raster_cache_t *cache, unsigned int xs,
     unsigned int i;
     int icsi = -1;  /* Inter Character Spacing Index - used as a combo flag/index as to whether there is any intercharacter gap to render */
 
+    line_cache_invalidate_line();
+
     if (vdc.regs[25] & 0x10) { /* double pixel a.k.a 40column mode */
         if (vdc.charwidth > 16) {   /* Is there inter character spacing to render? */
             icsi = vdc.charwidth / 2 - 8;
@@ -664,8 +816,31 @@ static void draw_std_text(void)
     unsigned int i, d, d2;
     unsigned int cpos = 0xFFFF;
     int icsi = -1;  /* Inter Character Spacing Index - used as a combo flag/index as to whether there is any intercharacter gap to render */
+    vdc_line_key_t key;
 
-    cpos = ( vdc.crsrpos & vdc.vdc_address_mask ) - vdc.screen_adr - vdc.mem_counter;
+    if (cursor_visible()) {
+        cpos = ( vdc.crsrpos & vdc.vdc_address_mask ) - vdc.screen_adr - vdc.mem_counter;
+    }
+    char_index = (vdc.chargen_adr & vdc.vdc_address_mask) + vdc.raster.ycounter;
+
+    /* Skip the line if nothing it depends on has changed since it was drawn */
+    line_key_init(&key, VDC_TEXT_MODE, vdc.screen_text_cols);
+    key.data_index = char_index;
+    key.ram_generation = charset_generation();
+    if (cpos < vdc.screen_text_cols) {
+        key.cursor_col = cpos;
+    }
+    if ((vdc.regs[25] & 0x40) && vdc.attribute_blink) {
+        for (i = 0; i < vdc.screen_text_cols; i++) {
+            if (vdc.attrbuf[vdc.attrbufdraw + i] & VDC_FLASH_ATTR) {
+                key.attribute_blink = 1;
+                break;
+            }
+        }
+    }
+    if (!line_cache_update(&key, (vdc.regs[25] & 0x40) ? vdc.screen_text_cols : 0, 1)) {
+        return;
+    }
 
     if(vdc.regs[25] & 0x10) { /* double pixel a.k.a 40column mode */
         if (vdc.charwidth > 16) {   /* Is there inter character spacing to render? */
@@ -687,7 +862,6 @@ static void draw_std_text(void)
     attr_ptr = &vdc.attrbuf[vdc.attrbufdraw];
     /* screen_ptr = vdc.ram + ((vdc.screen_adr + vdc.mem_counter) & vdc.vdc_address_mask);*/ /* as above */
     screen_ptr = &vdc.scrnbuf[vdc.attrbufdraw];
-    char_index = (vdc.chargen_adr & vdc.vdc_address_mask) + vdc.raster.ycounter;
 
     calculate_draw_masks();
 
@@ -733,19 +907,10 @@ static void draw_std_text(void)
                 d2 ^= 0xFF;
             }
 
-            if (cpos == i) { /* handle cursor if this is the cursor */
-                if ((vdc.frame_counter | 1) & crsrblink[(vdc.regs[10] >> 5) & 3]) {
-                    /* invert current byte of the character if we are within the cursor area */
-                    if (
-                    ((vdc.raster.ycounter >= (vdc.regs[10] & 0x1F)) && (vdc.raster.ycounter < (vdc.regs[11] & 0x1F)))
-                    || ((vdc.raster.ycounter == (vdc.regs[10] & 0x1F)) && (vdc.raster.ycounter == (vdc.regs[11] & 0x1F)))
-                    || (((vdc.regs[10] & 0x1F) > (vdc.regs[11] & 0x1F)) && ((vdc.raster.ycounter >= (vdc.regs[10] & 0x1F)) || (vdc.raster.ycounter < (vdc.regs[11] & 0x1F))))
-                    ) {
-                        /* The VDC cursor reverses the char */
-                        d ^= 0xFF;
-                        d2 ^= 0xFF;
-                    }
-                }
+            if (cpos == i) { /* handle cursor if this is the cursor and it is visible on this line */
+                /* The VDC cursor reverses the char */
+                d ^= 0xFF;
+                d2 ^= 0xFF;
             }
 
             if (vdc.regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
@@ -802,19 +967,10 @@ static void draw_std_text(void)
                 d2 = semi_gfx_type;  /* this will get masked off later on, so we just set all (or none) inter-char pixels on for now */
             }
 
-            if (cpos == i) { /* handle cursor if this is the cursor */
-                if ((vdc.frame_counter | 1) & crsrblink[(vdc.regs[10] >> 5) & 3]) {
-                    /* invert current byte of the character if we are within the cursor area */
-                    if (
-                    ((vdc.raster.ycounter >= (vdc.regs[10] & 0x1F)) && (vdc.raster.ycounter < (vdc.regs[11] & 0x1F)))
-                    || ((vdc.raster.ycounter == (vdc.regs[10] & 0x1F)) && (vdc.raster.ycounter == (vdc.regs[11] & 0x1F)))
-                    || (((vdc.regs[10] & 0x1F) > (vdc.regs[11] & 0x1F)) && ((vdc.raster.ycounter >= (vdc.regs[10] & 0x1F)) || (vdc.raster.ycounter < (vdc.regs[11] & 0x1F))))
-                    ) {
-                        /* The VDC cursor reverses the char */
-                        d ^= 0xFF;
-                        d2 ^= 0xFF;
-                    }
-                }
+            if (cpos == i) { /* handle cursor if this is the cursor and it is visible on this line */
+                /* The VDC cursor reverses the char */
+                d ^= 0xFF;
+                d2 ^= 0xFF;
             }
 
             if (vdc.regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
@@ -898,6 +1054,9 @@ static void draw_std_bitmap_cached(raster_cache_t *cache, unsigned int xs,
     uint32_t *ptr, *pdwl, *pdwh;
 
     unsigned int i, d, j, fg, bg;
+
+    line_cache_invalidate_line();
+
     p = vdc.raster.draw_buffer_ptr
         + vdc.border_width
         + ((vdc.regs[25] & 0x10) ? 2 : 0)
@@ -993,6 +1152,18 @@ static void draw_std_bitmap(void)
 
     unsigned int i, d, d2, j, fg, bg, bitmap_index;
     int icsi = -1;  /* Inter Character Spacing Index - used as a combo flag/index as to whether there is any intercharacter gap to render */
+    vdc_line_key_t key;
+
+    bitmap_index = vdc.screen_adr + vdc.bitmap_counter;
+
+    /* Skip the line if nothing it depends on has changed since it was drawn,
+       including the byte after the line used for the last few pixels */
+    line_key_init(&key, VDC_BITMAP_MODE, vdc.mem_counter_inc);
+    key.data_index = bitmap_index;
+    key.ram_generation = vdc_ram_generation((uint16_t)bitmap_index, vdc.mem_counter_inc + 1);
+    if (!line_cache_update(&key, (vdc.regs[25] & 0x40) ? vdc.mem_counter_inc + 1 : 0, 0)) {
+        return;
+    }
 
     if(vdc.regs[25] & 0x10) { /* double pixel a.k.a 40column mode */
         if (vdc.charwidth > 16) {   /* Is there inter character spacing to render? */
@@ -1012,7 +1183,6 @@ static void draw_std_bitmap(void)
 
     /*attr_ptr = vdc.ram + ((vdc.attribute_adr + vdc.mem_counter) & vdc.vdc_address_mask);*/    /* keep pre-buffer pointer set-up for testing */
     attr_ptr = &vdc.attrbuf[vdc.attrbufdraw];
-    bitmap_index = vdc.screen_adr + vdc.bitmap_counter;
 
     calculate_draw_masks();
 
@@ -1125,6 +1295,8 @@ static void draw_idle_cached(raster_cache_t *cache, unsigned int xs,
 
     unsigned int i;
 
+    line_cache_invalidate_line();
+
     p = vdc.raster.draw_buffer_ptr + vdc.border_width
         + vdc.raster.xsmooth + xs * 8;
 
@@ -1144,6 +1316,8 @@ static void draw_idle(void)
 
     unsigned int i;
 
+    line_cache_invalidate_line();
+
     p = vdc.raster.draw_buffer_ptr + vdc.border_width
         + vdc.raster.xsmooth;
 
@@ -1191,3 +1365,10 @@ void vdc_draw_init(void)
 
     setup_modes();
 }
+
+void vdc_draw_shutdown(void)
+{
+    lib_free(line_cache);
+    line_cache = NULL;
+    line_cache_size = 0;
+}
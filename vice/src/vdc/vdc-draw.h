@@ -30,5 +30,7 @@
 #define VICE_VDC_DRAW_H
 
 void vdc_draw_init(void);
+void vdc_draw_shutdown(void);
+void vdc_draw_invalidate_lines(void);
 
 #endif
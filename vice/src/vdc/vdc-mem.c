@@ -639,46 +639,58 @@ static uint16_t vdc_64k_to_16k_map(uint16_t address)
     return new_address;
 }
 
-uint8_t vdc_ram_read(uint16_t addr)
+/* translate a VDC address into an index into vdc.ram, used by read/write functions below */
+inline static unsigned int vdc_ram_index(uint16_t addr)
 {   /* perform necessary address translations when memory configuration doesn't match memory addressing */
     if (vdc.regs[28] & 0x10) {
         if (vdc_resources.vdc_64kb_expansion) {
             /* 64KB addressing, 4464 chips 64KB */
-            return vdc.ram[addr];
+            return addr;
         } else {
             /* 64KB addressing, 4416 chips 16KB */
-            return vdc.ram[vdc_64k_to_16k_map(addr)];
+            return vdc_64k_to_16k_map(addr);
         }
     } else {
         if (vdc_resources.vdc_64kb_expansion) {
             /* 16KB addressing, 4464 chips 64KB */
-            return vdc.ram[vdc_16k_to_64k_map(addr)];
+            return vdc_16k_to_64k_map(addr);
         } else {
             /* 16KB addressing, 4416 chips 16KB */
-            return vdc.ram[addr & 0x3fff];
+            return addr & 0x3fff;
         }
     }
 }
 
+uint8_t vdc_ram_read(uint16_t addr)
+{
+    return vdc.ram[vdc_ram_index(addr)];
+}
+
 void vdc_ram_store(uint16_t addr, uint8_t value)
 {   /* as above but for storing to VDC ram with appropriate address translation*/
-    if (vdc.regs[28] & 0x10) {
-        if (vdc_resources.vdc_64kb_expansion) {
-            /* 64KB addressing, 4464 chips 64KB */
-            vdc.ram[addr] = value;
-        } else {
-            /* 64KB addressing, 4416 chips 16KB */
-            vdc.ram[vdc_64k_to_16k_map(addr)] = value;
-        }
-    } else {
-        if (vdc_resources.vdc_64kb_expansion) {
-            /* 16KB addressing, 4464 chips 64KB */
-            vdc.ram[vdc_16k_to_64k_map(addr)] = value;
-        } else {
-            /* 16KB addressing, 4416 chips 16KB */
-            vdc.ram[addr & 0x3fff] = value;
+    unsigned int index = vdc_ram_index(addr);
+
+    vdc.ram[index] = value;
+    vdc.ram_page_generation[index >> 8] = ++vdc.ram_generation;
+}
+
+/* Return the value of vdc.ram_generation at the last write to any of the
+   `size' bytes starting at `addr'. The address translations above keep the
+   low byte, so it is enough to look at whole pages. */
+uint64_t vdc_ram_generation(uint16_t addr, unsigned int size)
+{
+    uint64_t generation = 0;
+    unsigned int i, pages;
+
+    pages = ((addr & 0xff) + size + 0xff) >> 8;
+    for (i = 0; i < pages; i++) {
+        unsigned int index = vdc_ram_index((uint16_t)((addr & 0xff00) + (i << 8)));
+
+        if (vdc.ram_page_generation[index >> 8] > generation) {
+            generation = vdc.ram_page_generation[index >> 8];
         }
     }
+    return generation;
 }
 
 
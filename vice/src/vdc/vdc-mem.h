@@ -37,6 +37,7 @@ uint8_t vdc_peek(uint16_t addr);
 
 void vdc_ram_store(uint16_t addr, uint8_t value);
 uint8_t vdc_ram_read(uint16_t addr);
+uint64_t vdc_ram_generation(uint16_t addr, unsigned int size);
 
 int vdc_dump(void);
 
@@ -159,6 +159,7 @@ printf("LD: %03i FD: %03i\n", last_displayed_line, first_displayed_line);
 static void vdc_invalidate_cache(raster_t *raster, unsigned int screen_height)
 {
     raster_new_cache(raster, screen_height);
+    vdc_draw_invalidate_lines();
 }
 
 static int init_raster(void)
@@ -371,6 +372,10 @@ void vdc_powerup(void)
         vdc.ram[i] = v;
         v ^= 0xff;
     }
+    vdc.ram_generation++;
+    for (i = 0; i < 0x100; i++) {
+        vdc.ram_page_generation[i] = vdc.ram_generation;
+    }
     memset(vdc.regs, 0, sizeof(vdc.regs));
     vdc.mem_counter = 0;
     vdc.mem_counter_inc = 0;
@@ -657,6 +662,7 @@ static void vdc_raster_draw_alarm_handler(CLOCK offset, void *data)
                 if (vdc.initialized) {
                     vdc_set_geometry();
                     raster_mode_change();
+                    vdc_draw_invalidate_lines();
                 }
                 vdc.force_resize = 0;
             }
@@ -896,4 +902,5 @@ void vdc_async_refresh(struct canvas_refresh_s *refresh)
 void vdc_shutdown(void)
 {
     raster_shutdown(&vdc.raster);
+    vdc_draw_shutdown();
 }
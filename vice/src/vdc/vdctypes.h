@@ -190,6 +190,11 @@ struct vdc_s {
     /* Internal VDC video memory */
     uint8_t ram[0x10000];
 
+    /* Count of writes to `ram', and its value at the last write to each
+       256 byte page of `ram' (used by the line cache in vdc-draw.c) */
+    uint64_t ram_generation;
+    uint64_t ram_page_generation[0x100];
+
     /* used to record the value of the cpu clock at the start of a raster line */
     CLOCK vdc_line_start;
     /* based on blacky_stardust calculations, calculating current_x_pixel should be like:
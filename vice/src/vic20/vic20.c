@@ -222,6 +222,15 @@ static const trap_t vic20_serial_traps[] = {
         vic20memrom_trap_read,
         vic20memrom_trap_store
     },
+    {
+        "SerialLoad",
+        0xF598,
+        0xF5BB,
+        { 0x20, 0x19, 0xEF },
+        serial_trap_load,
+        vic20memrom_trap_read,
+        vic20memrom_trap_store
+    },
     {
         NULL,
         0,
@@ -118,8 +118,22 @@ static void store_prb(via_context_t *via_context, uint8_t byte, uint8_t myoldpb,
     store_joyport_dig(JOYPORT_1, joy_bit, 8);
 }
 
+/* CA2 and CB2 are the CLK and DATA outputs to the serial bus */
+static void update_iec_pcr(uint8_t byte)
+{
+    /* first set bit 1 and 5 to the real output values */
+    if ((byte & 0x0c) != 0x0c) {
+        byte |= 0x02;
+    }
+    if ((byte & 0xc0) != 0xc0) {
+        byte |= 0x20;
+    }
+    iec_pcr_write(byte);
+}
+
 static void undump_pcr(via_context_t *via_context, uint8_t byte)
 {
+    update_iec_pcr(byte);
 }
 
 static void reset(via_context_t *via_context)
@@ -131,15 +145,7 @@ static uint8_t store_pcr(via_context_t *via_context, uint8_t byte, uint16_t addr
 {
     /* FIXME: this should use via_set_ca2() and via_set_cb2() */
     if (byte != via_context->via[VIA_PCR]) {
-        register uint8_t tmp = byte;
-        /* first set bit 1 and 5 to the real output values */
-        if ((tmp & 0x0c) != 0x0c) {
-            tmp |= 0x02;
-        }
-        if ((tmp & 0xc0) != 0xc0) {
-            tmp |= 0x20;
-        }
-        iec_pcr_write(tmp);
+        update_iec_pcr(byte);
     }
     return byte;
 }
@@ -45,6 +45,7 @@
 #define EVENT_SYNC_TEST         14
 #define EVENT_KEYBOARD_CLEAR    15
 #define EVENT_RESOURCE          16
+#define EVENT_KEYFRAME          17
 
 #define EVENT_START_MODE_FILE_SAVE 0
 #define EVENT_START_MODE_FILE_LOAD 1
@@ -82,6 +83,7 @@ int event_record_start(void);
 int event_record_stop(void);
 int event_playback_start(void);
 int event_playback_stop(void);
+int event_playback_seek(unsigned int seconds);
 int event_record_active(void);
 int event_playback_active(void);
 int event_record_set_milestone(void);
@@ -114,6 +114,9 @@ static uint8_t pri_buffer[8];
 
 static uint8_t pixel_buffer[8];
 
+/* 0xff for every bit set in the index, msb first */
+static uint8_t expand_bits[256][8];
+
 /* color resolution registers */
 static uint8_t cregs[0x2f];
 static uint8_t last_color_reg;
@@ -145,6 +148,34 @@ static const uint8_t colors[] = {
     COL_NONE, COL_NONE, COL_NONE, COL_NONE          /* ECM=1 BMM=1 MCM=1 */
 };
 
+/* lookup colors with the current cbuf/vbuf registers */
+static DRAW_INLINE uint8_t resolve_color(uint8_t cc)
+{
+    switch (cc) {
+        case COL_NONE:
+            cc = 0;
+            break;
+        case COL_VBUF_L:
+            cc = vbuf_reg & 0x0f;
+            break;
+        case COL_VBUF_H:
+            cc = vbuf_reg >> 4;
+            break;
+        case COL_CBUF:
+            cc = cbuf_reg;
+            break;
+        case COL_CBUF_MC:
+            cc = cbuf_reg & 0x07;
+            break;
+        case COL_D02X_EXT:
+            cc = COL_D021 + (vbuf_reg >> 6);
+            break;
+        default:
+            break;
+    }
+    return cc;
+}
+
 static DRAW_INLINE void draw_graphics(int i)
 {
     uint8_t px;
@@ -198,43 +229,69 @@ static DRAW_INLINE void draw_graphics(int i)
     /* Determine pixel color and priority */
     vmode = vmode11_pipe | vmode16_pipe;
     pixel_pri = (px & 0x2);
-    cc = colors[vmode | px];
-
-    /* lookup colors and render pixel */
-    switch (cc) {
-        case COL_NONE:
-            cc = 0;
-            break;
-        case COL_VBUF_L:
-            cc = vbuf_reg & 0x0f;
-            break;
-        case COL_VBUF_H:
-            cc = vbuf_reg >> 4;
-            break;
-        case COL_CBUF:
-            cc = cbuf_reg;
-            break;
-        case COL_CBUF_MC:
-            cc = cbuf_reg & 0x07;
-            break;
-        case COL_D02X_EXT:
-            cc = COL_D021 + (vbuf_reg >> 6);
-            break;
-        default:
-            break;
-    }
+    cc = resolve_color(colors[vmode | px]);
 
     render_buffer[i] = cc;
     pri_buffer[i] = pixel_pri;
 }
 
-static DRAW_INLINE void draw_graphics8(unsigned int cycle_flags)
+/*
+ * Render pixels i to end - 1 like draw_graphics() does, for the common case
+ * that the video mode stays the same during the whole cycle and no new
+ * values are latched in between. The colors are resolved only once, and
+ * hires pixels are rendered all at once by selecting bytes of a 64 bit
+ * word with the expanded graphics bits.
+ */
+static DRAW_INLINE void draw_graphics_span(int i, int end)
 {
-    int vis_en;
+    uint8_t vmode = vmode11_pipe | vmode16_pipe;
+    int mc_pixels = (vmode11_pipe & 0x08) || (cbuf_reg & 0x08);
+    int n = end - i;
 
-    vis_en = cycle_is_visible(cycle_flags);
+    if (n <= 0) {
+        return;
+    }
 
-    /* render pixels */
+    if (vmode16_pipe2 && mc_pixels) {
+        uint8_t lut[4];
+        uint8_t px;
+
+        for (px = 0; px < 4; px++) {
+            lut[px] = resolve_color(colors[vmode | px]);
+        }
+        for (; i < end; i++) {
+            if (gbuf_mc_flop) {
+                gbuf_pixel_reg = gbuf_reg >> 6;
+            }
+            gbuf_reg <<= 1;
+            gbuf_mc_flop ^= 1;
+            render_buffer[i] = lut[gbuf_pixel_reg];
+            pri_buffer[i] = gbuf_pixel_reg & 0x2;
+        }
+    } else {
+        /* see draw_graphics() for the $d023 glitch kludge */
+        uint8_t fg = (vmode16_pipe2 || !mc_pixels) ? 3 : 2;
+        uint64_t bg_color = resolve_color(colors[vmode]);
+        uint64_t fg_color = resolve_color(colors[vmode | fg]);
+        uint64_t mask;
+        uint64_t pixels;
+
+        memcpy(&mask, expand_bits[gbuf_reg], 8);
+        pixels = (bg_color * 0x0101010101010101ULL)
+                 ^ (mask & ((bg_color ^ fg_color) * 0x0101010101010101ULL));
+        memcpy(render_buffer + i, &pixels, (size_t)n);
+        mask &= 0x0202020202020202ULL;
+        memcpy(pri_buffer + i, &mask, (size_t)n);
+
+        gbuf_pixel_reg = expand_bits[gbuf_reg][n - 1] & fg;
+        gbuf_reg = (uint8_t)(gbuf_reg << n);
+        gbuf_mc_flop ^= n & 1;
+    }
+}
+
+/* render the pixels of a cycle in which the video mode changes */
+static DRAW_INLINE void draw_graphics8_mode_change(void)
+{
     /* pixel 0 */
     draw_graphics(0);
     /* pixel 1 */
@@ -264,9 +321,52 @@ static DRAW_INLINE void draw_graphics8(unsigned int cycle_flags)
     }
     vmode16_pipe2 = vmode16_pipe;
     draw_graphics(7);
+}
+
+/*
+ * Advance the graphics state of a cycle that is covered by the border and
+ * where no sprite is displayed, like on the idle lines of a blanked screen.
+ * The pixels are not visible, and with an empty gbuf pipeline they are all
+ * 0, so only the latch at xscroll needs to be done.
+ */
+static DRAW_INLINE void draw_graphics8_idle(void)
+{
+    vbuf_reg = vbuf_pipe1_reg;
+    cbuf_reg = cbuf_pipe1_reg;
+    gbuf_reg = gbuf_pipe1_reg;
+    /* set at xscroll, then toggled for each remaining pixel */
+    gbuf_mc_flop = (xscroll_pipe & 1) ? 0 : 1;
+
+    memset(pri_buffer, 0, 8);
+}
+
+static DRAW_INLINE void draw_graphics8(unsigned int cycle_flags, int idle)
+{
+    int vis_en;
+    uint8_t next_vmode11 = (vicii.regs[0x11] & 0x60) >> 2;
+    uint8_t next_vmode16 = (vicii.regs[0x16] & 0x10) >> 2;
+
+    vis_en = cycle_is_visible(cycle_flags);
+
+    if (vmode16_pipe == next_vmode16 && vmode16_pipe2 == next_vmode16
+        && (!vicii.color_latency || vmode11_pipe == next_vmode11)) {
+        /* the video mode stays the same for all 8 pixels */
+        if (idle && !(gbuf_reg | gbuf_pipe1_reg | gbuf_pixel_reg)) {
+            draw_graphics8_idle();
+        } else {
+            draw_graphics_span(0, xscroll_pipe);
+            vbuf_reg = vbuf_pipe1_reg;
+            cbuf_reg = cbuf_pipe1_reg;
+            gbuf_reg = gbuf_pipe1_reg;
+            gbuf_mc_flop = 1;
+            draw_graphics_span(xscroll_pipe, 8);
+        }
+    } else {
+        draw_graphics8_mode_change();
+    }
 
     if (!vicii.color_latency) {
-        vmode11_pipe = ( vicii.regs[0x11] & 0x60 ) >> 2;
+        vmode11_pipe = next_vmode11;
     }
 
     /* shift and put the next data into the pipe. */
@@ -502,6 +602,29 @@ static DRAW_INLINE void draw_sprites8(unsigned int cycle_flags)
     }
     candidate_bits = get_trigger_candidates(xpos);
 
+    /*
+     * if no sprite is displayed and none can start in this cycle, only
+     * update the registers in the same order as below
+     */
+    if (!candidate_bits && !sprite_active_bits) {
+        sprite_halt_bits |= dma_cycle_0;
+        if (spr_en) {
+            sprite_pending_bits = vicii.sprite_display_bits;
+        }
+        update_sprite_data(cycle_flags);
+        if (!vicii.color_latency) {
+            update_sprite_mc_bits_8565();
+        }
+        sprite_pri_bits = vicii.regs[0x1b];
+        sprite_expx_bits = vicii.regs[0x1d];
+        if (vicii.color_latency) {
+            update_sprite_mc_bits_6569();
+        }
+        sprite_halt_bits &= ~dma_cycle_2;
+        update_sprite_xpos();
+        return;
+    }
+
     /* process and render sprites */
     /* pixel 0 */
     trigger_sprites(xpos + 0, candidate_bits);
@@ -605,38 +728,40 @@ static DRAW_INLINE void update_cregs(void)
     vicii.last_color_reg = 0xff;
 }
 
-static DRAW_INLINE void draw_colors_6569(int offs, int i)
+/*
+ * The colors are resolved with one pixel of delay on the 6569, and without
+ * delay on the 8565. The color registers don't change during the 8 pixels,
+ * so all pixels are resolved at once.
+ */
+static DRAW_INLINE void draw_colors_6569(uint8_t *dbuf)
 {
-    int lookup_index;
-
-    /* resolve any unresolved colors */
-    lookup_index = (i + 1) & 0x07;
-    pixel_buffer[lookup_index] = cregs[pixel_buffer[lookup_index]];
+    int i;
 
-    /* draw pixel to buffer */
-    vicii.dbuf[offs + i] = pixel_buffer[i];
+    /* the first pixel was already resolved in the last cycle */
+    dbuf[0] = pixel_buffer[0];
+    for (i = 1; i < 8; i++) {
+        dbuf[i] = cregs[pixel_buffer[i]];
+    }
 
-    pixel_buffer[i] = render_buffer[i];
+    memcpy(pixel_buffer, render_buffer, 8);
+    pixel_buffer[0] = cregs[pixel_buffer[0]];
 }
 
-static DRAW_INLINE void draw_colors_8565(int offs, int i)
+static DRAW_INLINE void draw_colors_8565(uint8_t *dbuf)
 {
-    int lookup_index;
-
-    lookup_index = i;
-    /* resolve any unresolved colors */
+    int i;
 
     /* special case for grey dot handling */
-    if (i == 0 && pixel_buffer[lookup_index] == last_color_reg) {
-        pixel_buffer[lookup_index] = 0x0f;
+    if (pixel_buffer[0] == last_color_reg) {
+        dbuf[0] = 0x0f;
     } else {
-        pixel_buffer[lookup_index] = cregs[pixel_buffer[lookup_index]];
+        dbuf[0] = cregs[pixel_buffer[0]];
+    }
+    for (i = 1; i < 8; i++) {
+        dbuf[i] = cregs[pixel_buffer[i]];
     }
 
-    /* draw pixel to buffer */
-    vicii.dbuf[offs + i] = pixel_buffer[i];
-
-    pixel_buffer[i] = render_buffer[i];
+    memcpy(pixel_buffer, render_buffer, 8);
 }
 
 static DRAW_INLINE void draw_colors8(void)
@@ -655,23 +780,9 @@ static DRAW_INLINE void draw_colors8(void)
 
     /* render pixels */
     if (vicii.color_latency) {
-        draw_colors_6569(offs, 0);
-        draw_colors_6569(offs, 1);
-        draw_colors_6569(offs, 2);
-        draw_colors_6569(offs, 3);
-        draw_colors_6569(offs, 4);
-        draw_colors_6569(offs, 5);
-        draw_colors_6569(offs, 6);
-        draw_colors_6569(offs, 7);
+        draw_colors_6569(vicii.dbuf + offs);
     } else {
-        draw_colors_8565(offs, 0);
-        draw_colors_8565(offs, 1);
-        draw_colors_8565(offs, 2);
-        draw_colors_8565(offs, 3);
-        draw_colors_8565(offs, 4);
-        draw_colors_8565(offs, 5);
-        draw_colors_8565(offs, 6);
-        draw_colors_8565(offs, 7);
+        draw_colors_8565(vicii.dbuf + offs);
     }
     vicii.dbuf_offset += 8;
 
@@ -687,12 +798,21 @@ static DRAW_INLINE void draw_colors8(void)
 
 void vicii_draw_cycle(void)
 {
+    int idle;
+
     /* reset rendering on raster cycle 1 */
     if (vicii.raster_cycle == 1) {
         vicii.dbuf_offset = 0;
     }
 
-    draw_graphics8(cycle_flags_pipe);
+    /*
+     * the graphics need not be rendered if draw_border8() covers all pixels
+     * and draw_sprites8() has nothing to display or collide with them
+     */
+    idle = border_state && vicii.main_border && !sprite_active_bits
+           && !get_trigger_candidates(cycle_get_xpos(cycle_flags_pipe));
+
+    draw_graphics8(cycle_flags_pipe, idle);
 
     draw_sprites8(cycle_flags_pipe);
 
@@ -706,7 +826,7 @@ void vicii_draw_cycle(void)
 
 void vicii_draw_cycle_init(void)
 {
-    int i;
+    int i, j;
 
     /* initialize the draw buffer */
     memset(vicii.dbuf, 0, VICII_DRAW_BUFFER_SIZE);
@@ -724,6 +844,12 @@ void vicii_draw_cycle_init(void)
     last_color_reg = 0xff;
 
     cycle_flags_pipe = 0;
+
+    for (i = 0; i < 256; i++) {
+        for (j = 0; j < 8; j++) {
+            expand_bits[i][j] = (i & (0x80 >> j)) ? 0xff : 0x00;
+        }
+    }
 }
 
 
@@ -153,6 +153,7 @@ typedef struct video_chip_cap_s video_chip_cap_t;
 
 struct video_render_color_tables_s {
     int updated;                /* tables here are up to date */
+    unsigned long generation;   /* changes whenever the tables change */
     uint32_t physical_colors[256];
     int32_t ytableh[256];        /* y for current pixel */
     int32_t ytablel[256];        /* y for neighbouring pixels */
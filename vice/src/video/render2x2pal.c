@@ -41,7 +41,7 @@
     B = Y + U
 */
 static inline
-void yuv_to_rgb(int32_t y, int32_t u, int32_t v, int16_t *red, int16_t *grn, int16_t *blu)
+void yuv_to_rgb(int32_t y, int32_t u, int32_t v, int32_t *red, int32_t *grn, int32_t *blu)
 {
     *red = (y + v) >> 16;
     *blu = (y + u) >> 16;
@@ -55,7 +55,7 @@ void store_line_and_scanline_4(
     int16_t *const prevline, const int shade, /* ignored by RGB modes */
     const int32_t y, const int32_t u, const int32_t v)
 {
-    int16_t red, grn, blu;
+    int32_t red, grn, blu;
     uint32_t *tmp1, *tmp2;
     yuv_to_rgb(y, u, v, &red, &grn, &blu);
 
@@ -87,6 +87,10 @@ void get_yuv_from_video(
     line[1] = vnew;
 }
 
+/* Every source line is done in a single pass: palette lookup, the chroma
+   delay line, the blur and the scanline shading. The only buffers are the
+   delay line (line_yuv_0) and the RGB values of the previous line
+   (prevrgbline), which the scanline between the two lines is made of. */
 static inline
 void render_generic_2x2_pal(video_render_color_tables_t *color_tab,
                             const uint8_t *src, uint8_t *trg,
@@ -39,6 +39,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "frametiming.h"
 #include "lib.h"
 #include "log.h"
 #include "machine.h"
@@ -46,6 +47,7 @@
 #include "video-canvas.h"
 #include "video-color.h"
 #include "video-render.h"
+#include "video-shm.h"
 #include "video.h"
 #include "viewport.h"
 
@@ -127,6 +129,8 @@ void video_canvas_render(video_canvas_t *canvas, uint8_t *trg, int width,
         canvas->crt_type = viewport->crt_type;
     }
 
+    frametiming_begin(FRAMETIMING_RENDER);
+
     if (!canvas->videoconfig->color_tables.updated) { /* update colors as necessary */
         video_color_update_palette(canvas);
     }
@@ -134,6 +138,8 @@ void video_canvas_render(video_canvas_t *canvas, uint8_t *trg, int width,
                       trg, width, height, xs, ys, xt, yt,
                       canvas->draw_buffer->draw_buffer_width, pitcht,
                       viewport);
+
+    frametiming_end();
 }
 
 /** \brief Force refresh all tracked canvases.
@@ -156,6 +162,8 @@ void video_canvas_refresh_all(video_canvas_t *canvas)
 {
     viewport_t *viewport;
     geometry_t *geometry;
+    unsigned int xs, ys, w, h;
+    int i;
 
     if (video_disabled_mode) {
         return;
@@ -164,16 +172,21 @@ void video_canvas_refresh_all(video_canvas_t *canvas)
     viewport = canvas->viewport;
     geometry = canvas->geometry;
 
-    video_canvas_refresh(canvas,
-                         viewport->first_x
-                         + geometry->extra_offscreen_border_left,
-                         viewport->first_line,
-                         viewport->x_offset,
-                         viewport->y_offset,
-                         MIN(canvas->draw_buffer->canvas_width,
-                             geometry->screen_size.width - viewport->first_x),
-                         MIN(canvas->draw_buffer->canvas_height,
-                             viewport->last_line - viewport->first_line + 1));
+    xs = viewport->first_x + geometry->extra_offscreen_border_left;
+    ys = viewport->first_line;
+    w = MIN(canvas->draw_buffer->canvas_width,
+            geometry->screen_size.width - viewport->first_x);
+    h = MIN(canvas->draw_buffer->canvas_height,
+            viewport->last_line - viewport->first_line + 1);
+
+    video_canvas_refresh(canvas, xs, ys, viewport->x_offset, viewport->y_offset, w, h);
+
+    for (i = 0; i < TRACKED_CANVAS_MAX; i++) {
+        if (tracked_canvas[i] == canvas) {
+            video_shm_export(canvas, i, (int)xs, (int)ys, (int)w, (int)h);
+            break;
+        }
+    }
 }
 
 int video_canvas_palette_set(struct video_canvas_s *canvas,
@@ -34,10 +34,23 @@
 #include "machine.h"
 #include "resources.h"
 #include "util.h"
+#include "video-shm.h"
 #include "video.h"
 
+static const cmdline_option_t cmdline_options[] =
+{
+    { "-renderthreads", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "RenderThreads", NULL,
+      "<value>", "Set number of threads rendering large frames (0: one per CPU, 1-8)" },
+    CMDLINE_LIST_END
+};
+
 int video_cmdline_options_init(void)
 {
+    if (cmdline_register_options(cmdline_options) < 0
+        || video_shm_cmdline_options_init() < 0) {
+        return -1;
+    }
     return video_arch_cmdline_options_init();
 }
 
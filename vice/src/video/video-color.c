@@ -52,6 +52,7 @@
 #include "viewport.h"
 #include "video-canvas.h"
 #include "video-color.h"
+#include "video-render.h"
 #include "video.h"
 
 #define RMIN(x,min) (((x) < (min)) ? (min) : (x))
@@ -76,11 +77,13 @@ void video_render_setrawrgb(video_render_color_tables_t *color_tab, unsigned int
     color_tab->color_red[index] = r;
     color_tab->color_grn[index] = g;
     color_tab->color_blu[index] = b;
+    video_render_color_tables_changed(color_tab);
 }
 
 void video_render_setrawalpha(video_render_color_tables_t *color_tab, uint32_t a)
 {
     color_tab->alpha = a;
+    video_render_color_tables_changed(color_tab);
 }
 
 static video_ycbcr_palette_t *video_ycbcr_palette_create(unsigned int num_entries)
@@ -898,6 +901,7 @@ int video_color_update_palette(struct video_canvas_s *canvas)
         return 0;
     }
     canvas->videoconfig->color_tables.updated = 1;
+    video_render_color_tables_changed(&canvas->videoconfig->color_tables);
 
     DBG(("video_color_update_palette cbm palette:%d extern: %d",
          canvas->videoconfig->cbm_palette ? 1 : 0, canvas->videoconfig->external_palette ? 1 : 0));
@@ -989,4 +993,5 @@ void video_render_initraw(struct video_render_config_s *videoconfig)
     int video;
     resources_get_int("MachineVideoStandard", &video);
     video_calc_gammatable(&videoconfig->color_tables, &videoconfig->video_resources, video);
+    video_render_color_tables_changed(&videoconfig->color_tables);
 }
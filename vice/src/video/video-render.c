@@ -25,10 +25,27 @@
  *
  */
 
+/* Large frames can be rendered in horizontal bands by a small pool of
+   threads. The calling thread renders the first band, the workers render the
+   others into the same target, and video_render_main() only returns when all
+   bands are done. Every band is rendered with the same code and parameters a
+   partial update of that area would use, so the output doesn't depend on the
+   number of threads. Renderers that carry state from one line to the next
+   (the delay line of the CRT emulation) already start each area from the
+   source line above it, and those that look at neighbouring lines (scale2x)
+   read them from the source, so the bands overlap in the source only. The
+   color tables hold scratch buffers for the CRT emulation, each worker uses
+   its own copy of the render config for that reason. */
+
 #include "vice.h"
 
+#include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
+#include "lib.h"
 #include "log.h"
 #include "types.h"
 #include "video-render.h"
@@ -39,6 +56,53 @@ static render_pal_ntsc_func_t  render_pal_ntsc_func  = video_render_pal_ntsc_mai
 static render_rgbi_func_t render_rgbi_func = video_render_rgbi_main;
 static render_crt_mono_func_t render_crt_mono_func = video_render_crt_mono_main;
 
+/* Bands start at a multiple of this many target lines. All renderers agree
+   with a full frame on the line phase (odd/even, interlace, scanlines) at
+   these lines, the 2x4 renderers need the 8. */
+#define RENDER_BAND_ALIGN       8
+
+/* Areas with less target lines per band are not worth splitting */
+#define RENDER_BAND_MIN_LINES   64
+
+typedef struct render_band_s {
+    video_render_config_t *config;
+    int height;
+    int ys;
+    int yt;
+} render_band_t;
+
+/* the RenderThreads resource, 0 = one per CPU, 1 = no render threads */
+static int render_threads = 1;
+
+/* parameters shared by all bands of the area being rendered */
+static uint8_t *band_src;
+static uint8_t *band_trg;
+static int band_width;
+static int band_xs;
+static int band_xt;
+static int band_pitchs;
+static int band_pitcht;
+static viewport_t *band_viewport;
+
+/* everything below is protected by the lock */
+static pthread_mutex_t render_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t render_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t render_done = PTHREAD_COND_INITIALIZER;
+static pthread_t render_thread[VIDEO_RENDER_THREADS_MAX];
+static video_render_config_t *render_config[VIDEO_RENDER_THREADS_MAX];
+/* what the color tables of render_config[] were copied from */
+static const video_render_config_t *render_config_source[VIDEO_RENDER_THREADS_MAX];
+static unsigned long render_config_generation[VIDEO_RENDER_THREADS_MAX];
+static render_band_t render_band[VIDEO_RENDER_THREADS_MAX];
+static int render_num_workers = 0;     /* threads including the caller, 0 = not started */
+static int render_num_bands = 0;
+static int render_pending = 0;
+static unsigned long render_generation = 0;
+static int render_stop = 0;
+
+/* source of unique color_tables.generation values */
+static unsigned long color_tables_generation = 0;
+
 void video_render_initconfig(video_render_config_t *config)
 {
     int i;
@@ -67,26 +131,44 @@ void video_render_setphysicalcolor(video_render_config_t *config, int index,
             break;
     }
     config->color_tables.physical_colors[index] = color;
+    video_render_color_tables_changed(&config->color_tables);
 }
 
-static int rendermode_error = -1;
-
-void video_render_main(video_render_config_t *config, uint8_t *src, uint8_t *trg,
-                       int width, int height, int xs, int ys, int xt, int yt,
-                       int pitchs, int pitcht, viewport_t *viewport)
+/* Must be called after changing the color tables of a render config, so
+   the copies for the render threads are updated. */
+void video_render_color_tables_changed(video_render_color_tables_t *color_tab)
 {
-    int rendermode;
+    color_tab->generation = ++color_tables_generation;
+}
 
-#if 0
-    log_debug(LOG_DEFAULT, "w:%i h:%i xs:%i ys:%i xt:%i yt:%i ps:%i pt:%i d%i",
-              width, height, xs, ys, xt, yt, pitchs, pitcht, depth);
+/* Copy the render config for a band. The color tables are large and rarely
+   change, they are only copied when they did. The scratch buffers in them
+   are not carried over between lines, each band fills its own. */
+static void render_config_copy(int index, const video_render_config_t *config)
+{
+    video_render_config_t *copy = render_config[index];
+    size_t tables = offsetof(video_render_config_t, color_tables);
+    size_t rest = tables + sizeof(video_render_color_tables_t);
 
-#endif
-    if (width <= 0) {
-        return; /* some render routines don't like invalid width */
+    if (render_config_source[index] != config
+        || render_config_generation[index] != config->color_tables.generation) {
+        memcpy(&copy->color_tables, &config->color_tables,
+               sizeof(video_render_color_tables_t));
+        render_config_source[index] = config;
+        render_config_generation[index] = config->color_tables.generation;
     }
+    memcpy(copy, config, tables);
+    memcpy((uint8_t *)copy + rest, (const uint8_t *)config + rest,
+           sizeof(video_render_config_t) - rest);
+}
 
-    video_sound_update(config, src, width, height, xs, ys, pitchs, viewport);
+static int rendermode_error = -1;
+
+static void render_area(video_render_config_t *config, uint8_t *src, uint8_t *trg,
+                        int width, int height, int xs, int ys, int xt, int yt,
+                        int pitchs, int pitcht, viewport_t *viewport)
+{
+    int rendermode;
 
     rendermode = config->rendermode;
 
@@ -123,6 +205,216 @@ void video_render_main(video_render_config_t *config, uint8_t *src, uint8_t *trg
     rendermode_error = rendermode;
 }
 
+/* target lines per source line, 0 if the area can't be split */
+static int render_scaley(int rendermode)
+{
+    switch (rendermode) {
+        case VIDEO_RENDER_PAL_NTSC_1X1:
+        case VIDEO_RENDER_CRT_MONO_1X1:
+        case VIDEO_RENDER_RGBI_1X1:
+            return 1;
+        case VIDEO_RENDER_PAL_NTSC_2X2:
+        case VIDEO_RENDER_CRT_MONO_1X2:
+        case VIDEO_RENDER_CRT_MONO_2X2:
+        case VIDEO_RENDER_RGBI_1X2:
+        case VIDEO_RENDER_RGBI_2X2:
+            return 2;
+        case VIDEO_RENDER_CRT_MONO_2X4:
+        case VIDEO_RENDER_RGBI_2X4:
+            return 4;
+    }
+    return 0;
+}
+
+static void render_band_area(const render_band_t *band)
+{
+    render_area(band->config, band_src, band_trg, band_width, band->height,
+                band_xs, band->ys, band_xt, band->yt, band_pitchs, band_pitcht,
+                band_viewport);
+}
+
+static void *render_worker(void *arg)
+{
+    int index = vice_ptr_to_int(arg);
+    unsigned long generation = 0;
+
+    pthread_mutex_lock(&render_lock);
+    for (;;) {
+        while (!render_stop && generation == render_generation) {
+            pthread_cond_wait(&render_start, &render_lock);
+        }
+        if (render_stop) {
+            break;
+        }
+        generation = render_generation;
+        if (index >= render_num_bands) {
+            continue;
+        }
+        pthread_mutex_unlock(&render_lock);
+
+        render_band_area(&render_band[index]);
+
+        pthread_mutex_lock(&render_lock);
+        if (--render_pending == 0) {
+            pthread_cond_signal(&render_done);
+        }
+    }
+    pthread_mutex_unlock(&render_lock);
+    return NULL;
+}
+
+static void render_stop_workers(void)
+{
+    int i;
+
+    pthread_mutex_lock(&render_lock);
+    render_stop = 1;
+    pthread_cond_broadcast(&render_start);
+    pthread_mutex_unlock(&render_lock);
+
+    for (i = 1; i < render_num_workers; i++) {
+        pthread_join(render_thread[i], NULL);
+        lib_free(render_config[i]);
+        render_config[i] = NULL;
+        render_config_source[i] = NULL;
+    }
+    render_num_workers = 0;
+    render_stop = 0;
+    /* new workers start waiting for the first generation after 0 */
+    render_generation = 0;
+}
+
+/* Number of threads to use, starts or stops the workers as needed. The
+   calling thread counts as one. */
+static int render_workers(void)
+{
+    int threads = render_threads;
+    int i;
+
+    if (threads == 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        threads = cpus > 0 ? (int)cpus : 1;
+#else
+        threads = 1;
+#endif
+        if (threads > VIDEO_RENDER_THREADS_MAX) {
+            threads = VIDEO_RENDER_THREADS_MAX;
+        }
+    }
+
+    if (threads != render_num_workers && render_num_workers > 0) {
+        render_stop_workers();
+    }
+    if (threads > 1 && render_num_workers == 0) {
+        for (i = 1; i < threads; i++) {
+            render_config[i] = lib_malloc(sizeof(video_render_config_t));
+            if (pthread_create(&render_thread[i], NULL, render_worker,
+                               vice_int_to_ptr(i)) != 0) {
+                lib_free(render_config[i]);
+                render_config[i] = NULL;
+                break;
+            }
+        }
+        render_num_workers = i;
+        if (i < threads) {
+            log_error(LOG_DEFAULT, "video_render_main: cannot start render threads, using %d.", i);
+            render_threads = i;
+        }
+    }
+    return render_num_workers > 1 ? render_num_workers : 1;
+}
+
+void video_render_main(video_render_config_t *config, uint8_t *src, uint8_t *trg,
+                       int width, int height, int xs, int ys, int xt, int yt,
+                       int pitchs, int pitcht, viewport_t *viewport)
+{
+    int bands, scaley, lines, i;
+
+#if 0
+    log_debug(LOG_DEFAULT, "w:%i h:%i xs:%i ys:%i xt:%i yt:%i ps:%i pt:%i d%i",
+              width, height, xs, ys, xt, yt, pitchs, pitcht, depth);
+
+#endif
+    if (width <= 0) {
+        return; /* some render routines don't like invalid width */
+    }
+
+    video_sound_update(config, src, width, height, xs, ys, pitchs, viewport);
+
+    /* The double scan renderers extend areas starting on an odd target
+       line by one line at the top, neighbouring bands would overlap. */
+    scaley = render_scaley(config->rendermode);
+    if (config->filter == VIDEO_FILTER_CRT && scaley > 0) {
+        /* The CRT emulation handles the scanlines at the edges of the
+           viewport specially, a band must not end there. The 2x4 ones
+           count target lines at half the rate for that, which only works
+           out when starting at the top of the area. */
+        if (scaley == 4
+            || ys < (int)viewport->first_line
+            || ys + (height + scaley - 1) / scaley > (int)viewport->last_line + 1) {
+            scaley = 0;
+        }
+    }
+    bands = (yt & 1) || scaley == 0 ? 1 : render_workers();
+    if (bands > height / RENDER_BAND_MIN_LINES) {
+        bands = height / RENDER_BAND_MIN_LINES;
+    }
+    if (bands <= 1) {
+        render_area(config, src, trg, width, height, xs, ys, xt, yt,
+                    pitchs, pitcht, viewport);
+        return;
+    }
+
+    lines = ((height + bands - 1) / bands + RENDER_BAND_ALIGN - 1) & ~(RENDER_BAND_ALIGN - 1);
+
+    band_src = src;
+    band_trg = trg;
+    band_width = width;
+    band_xs = xs;
+    band_xt = xt;
+    band_pitchs = pitchs;
+    band_pitcht = pitcht;
+    band_viewport = viewport;
+
+    pthread_mutex_lock(&render_lock);
+    for (i = 0; i < bands && i * lines < height; i++) {
+        render_band[i].config = i == 0 ? config : render_config[i];
+        render_band[i].height = (i + 1) * lines < height ? lines : height - i * lines;
+        render_band[i].ys = ys + i * lines / scaley;
+        render_band[i].yt = yt + i * lines;
+        if (i > 0) {
+            render_config_copy(i, config);
+        }
+    }
+    render_num_bands = i;
+    render_pending = i - 1;
+    render_generation++;
+    pthread_cond_broadcast(&render_start);
+    pthread_mutex_unlock(&render_lock);
+
+    render_band_area(&render_band[0]);
+
+    pthread_mutex_lock(&render_lock);
+    while (render_pending > 0) {
+        pthread_cond_wait(&render_done, &render_lock);
+    }
+    pthread_mutex_unlock(&render_lock);
+}
+
+void video_render_threads_set(int threads)
+{
+    render_threads = threads;
+}
+
+void video_render_shutdown(void)
+{
+    if (render_num_workers > 0) {
+        render_stop_workers();
+    }
+}
+
 void video_render_palntscfunc_set(render_pal_ntsc_func_t func)
 {
     render_pal_ntsc_func = func;
@@ -35,6 +35,9 @@
 struct video_render_config_s;
 struct video_canvas_s;
 
+/* maximum value of the RenderThreads resource */
+#define VIDEO_RENDER_THREADS_MAX    8
+
 typedef void (*render_pal_ntsc_func_t)(video_render_config_t *, uint8_t *, uint8_t *,
                                   int, int, int, int,
                                   int, int, int, int,
@@ -58,6 +61,10 @@ void video_render_main(struct video_render_config_s *config, uint8_t *src,
                        viewport_t *viewport);
 void video_render_update_palette(struct video_canvas_s *canvas);
 
+void video_render_threads_set(int threads);
+void video_render_color_tables_changed(video_render_color_tables_t *color_tab);
+void video_render_shutdown(void);
+
 void video_render_palntscfunc_set(render_pal_ntsc_func_t func);
 void video_render_crtmonofunc_set(render_crt_mono_func_t func);
 void video_render_rgbifunc_set(render_rgbi_func_t func);
@@ -47,6 +47,8 @@
 #include "machine.h"
 #include "resources.h"
 #include "video-color.h"
+#include "video-render.h"
+#include "video-shm.h"
 #include "video.h"
 #include "viewport.h"
 #include "util.h"
@@ -55,13 +57,37 @@
 /*-----------------------------------------------------------------------*/
 /* global resources.  */
 
+static int render_threads;
+
+static int set_render_threads(int val, void *param)
+{
+    if (val < 0 || val > VIDEO_RENDER_THREADS_MAX) {
+        return -1;
+    }
+    render_threads = val;
+    video_render_threads_set(val);
+    return 0;
+}
+
+static const resource_int_t resources_int[] = {
+    { "RenderThreads", 1, RES_EVENT_NO, NULL,
+      &render_threads, set_render_threads, NULL },
+    RESOURCE_INT_LIST_END
+};
+
 int video_resources_init(void)
 {
+    if (resources_register_int(resources_int) < 0
+        || video_shm_resources_init() < 0) {
+        return -1;
+    }
     return video_arch_resources_init();
 }
 
 void video_resources_shutdown(void)
 {
+    video_shm_shutdown();
+    video_render_shutdown();
     video_arch_resources_shutdown();
 }
 
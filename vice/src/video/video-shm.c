@@ -0,0 +1,338 @@
+/*
+ * video-shm.c - Export rendered frames through POSIX shared memory.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+/* When SharedFrameBuffer is set, every refreshed frame is rendered straight
+   into one of three buffers of a shared memory object of that name, so
+   other processes on the same host can use the frames without copying them
+   and without going through the monitor. The layout is described in
+   video-shm.h.
+
+   The first canvas uses the name as given, further canvases (the VDC of
+   x128) append "-<chip name>". The object is removed when the name is
+   changed and when the emulator exits. */
+
+#include "vice.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_SHM_OPEN)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define VIDEO_SHM_SUPPORTED
+#ifdef HAVE_LINUX_FUTEX_H
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#define VIDEO_SHM_FUTEX
+#endif
+#endif
+
+#include "cmdline.h"
+#include "lib.h"
+#include "log.h"
+#include "resources.h"
+#include "types.h"
+#include "util.h"
+#include "video-shm.h"
+#include "video.h"
+#include "videoarch.h"
+
+/* #define DEBUG_VIDEO_SHM */
+
+#ifdef DEBUG_VIDEO_SHM
+#define DBG(x) log_printf x
+#else
+#define DBG(x)
+#endif
+
+#define SHM_CANVASES_MAX    2
+#define SHM_ALIGN           4096
+
+typedef struct shm_export_s {
+    char *name;
+    int fd;
+    uint8_t *map;
+    size_t size;
+    size_t buffer_size;
+    unsigned int next;
+    int failed;
+} shm_export_t;
+
+static char *shm_name = NULL;
+
+#ifdef VIDEO_SHM_SUPPORTED
+
+static shm_export_t shm_exports[SHM_CANVASES_MAX];
+
+static size_t shm_align(size_t size)
+{
+    return (size + SHM_ALIGN - 1) & ~(size_t)(SHM_ALIGN - 1);
+}
+
+static void shm_close(shm_export_t *e)
+{
+    if (e->map != NULL) {
+        munmap(e->map, e->size);
+        e->map = NULL;
+    }
+    if (e->name != NULL) {
+        close(e->fd);
+        shm_unlink(e->name);
+        lib_free(e->name);
+        e->name = NULL;
+    }
+    e->size = 0;
+    e->buffer_size = 0;
+    e->next = 0;
+    e->failed = 0;
+}
+
+static void shm_close_all(void)
+{
+    int i;
+
+    for (i = 0; i < SHM_CANVASES_MAX; i++) {
+        shm_close(&shm_exports[i]);
+    }
+}
+
+static int shm_open_export(shm_export_t *e, video_canvas_t *canvas, int index)
+{
+    const char *slash = shm_name[0] == '/' ? "" : "/";
+
+    if (index == 0) {
+        e->name = util_concat(slash, shm_name, NULL);
+    } else {
+        e->name = util_concat(slash, shm_name, "-", canvas->videoconfig->chip_name, NULL);
+    }
+
+    e->fd = shm_open(e->name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (e->fd < 0) {
+        log_error(LOG_DEFAULT, "Cannot create shared frame buffer `%s'.", e->name);
+        lib_free(e->name);
+        e->name = NULL;
+        return -1;
+    }
+    DBG(("video_shm: created %s", e->name));
+    return 0;
+}
+
+/* Make room for frames of `frame_size' bytes. The buffers move when the
+   object grows, so they are all marked as being written first. */
+static int shm_reserve(shm_export_t *e, size_t frame_size)
+{
+    video_shm_header_t *header;
+    size_t buffer_size = shm_align(frame_size);
+    size_t size = shm_align(sizeof(video_shm_header_t)) + buffer_size * VIDEO_SHM_BUFFERS;
+    uint32_t frame = 0;
+    unsigned int i;
+
+    if (buffer_size <= e->buffer_size) {
+        return 0;
+    }
+
+    if (e->map != NULL) {
+        header = (video_shm_header_t *)e->map;
+        frame = header->frame;
+        for (i = 0; i < VIDEO_SHM_BUFFERS; i++) {
+            __atomic_store_n(&header->buffers[i].sequence,
+                             header->buffers[i].sequence | 1, __ATOMIC_RELEASE);
+        }
+        munmap(e->map, e->size);
+        e->map = NULL;
+    }
+
+    if (ftruncate(e->fd, (off_t)size) < 0) {
+        return -1;
+    }
+    e->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, e->fd, 0);
+    if (e->map == MAP_FAILED) {
+        e->map = NULL;
+        return -1;
+    }
+    e->size = size;
+    e->buffer_size = buffer_size;
+
+    header = (video_shm_header_t *)e->map;
+    if (frame == 0) {
+        memset(header, 0, sizeof(video_shm_header_t));
+        header->version = VIDEO_SHM_VERSION;
+        header->header_size = sizeof(video_shm_header_t);
+    }
+    for (i = 0; i < VIDEO_SHM_BUFFERS; i++) {
+        header->buffers[i].offset = (uint32_t)(shm_align(sizeof(video_shm_header_t)) + buffer_size * i);
+    }
+    __atomic_store_n(&header->size, (uint32_t)size, __ATOMIC_RELEASE);
+    __atomic_store_n(&header->magic, VIDEO_SHM_MAGIC, __ATOMIC_RELEASE);
+
+    DBG(("video_shm: %s is %u bytes", e->name, (unsigned int)size));
+    return 0;
+}
+
+/** \brief  Render a refreshed frame into the shared frame buffer
+ *
+ * Called by video_canvas_refresh_all() with the same area that is passed to
+ * video_canvas_refresh().
+ *
+ * \param[in]   canvas  canvas that was refreshed
+ * \param[in]   index   number of the canvas, 0 for the first one
+ * \param[in]   xs      first column in the draw buffer
+ * \param[in]   ys      first line in the draw buffer
+ * \param[in]   width   width in draw buffer pixels
+ * \param[in]   height  height in draw buffer lines
+ */
+void video_shm_export(video_canvas_t *canvas, int index,
+                      int xs, int ys, int width, int height)
+{
+    shm_export_t *e;
+    video_shm_header_t *header;
+    video_shm_buffer_t *buffer;
+    video_render_color_tables_t *color_tables;
+    uint32_t sequence, frame;
+    int pitch;
+
+    if (shm_name == NULL || *shm_name == 0 || index < 0 || index >= SHM_CANVASES_MAX) {
+        return;
+    }
+
+    e = &shm_exports[index];
+    if (e->failed) {
+        return;
+    }
+
+    width *= canvas->videoconfig->scalex;
+    height *= canvas->videoconfig->scaley;
+    if (width <= 0 || height <= 0) {
+        return;
+    }
+    pitch = width * 4;
+
+    if (e->name == NULL && shm_open_export(e, canvas, index) < 0) {
+        e->failed = 1;
+        return;
+    }
+    if (shm_reserve(e, (size_t)pitch * (size_t)height) < 0) {
+        log_error(LOG_DEFAULT, "Cannot map shared frame buffer `%s'.", e->name);
+        shm_close(e);
+        e->failed = 1;
+        return;
+    }
+
+    header = (video_shm_header_t *)e->map;
+    buffer = &header->buffers[e->next];
+
+    sequence = buffer->sequence | 1;
+    __atomic_store_n(&buffer->sequence, sequence, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    frame = header->frame + 1;
+    buffer->frame = frame;
+    buffer->width = (uint32_t)width;
+    buffer->height = (uint32_t)height;
+    buffer->pitch = (uint32_t)pitch;
+    buffer->interlaced = (uint32_t)canvas->videoconfig->interlaced;
+    buffer->interlace_field = (uint32_t)canvas->videoconfig->interlace_field;
+
+    video_canvas_render(canvas, e->map + buffer->offset, width, height,
+                        xs, ys, 0, 0, pitch);
+
+    /* the masks are only known after the first render set up the colors */
+    color_tables = &canvas->videoconfig->color_tables;
+    header->red_mask = color_tables->color_red[255];
+    header->green_mask = color_tables->color_grn[255];
+    header->blue_mask = color_tables->color_blu[255];
+    header->alpha_mask = color_tables->alpha;
+
+    __atomic_store_n(&buffer->sequence, sequence + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&header->latest, e->next, __ATOMIC_RELEASE);
+    __atomic_store_n(&header->frame, frame, __ATOMIC_RELEASE);
+#ifdef VIDEO_SHM_FUTEX
+    syscall(SYS_futex, &header->frame, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+
+    e->next = (e->next + 1) % VIDEO_SHM_BUFFERS;
+}
+
+#else
+
+static void shm_close_all(void)
+{
+}
+
+void video_shm_export(video_canvas_t *canvas, int index,
+                      int xs, int ys, int width, int height)
+{
+}
+
+#endif
+
+/*-----------------------------------------------------------------------*/
+
+static int set_shm_name(const char *val, void *param)
+{
+    if (shm_name != NULL && val != NULL && strcmp(shm_name, val) == 0) {
+        return 0;
+    }
+#ifndef VIDEO_SHM_SUPPORTED
+    if (val != NULL && *val != 0) {
+        log_error(LOG_DEFAULT, "Shared frame buffers are not supported on this platform.");
+    }
+#endif
+    shm_close_all();
+    util_string_set(&shm_name, val);
+    return 0;
+}
+
+static const resource_string_t resources_string[] = {
+    { "SharedFrameBuffer", "", RES_EVENT_NO, NULL,
+      &shm_name, set_shm_name, NULL },
+    RESOURCE_STRING_LIST_END
+};
+
+int video_shm_resources_init(void)
+{
+    return resources_register_string(resources_string);
+}
+
+static const cmdline_option_t cmdline_options[] =
+{
+    { "-sharedframebuffer", SET_RESOURCE, CMDLINE_ATTRIB_NEED_ARGS,
+      NULL, NULL, "SharedFrameBuffer", NULL,
+      "<Name>", "Export every frame through a shared memory object of that name" },
+    CMDLINE_LIST_END
+};
+
+int video_shm_cmdline_options_init(void)
+{
+    return cmdline_register_options(cmdline_options);
+}
+
+void video_shm_shutdown(void)
+{
+    shm_close_all();
+    lib_free(shm_name);
+    shm_name = NULL;
+}
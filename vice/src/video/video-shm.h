@@ -0,0 +1,85 @@
+/*
+ * video-shm.h - Export rendered frames through POSIX shared memory.
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef VICE_VIDEO_SHM_H
+#define VICE_VIDEO_SHM_H
+
+#include <stdint.h>
+
+/* Layout of the shared memory object, consumers may include this header.
+
+   The object starts with a video_shm_header_t, the pixel buffers follow at
+   the offsets given in the header. Every buffer holds one frame of 32 bit
+   pixels, the bits of each channel are given by the masks in the header.
+
+   Frames are written to the buffers in turn. While a buffer is written its
+   sequence number is odd. A consumer reads `latest', checks that the
+   sequence number of that buffer is even, uses the pixels in place and
+   then checks that the sequence number has not changed. A buffer is only
+   written again two frames after it was published.
+
+   `frame' counts the published frames. On Linux it is a futex word, a
+   consumer can wait for the next frame with FUTEX_WAIT on it (not the
+   private variant, the object is shared between processes).
+
+   The object grows when the frame size grows. `size' is the size of the
+   whole object, a consumer must map it again when it has grown. */
+
+#define VIDEO_SHM_MAGIC     0x45434956U     /* "VICE" */
+#define VIDEO_SHM_VERSION   1
+#define VIDEO_SHM_BUFFERS   3
+
+typedef struct video_shm_buffer_s {
+    volatile uint32_t sequence;     /* odd while the buffer is written */
+    uint32_t frame;                 /* value of `frame' when published */
+    uint32_t offset;                /* from the start of the object */
+    uint32_t width;                 /* in pixels */
+    uint32_t height;
+    uint32_t pitch;                 /* in bytes */
+    uint32_t interlaced;
+    uint32_t interlace_field;
+} video_shm_buffer_t;
+
+typedef struct video_shm_header_s {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t header_size;
+    volatile uint32_t size;         /* size of the whole object */
+    uint32_t red_mask;
+    uint32_t green_mask;
+    uint32_t blue_mask;
+    uint32_t alpha_mask;
+    volatile uint32_t latest;       /* index of the newest complete buffer */
+    volatile uint32_t frame;        /* number of published frames */
+    video_shm_buffer_t buffers[VIDEO_SHM_BUFFERS];
+} video_shm_header_t;
+
+struct video_canvas_s;
+
+int video_shm_resources_init(void);
+int video_shm_cmdline_options_init(void);
+void video_shm_export(struct video_canvas_s *canvas, int index,
+                      int xs, int ys, int width, int height);
+void video_shm_shutdown(void);
+
+#endif
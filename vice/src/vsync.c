@@ -52,6 +52,7 @@
 #include "archdep.h"
 #include "cmdline.h"
 #include "debug.h"
+#include "frametiming.h"
 #include "joystick.h"
 #include "kbdbuf.h"
 #include "lib.h"
@@ -527,8 +528,11 @@ void vsync_do_end_of_line(void)
         return;
     }
 
-    /* deal with any accumulated sound immediately */
+    /* deal with any accumulated sound immediately, a blocking sound device
+       is what keeps the emulation in sync */
+    frametiming_begin(FRAMETIMING_SYNC_WAIT);
     tick_based_sync_timing = sound_flush();
+    frametiming_end();
 
     tick_now = tick_now_after(last_sync_tick);
 
@@ -592,7 +596,9 @@ void vsync_do_end_of_line(void)
                 /* If we can't rely on the audio device for timing, slow down here. */
                 if (tick_based_sync_timing) {
                     if (can_yield_to_ui) {
+                        frametiming_begin(FRAMETIMING_SYNC_WAIT);
                         mainlock_yield_and_sleep(ticks_until_target);
+                        frametiming_end();
                     }
                 }
             } else if ((tick_t)0 - ticks_until_target > tick_per_second()) {
@@ -716,6 +722,7 @@ void vsync_do_vsync(struct video_canvas_s *c)
 
     now = tick_now_after(last_vsync);
     update_performance_metrics(now);
+    frametiming_frame_done();
 
     vsyncarch_postsync();
 
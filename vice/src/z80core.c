@@ -24,6 +24,8 @@
  *
  */
 
+#include "coverage.h"
+
 #ifdef Z80_4MHZ
 #define CLK_ADD(clock, amount) clock = z80cpu_clock_add(clock, amount)
 #else
@@ -4060,6 +4062,10 @@ static void z80_maincpu_loop(interrupt_cpu_status_t *cpu_int_status, alarm_conte
             continue;
         }
 
+        if (coverage_enabled) {
+            coverage_exec_z80(z80_reg_pc);
+        }
+
         SET_LAST_ADDR(z80_reg_pc);
 fetchmore:
         FETCH_OPCODE(opcode);
@@ -68,6 +68,9 @@
 #define ZDEBUG(a)
 #endif
 
+/* Chunk size for the in-process decompression */
+#define ZFILE_MEM_CHUNK 0x10000
+
 /* We could add more here...  */
 enum compression_type {
     COMPR_NONE,
@@ -91,6 +94,7 @@ struct zfile_s {
     struct zfile_s *prev, *next; /* Link to the previous and next nodes.  */
     zfile_action_t action;       /* action on close */
     char *request_string;        /* ui string for action=ZFILE_REQUEST */
+    uint8_t *mem_buf;            /* Uncompressed data behind `stream'.  */
 };
 typedef struct zfile_s zfile_t;
 
@@ -134,6 +138,7 @@ static void zfile_list_destroy(void)
 
         lib_free(p->orig_name);
         lib_free(p->tmp_name);
+        lib_free(p->mem_buf);
         next = p->next;
         lib_free(p);
         p = next;
@@ -160,7 +165,8 @@ static void zfile_list_add(const char *tmp_name,
                            const char *orig_name,
                            enum compression_type type,
                            int write_mode,
-                           FILE *stream, FILE *fd)
+                           FILE *stream, FILE *fd,
+                           uint8_t *mem_buf)
 {
     zfile_t *new_zfile = lib_malloc(sizeof(zfile_t));
 
@@ -175,6 +181,7 @@ static void zfile_list_add(const char *tmp_name,
     new_zfile->type = type;
     new_zfile->action = ZFILE_KEEP;
     new_zfile->request_string = NULL;
+    new_zfile->mem_buf = mem_buf;
     new_zfile->next = zfile_list;
     new_zfile->prev = NULL;
     if (zfile_list != NULL) {
@@ -241,6 +248,49 @@ static char *try_uncompress_with_gzip(const char *name)
     return tmp_name;
 }
 
+/* If `name' has a gzip-like extension, uncompress it into memory using zlib.
+   If this succeeds, return the data and store its length in `size'; return
+   NULL otherwise.  */
+static uint8_t *try_uncompress_with_gzip_to_memory(const char *name, size_t *size)
+{
+    gzFile fdsrc;
+    uint8_t *buf;
+    size_t buf_size = ZFILE_MEM_CHUNK;
+    size_t len = 0;
+    int n;
+
+    if (!file_is_gzip(name)) {
+        return NULL;
+    }
+
+    fdsrc = gzopen(name, MODE_READ);
+    if (fdsrc == NULL) {
+        return NULL;
+    }
+
+    buf = lib_malloc(buf_size);
+    do {
+        if (len == buf_size) {
+            buf_size *= 2;
+            buf = lib_realloc(buf, buf_size);
+        }
+        n = gzread(fdsrc, buf + len, (unsigned int)(buf_size - len));
+        if (n > 0) {
+            len += (size_t)n;
+        }
+    } while (n > 0);
+
+    gzclose(fdsrc);
+
+    if (n < 0 || len == 0) {
+        lib_free(buf);
+        return NULL;
+    }
+
+    *size = len;
+    return buf;
+}
+
 /* If `name' has a bzip-like extension, try to uncompress it into a temporary
    file using bzip.  If this succeeds, return the name of the temporary file;
    return NULL otherwise.  */
@@ -372,6 +422,333 @@ static int is_valid_extension(char *end, size_t l, int nameoffset)
 }
 
 
+/* In-process extraction of zip archives.
+
+   Only the central directory and the selected member are read, members that
+   are stored or deflated are handled, anything else (ZIP64, encryption,
+   other compression methods) is left to the external unzip.  */
+
+#define ZIP_EOCD_SIGNATURE      0x06054b50
+#define ZIP_CENTRAL_SIGNATURE   0x02014b50
+#define ZIP_LOCAL_SIGNATURE     0x04034b50
+
+#define ZIP_EOCD_SIZE           22
+#define ZIP_CENTRAL_SIZE        46
+#define ZIP_LOCAL_SIZE          30
+#define ZIP_MAX_COMMENT         0xffff
+
+#define ZIP_METHOD_STORED       0
+#define ZIP_METHOD_DEFLATED     8
+
+#define ZIP_FLAG_ENCRYPTED      0x0001
+
+#define ZIP_READ_CHUNK          0x4000
+
+typedef struct zip_entry_s {
+    char *name;
+    unsigned int flags;
+    unsigned int method;
+    uint32_t crc;
+    uint32_t csize;
+    uint32_t usize;
+    uint32_t offset;
+} zip_entry_t;
+
+/* Find the end of central directory record and read the location and number
+   of entries of the central directory.  */
+static int zip_read_eocd(FILE *fd, uint32_t *cd_offset, unsigned int *entries)
+{
+    uint8_t *buf;
+    long file_len;
+    size_t len;
+    size_t i;
+    int found = -1;
+
+    if (fseek(fd, 0, SEEK_END) < 0) {
+        return -1;
+    }
+    file_len = ftell(fd);
+    if (file_len < ZIP_EOCD_SIZE) {
+        return -1;
+    }
+
+    /* the record is at the end, followed by a comment of up to 64k */
+    len = (size_t)file_len;
+    if (len > ZIP_EOCD_SIZE + ZIP_MAX_COMMENT) {
+        len = ZIP_EOCD_SIZE + ZIP_MAX_COMMENT;
+    }
+
+    buf = lib_malloc(len);
+    if (fseek(fd, file_len - (long)len, SEEK_SET) < 0
+        || fread(buf, 1, len, fd) != len) {
+        lib_free(buf);
+        return -1;
+    }
+
+    for (i = len - ZIP_EOCD_SIZE + 1; i-- > 0; ) {
+        if (util_le_buf_to_dword(buf + i) == ZIP_EOCD_SIGNATURE) {
+            *entries = util_le_buf_to_word(buf + i + 10);
+            *cd_offset = util_le_buf_to_dword(buf + i + 16);
+            found = 0;
+            break;
+        }
+    }
+    lib_free(buf);
+
+    /* ZIP64 archives have the real values elsewhere */
+    if (found == 0 && (*entries == 0xffff || *cd_offset == 0xffffffff)) {
+        return -1;
+    }
+    return found;
+}
+
+static void zip_free_entries(zip_entry_t *entries, unsigned int count)
+{
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        lib_free(entries[i].name);
+    }
+    lib_free(entries);
+}
+
+/* Read the central directory, return the entries or NULL on error.  */
+static zip_entry_t *zip_read_central_directory(FILE *fd, unsigned int *count)
+{
+    zip_entry_t *entries;
+    uint8_t hdr[ZIP_CENTRAL_SIZE];
+    uint32_t cd_offset;
+    unsigned int num;
+    unsigned int i;
+    size_t name_len;
+
+    if (zip_read_eocd(fd, &cd_offset, &num) < 0 || num == 0) {
+        return NULL;
+    }
+    if (fseek(fd, (long)cd_offset, SEEK_SET) < 0) {
+        return NULL;
+    }
+
+    entries = lib_calloc(num, sizeof(zip_entry_t));
+    for (i = 0; i < num; i++) {
+        if (fread(hdr, 1, ZIP_CENTRAL_SIZE, fd) != ZIP_CENTRAL_SIZE
+            || util_le_buf_to_dword(hdr) != ZIP_CENTRAL_SIGNATURE) {
+            zip_free_entries(entries, i);
+            return NULL;
+        }
+        entries[i].flags = util_le_buf_to_word(hdr + 8);
+        entries[i].method = util_le_buf_to_word(hdr + 10);
+        entries[i].crc = util_le_buf_to_dword(hdr + 16);
+        entries[i].csize = util_le_buf_to_dword(hdr + 20);
+        entries[i].usize = util_le_buf_to_dword(hdr + 24);
+        entries[i].offset = util_le_buf_to_dword(hdr + 42);
+
+        name_len = util_le_buf_to_word(hdr + 28);
+        entries[i].name = lib_malloc(name_len + 1);
+        if (fread(entries[i].name, 1, name_len, fd) != name_len) {
+            zip_free_entries(entries, i + 1);
+            return NULL;
+        }
+        entries[i].name[name_len] = '\0';
+
+        /* skip extra field and comment */
+        if (fseek(fd, (long)(util_le_buf_to_word(hdr + 30)
+                             + util_le_buf_to_word(hdr + 32)), SEEK_CUR) < 0) {
+            zip_free_entries(entries, i + 1);
+            return NULL;
+        }
+    }
+
+    *count = num;
+    return entries;
+}
+
+/* Return the file name part of a member name.  */
+static char *zip_basename(char *name)
+{
+    char *p = strrchr(name, '/');
+
+    return p != NULL ? p + 1 : name;
+}
+
+/* Uncompress one member into `dest', which has room for `entry->usize'
+   bytes.  */
+static int zip_extract_entry(FILE *fd, const zip_entry_t *entry, uint8_t *dest)
+{
+    uint8_t hdr[ZIP_LOCAL_SIZE];
+    uint8_t buf[ZIP_READ_CHUNK];
+    z_stream zs;
+    uint32_t left;
+    size_t len;
+    int ret;
+
+    if (entry->flags & ZIP_FLAG_ENCRYPTED) {
+        return -1;
+    }
+    if (entry->method != ZIP_METHOD_STORED
+        && entry->method != ZIP_METHOD_DEFLATED) {
+        return -1;
+    }
+
+    /* the local header may have a different extra field than the central
+       directory, so its lengths have to be used to find the data */
+    if (fseek(fd, (long)entry->offset, SEEK_SET) < 0
+        || fread(hdr, 1, ZIP_LOCAL_SIZE, fd) != ZIP_LOCAL_SIZE
+        || util_le_buf_to_dword(hdr) != ZIP_LOCAL_SIGNATURE
+        || fseek(fd, (long)(util_le_buf_to_word(hdr + 26)
+                            + util_le_buf_to_word(hdr + 28)), SEEK_CUR) < 0) {
+        return -1;
+    }
+
+    if (entry->method == ZIP_METHOD_STORED) {
+        if (entry->csize != entry->usize
+            || fread(dest, 1, entry->usize, fd) != entry->usize) {
+            return -1;
+        }
+    } else {
+        memset(&zs, 0, sizeof(zs));
+        /* raw deflate data, no zlib header */
+        if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+            return -1;
+        }
+        zs.next_out = dest;
+        zs.avail_out = entry->usize;
+
+        left = entry->csize;
+        ret = Z_OK;
+        while (ret == Z_OK && left > 0) {
+            len = left < sizeof(buf) ? left : sizeof(buf);
+            if (fread(buf, 1, len, fd) != len) {
+                break;
+            }
+            left -= (uint32_t)len;
+            zs.next_in = buf;
+            zs.avail_in = (uInt)len;
+            ret = inflate(&zs, Z_NO_FLUSH);
+        }
+        inflateEnd(&zs);
+
+        if (ret != Z_STREAM_END || zs.total_out != entry->usize) {
+            return -1;
+        }
+    }
+
+    if (crc32(crc32(0L, Z_NULL, 0), dest, entry->usize) != entry->crc) {
+        log_error(zlog, "CRC error in `%s'.", entry->name);
+        return -1;
+    }
+    return 0;
+}
+
+/* If `name' is a zip archive, uncompress the first member with a known
+   extension into memory and return it, storing its length in `size'. The
+   four files of a zipcode image are joined, like the external unzip does.
+   If the archive is valid but `write_mode' is non-zero, set `tmp_name' to a
+   zero-length string.  Return NULL if the archive cannot be handled here.  */
+static uint8_t *try_uncompress_zip(const char *name, int write_mode,
+                                   size_t *size, char **tmp_name)
+{
+    FILE *fd;
+    zip_entry_t *entries;
+    zip_entry_t *parts[4];
+    unsigned int count;
+    unsigned int num_parts = 1;
+    unsigned int i;
+    unsigned int j;
+    char *base;
+    uint8_t *buf = NULL;
+    size_t len = 0;
+    size_t l = strlen(name);
+
+    if (l <= 4 || util_strcasecmp(name + l - 4, ".zip") != 0) {
+        return NULL;
+    }
+
+    fd = fopen(name, MODE_READ);
+    if (fd == NULL) {
+        return NULL;
+    }
+
+    entries = zip_read_central_directory(fd, &count);
+    if (entries == NULL) {
+        ZDEBUG(("try_uncompress_zip: cannot read central directory of `%s'.", name));
+        fclose(fd);
+        return NULL;
+    }
+
+    parts[0] = NULL;
+    for (i = 0; i < count && parts[0] == NULL; i++) {
+        base = zip_basename(entries[i].name);
+        if (is_valid_extension(base, strlen(base), 0)) {
+            parts[0] = &entries[i];
+        }
+    }
+
+    if (parts[0] == NULL) {
+        ZDEBUG(("try_uncompress_zip: no valid file found."));
+        goto out;
+    }
+    ZDEBUG(("try_uncompress_zip: found `%s'.", parts[0]->name));
+
+    /* This would be a valid ZIP file, but we cannot handle ZIP files in
+       write mode.  Return a null temporary file name to report this.  */
+    if (write_mode) {
+        ZDEBUG(("try_uncompress_zip: cannot open file in write mode."));
+        *tmp_name = "";
+        goto out;
+    }
+
+    /* find 2!name, 3!name and 4!name in the same directory */
+    base = zip_basename(parts[0]->name);
+    if (is_zipcode_name(base)) {
+        for (num_parts = 1; num_parts < 4; num_parts++) {
+            parts[num_parts] = NULL;
+            for (j = 0; j < count; j++) {
+                char *other = zip_basename(entries[j].name);
+
+                if (other[0] == (char)('1' + num_parts)
+                    && strcmp(other + 1, base + 1) == 0
+                    && other - entries[j].name == base - parts[0]->name
+                    && strncmp(entries[j].name, parts[0]->name,
+                               (size_t)(base - parts[0]->name)) == 0) {
+                    parts[num_parts] = &entries[j];
+                    break;
+                }
+            }
+            if (parts[num_parts] == NULL) {
+                break;
+            }
+        }
+    }
+
+    for (i = 0; i < num_parts; i++) {
+        len += parts[i]->usize;
+    }
+    if (len == 0) {
+        goto out;
+    }
+
+    buf = lib_malloc(len);
+    len = 0;
+    for (i = 0; i < num_parts; i++) {
+        if (zip_extract_entry(fd, parts[i], buf + len) < 0) {
+            ZDEBUG(("try_uncompress_zip: cannot extract `%s'.", parts[i]->name));
+            lib_free(buf);
+            buf = NULL;
+            goto out;
+        }
+        len += parts[i]->usize;
+    }
+    *size = len;
+
+out:
+    zip_free_entries(entries, count);
+    fclose(fd);
+    return buf;
+}
+
+/* ------------------------------------------------------------------------ */
+
 /* If `name' has a correct extension, try to list its contents and search for
    the first file with a proper extension; if found, extract it.  If this
    succeeds, return the name of the temporary file; if the archive file is
@@ -740,17 +1117,30 @@ static const valid_archives_t valid_archives[] = {
 };
 
 /* Try to uncompress file `name' using the algorithms we know of.  If this is
-   not possible, return `COMPR_NONE'.  Otherwise, uncompress the file into a
-   temporary file, return the type of algorithm used and the name of the
+   not possible, return `COMPR_NONE'.  Otherwise, uncompress the file into
+   memory or a temporary file, return the type of algorithm used and either
+   the data in `mem_buf' and its length in `mem_size', or the name of the
    temporary file in `tmp_name'.  If `write_mode' is non-zero and the
    returned `tmp_name' has zero length, then the file cannot be accessed in
    write mode.  */
 static enum compression_type try_uncompress(const char *name,
                                             char **tmp_name,
+                                            uint8_t **mem_buf,
+                                            size_t *mem_size,
                                             int write_mode)
 {
     int i;
 
+    *tmp_name = NULL;
+    *mem_buf = NULL;
+
+    /* zip and gzip are handled in-process, no external program and no
+       temporary file is needed for them */
+    if ((*mem_buf = try_uncompress_zip(name, write_mode, mem_size, tmp_name)) != NULL
+        || *tmp_name != NULL) {
+        return COMPR_ARCHIVE;
+    }
+
     for (i = 0; valid_archives[i].program; i++) {
         if ((*tmp_name = try_uncompress_archive(name, write_mode,
                                                 valid_archives[i].program,
@@ -763,8 +1153,13 @@ static enum compression_type try_uncompress(const char *name,
         }
     }
 
-    /* need this order or .tar.gz is misunderstood */
-    if ((*tmp_name = try_uncompress_with_gzip(name)) != NULL) {
+    /* need this order or .tar.gz is misunderstood. Writable files are
+       recompressed from a temporary file on close.  */
+    if (!write_mode
+        && (*mem_buf = try_uncompress_with_gzip_to_memory(name, mem_size)) != NULL) {
+        return COMPR_GZIP;
+    }
+    if (write_mode && (*tmp_name = try_uncompress_with_gzip(name)) != NULL) {
         return COMPR_GZIP;
     }
 
@@ -965,10 +1360,44 @@ static int zfile_compress(const char *src, const char *dest,
    When a file that was opened for writing is closed, we re-compress the
    uncompressed version and update the original file.  */
 
+/* Open a read-only stream on uncompressed data in memory.  Without
+   fmemopen() the data is written to a temporary file, which is returned in
+   `tmp_name', and `buf' is freed.  */
+static FILE *zfile_open_memory(uint8_t **buf, size_t size, const char *mode,
+                               char **tmp_name)
+{
+#ifdef HAVE_FMEMOPEN
+    return fmemopen(*buf, size, mode);
+#else
+    FILE *fd;
+    size_t written;
+
+    fd = archdep_mkstemp_fd(tmp_name, MODE_WRITE);
+    if (fd == NULL) {
+        return NULL;
+    }
+    written = fwrite(*buf, 1, size, fd);
+    fclose(fd);
+    lib_free(*buf);
+    *buf = NULL;
+    if (written != size) {
+        archdep_remove(*tmp_name);
+        return NULL;
+    }
+    fd = fopen(*tmp_name, mode);
+    if (fd == NULL) {
+        archdep_remove(*tmp_name);
+    }
+    return fd;
+#endif
+}
+
 /* `fopen()' wrapper.  */
 FILE *zfile_fopen(const char *name, const char *mode)
 {
     char *tmp_name;
+    uint8_t *mem_buf;
+    size_t mem_size = 0;
     FILE *stream;
     enum compression_type type;
     int write_mode = 0;
@@ -991,13 +1420,23 @@ FILE *zfile_fopen(const char *name, const char *mode)
         return NULL;
     }
 
-    type = try_uncompress(name, &tmp_name, write_mode);
+    type = try_uncompress(name, &tmp_name, &mem_buf, &mem_size, write_mode);
     if (type == COMPR_NONE) {
         stream = fopen(name, mode);
         if (stream == NULL) {
             return NULL;
         }
-        zfile_list_add(NULL, name, type, write_mode, stream, NULL);
+        zfile_list_add(NULL, name, type, write_mode, stream, NULL, NULL);
+        return stream;
+    } else if (mem_buf != NULL) {
+        stream = zfile_open_memory(&mem_buf, mem_size, mode, &tmp_name);
+        if (stream == NULL) {
+            lib_free(mem_buf);
+            lib_free(tmp_name);
+            return NULL;
+        }
+        zfile_list_add(tmp_name, name, type, write_mode, stream, NULL, mem_buf);
+        lib_free(tmp_name);
         return stream;
     } else if (*tmp_name == '\0') {
         errno = EACCES;
@@ -1010,7 +1449,7 @@ FILE *zfile_fopen(const char *name, const char *mode)
         return NULL;
     }
 
-    zfile_list_add(tmp_name, name, type, write_mode, stream, NULL);
+    zfile_list_add(tmp_name, name, type, write_mode, stream, NULL, NULL);
 
     /* now we don't need the archdep_tmpnam allocation any more */
     lib_free(tmp_name);
@@ -1086,6 +1525,7 @@ static int handle_close(zfile_t *ptr)
     if (ptr->request_string) {
         lib_free(ptr->request_string);
     }
+    lib_free(ptr->mem_buf);
 
     lib_free(ptr);
 